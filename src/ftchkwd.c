@@ -14,11 +14,23 @@
 
 #include <ft2build.h>
 #include <freetype/freetype.h>
+#include <freetype/ftadvanc.h>
+
+#include "mlgetopt.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#define CHKWD_THREADS
+#include <pthread.h>
+#endif
+
+
+  /* number of advances retrieved at once */
+#define ADVANCE_BATCH  1024
+
 
   FT_Error  error;
 
@@ -29,7 +41,12 @@
     printf( "ftchkwd: test fixed font width -- part of the FreeType project\n" );
     printf( "---------------------------------------------------------------------\n" );
     printf( "\n" );
-    printf( "Usage: %s fontname[.ttf|.ttc] [fontname2..]\n", name );
+    printf( "Usage: %s [options] fontname[.ttf|.ttc] [fontname2..]\n", name );
+    printf( "\n" );
+    printf( "  -c      Print a CSV report instead.\n" );
+#ifdef CHKWD_THREADS
+    printf( "  -j N    Use N threads (default: 1).\n" );
+#endif
     printf( "\n" );
 
     exit( 1 );
@@ -63,45 +80,179 @@
   }
 
 
-  static void
-  check_face( FT_Face      face,
-              const char*  filepathname,
-              int          idx )
+  /* The result of checking one file. */
+  typedef struct  CheckRec_
   {
-    int  face_has_fixed_flag = FT_IS_FIXED_WIDTH(face);
-    int  face_max_advance    = face->max_advance_width;
-    int  num_proportional    = 0;
-    int  n;
+    const char*  fname;
 
-    FT_UNUSED( idx );
+    FT_Error     error;             /* from opening the face             */
+    int          retried;           /* error refers to the `.ttf' name   */
 
+    char*        family;
+    char*        style;
+    int          fixed_flag;
+    int          max_advance;
+    FT_Long      num_glyphs;
+    int          num_proportional;
 
-    printf( "%15s : %20s : ",
-            file_basename( filepathname ),
-            face->family_name ? face->family_name : "UNKNOWN FAMILY" );
+    int          done;
+
+  } CheckRec, *Check;
+
+
+  static char*
+  copy_string( const char*  s )
+  {
+    char*  copy;
+
+
+    if ( !s )
+      return NULL;
+
+    copy = (char*)malloc( strlen( s ) + 1 );
+    if ( !copy )
+    {
+      error = FT_Err_Out_Of_Memory;
+      Panic( "Out of memory" );
+    }
+
+    return strcpy( copy, s );
+  }
+
+
+  /* Count the glyphs whose advance width differs from the maximum. */
+  static int
+  count_proportional( FT_Face  face )
+  {
+    FT_Fixed  advances[ADVANCE_BATCH];
+    FT_Long   max_advance      = face->max_advance_width;
+    int       num_proportional = 0;
+    FT_Long   n, count, i;
+
+
+    /* Bulk-read unscaled advances if the driver can do that without */
+    /* loading glyphs, as with the `hmtx' table of SFNT fonts.        */
+    for ( n = 0; n < face->num_glyphs; n += count )
+    {
+      count = face->num_glyphs - n;
+      if ( count > ADVANCE_BATCH )
+        count = ADVANCE_BATCH;
+
+      if ( FT_Get_Advances( face, (FT_UInt)n, (FT_UInt)count,
+                            FT_LOAD_NO_SCALE | FT_ADVANCE_FLAG_FAST_ONLY,
+                            advances ) )
+        goto Slow;
+
+      for ( i = 0; i < count; i++ )
+        if ( advances[i] != max_advance )
+          num_proportional++;
+    }
+
+    return num_proportional;
+
+  Slow:
+    num_proportional = 0;
 
     for ( n = 0; n < face->num_glyphs; n++ )
     {
       /* load the glyph outline */
-      error = FT_Load_Glyph( face, n, FT_LOAD_NO_SCALE );
-      if ( error )
+      if ( FT_Load_Glyph( face, (FT_UInt)n, FT_LOAD_NO_SCALE ) )
         continue;
 
-      if ( face->glyph->metrics.horiAdvance != face_max_advance )
+      if ( face->glyph->metrics.horiAdvance != max_advance )
         num_proportional++;
     }
 
-    if ( num_proportional > 0 )
+    return num_proportional;
+  }
+
+
+  static void
+  check_file( FT_Library  library,
+              Check       check )
+  {
+    FT_Face      face;
+    FT_Error     err;
+    const char*  fname = check->fname;
+    char         filename[1024 + 4];
+    int          i;
+
+
+    /* try to open the file with no extra extension first */
+    err = FT_New_Face( library, fname, 0, &face );
+    if ( !err )
+      goto Success;
+
+    check->error = err;
+    if ( err == FT_Err_Unknown_File_Format )
+      return;
+
+    /* Ok, we could not load the file.  Try to add an extension to */
+    /* its name if possible.                                       */
+
+    i = (int)strlen( fname );
+    while ( i > 0 && fname[i] != '\\' && fname[i] != '/' )
+    {
+      if ( fname[i] == '.' )
+        i = 0;
+      i--;
+    }
+
+#ifndef macintosh
+    snprintf( filename, sizeof ( filename ), "%s%s", fname,
+              ( i >= 0 ? ".ttf" : "" ) );
+#else
+    snprintf( filename, sizeof ( filename ), "%s", fname );
+#endif
+
+    /* Load face */
+    check->retried = 1;
+    check->error   = FT_New_Face( library, filename, 0, &face );
+    if ( check->error )
+      return;
+
+  Success:
+    check->error            = 0;
+    check->family           = copy_string( face->family_name );
+    check->style            = copy_string( face->style_name );
+    check->fixed_flag       = FT_IS_FIXED_WIDTH( face ) ? 1 : 0;
+    check->max_advance      = face->max_advance_width;
+    check->num_glyphs       = face->num_glyphs;
+    check->num_proportional = count_proportional( face );
+
+    FT_Done_Face( face );
+  }
+
+
+  static void
+  print_check( Check  check )
+  {
+    if ( check->error )
+    {
+      if ( !check->retried )
+        fprintf( stderr, "%s: unknown format\n", check->fname );
+      else if ( check->error == FT_Err_Unknown_File_Format )
+        printf( "unknown format\n" );
+      else
+        printf( "could not find/open file (error: %d)\n", check->error );
+      return;
+    }
+
+    printf( "%15s : %20s : ",
+            file_basename( check->fname ),
+            check->family ? check->family : "UNKNOWN FAMILY" );
+
+    if ( check->num_proportional > 0 )
     {
-      if ( face_has_fixed_flag )
+      if ( check->fixed_flag )
         printf( "KO!  Tagged as fixed, but has %d `proportional' glyphs",
-                 num_proportional );
+                 check->num_proportional );
       else
         printf( "OK (proportional)" );
     }
     else
     {
-      if ( face_has_fixed_flag )
+      if ( check->fixed_flag )
         printf( "OK (fixed-width)" );
       else
         printf( "KO!  Tagged as proportional but has fixed width" );
@@ -110,79 +261,228 @@
   }
 
 
+  /* Print a CSV field, quoting it if necessary. */
+  static void
+  print_csv_field( const char*  s )
+  {
+    if ( !s )
+      return;
+
+    if ( !strpbrk( s, ",\"\r\n" ) )
+    {
+      fputs( s, stdout );
+      return;
+    }
+
+    putchar( '"' );
+    for ( ; *s; s++ )
+    {
+      if ( *s == '"' )
+        putchar( '"' );
+      putchar( *s );
+    }
+    putchar( '"' );
+  }
+
+
+  static void
+  print_csv( Check  check )
+  {
+    print_csv_field( check->fname );
+
+    if ( check->error )
+    {
+      printf( ",,,,,,,error,%d\n", check->error );
+      return;
+    }
+
+    putchar( ',' );
+    print_csv_field( check->family );
+    putchar( ',' );
+    print_csv_field( check->style );
+
+    printf( ",%d,%d,%ld,%d,%s,\n",
+            check->fixed_flag,
+            check->max_advance,
+            check->num_glyphs,
+            check->num_proportional,
+            check->num_proportional > 0
+              ? ( check->fixed_flag ? "mistagged-fixed" : "proportional" )
+              : ( check->fixed_flag ? "fixed" : "mistagged-proportional" ) );
+  }
+
+
+#ifdef CHKWD_THREADS
+
+  static struct
+  {
+    Check            checks;
+    int              num_checks;
+    int              next;
+    pthread_mutex_t  lock;
+    pthread_cond_t   done;
+
+  } pool = { NULL, 0, 0,
+             PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+
+  static void*
+  worker( void*  arg )
+  {
+    FT_Library  library = NULL;
+
+
+    FT_UNUSED( arg );
+
+    /* FreeType objects must not be shared between threads */
+    (void)FT_Init_FreeType( &library );
+
+    for (;;)
+    {
+      Check  check;
+
+
+      pthread_mutex_lock( &pool.lock );
+      check = pool.next < pool.num_checks ? pool.checks + pool.next++
+                                          : NULL;
+      pthread_mutex_unlock( &pool.lock );
+
+      if ( !check )
+        break;
+
+      check_file( library, check );
+
+      pthread_mutex_lock( &pool.lock );
+      check->done = 1;
+      pthread_cond_broadcast( &pool.done );
+      pthread_mutex_unlock( &pool.lock );
+    }
+
+    FT_Done_FreeType( library );
+
+    return NULL;
+  }
+
+#endif /* CHKWD_THREADS */
+
+
   int
   main( int     argc,
         char**  argv )
   {
-    FT_Face     face;
     FT_Library  library;
 
     int         i, file_index;
-    char        filename[1024 + 4];
     char*       execname;
-    char*       fname;
+    int         option;
+    int         csv  = 0;
+    int         jobs = 1;
+    Check       checks;
+
+#ifdef CHKWD_THREADS
+    pthread_t*  threads   = NULL;
+    int         n_threads = 0;
+#endif
 
 
     execname = argv[0];
 
-    if ( argc < 2 )
+    while ( ( option = getopt( argc, argv, "cj:" ) ) != -1 )
+    {
+      switch ( option )
+      {
+      case 'c':
+        csv = 1;
+        break;
+
+      case 'j':
+        jobs = atoi( optarg );
+        if ( jobs < 1 )
+          jobs = 1;
+        break;
+
+      default:
+        Usage( execname );
+        break;
+      }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if ( argc < 1 )
       Usage( execname );
 
     error = FT_Init_FreeType( &library );
     if ( error )
       Panic( "Could not create library object" );
 
-    /* Now check all files */
-    for ( file_index = 1; file_index < argc; file_index++ )
+    checks = (Check)calloc( (size_t)argc, sizeof ( CheckRec ) );
+    if ( !checks )
     {
-      fname = argv[file_index];
+      error = FT_Err_Out_Of_Memory;
+      Panic( "Out of memory" );
+    }
 
-      /* try to open the file with no extra extension first */
-      error = FT_New_Face( library, fname, 0, &face );
-      if ( !error )
-        goto Success;
+    for ( file_index = 0; file_index < argc; file_index++ )
+      checks[file_index].fname = argv[file_index];
 
-      if ( error == FT_Err_Unknown_File_Format )
-      {
-        fprintf( stderr, "%s: unknown format\n", fname );
-        continue;
-      }
+#ifdef CHKWD_THREADS
+    if ( jobs > 1 )
+    {
+      pool.checks     = checks;
+      pool.num_checks = argc;
+
+      threads = (pthread_t*)malloc( (size_t)jobs * sizeof ( pthread_t ) );
+      if ( threads )
+        for ( ; n_threads < jobs; n_threads++ )
+          if ( pthread_create( &threads[n_threads], NULL, worker, NULL ) )
+            break;
+    }
+#endif
 
-      /* Ok, we could not load the file.  Try to add an extension to */
-      /* its name if possible.                                       */
+    if ( csv )
+      printf( "file,family,style,fixed_flag,max_advance,num_glyphs,"
+              "proportional,result,error\n" );
 
-      i = strlen( fname );
-      while ( i > 0 && fname[i] != '\\' && fname[i] != '/' )
-      {
-        if ( fname[i] == '.' )
-          i = 0;
-        i--;
-      }
+    /* Now check all files, reporting them in command line order */
+    for ( file_index = 0; file_index < argc; file_index++ )
+    {
+      Check  check = checks + file_index;
 
-#ifndef macintosh
-      snprintf( filename, sizeof ( filename ), "%s%s", fname,
-                ( i >= 0 ? ".ttf" : "" ) );
-#else
-      snprintf( filename, sizeof ( filename ), "%s", fname );
-#endif
 
-      /* Load face */
-      error = FT_New_Face( library, filename, 0, &face );
-      if ( error )
+#ifdef CHKWD_THREADS
+      if ( n_threads > 0 )
       {
-        if ( error == FT_Err_Unknown_File_Format )
-          printf( "unknown format\n" );
-        else
-          printf( "could not find/open file (error: %d)\n", error );
-        continue;
+        pthread_mutex_lock( &pool.lock );
+        while ( !check->done )
+          pthread_cond_wait( &pool.done, &pool.lock );
+        pthread_mutex_unlock( &pool.lock );
       }
+      else
+#endif
+        check_file( library, check );
 
-  Success:
-      check_face( face, fname, face->face_index );
+      if ( csv )
+        print_csv( check );
+      else
+        print_check( check );
 
-      FT_Done_Face( face );
+      free( check->family );
+      free( check->style );
     }
 
+#ifdef CHKWD_THREADS
+    for ( i = 0; i < n_threads; i++ )
+      pthread_join( threads[i], NULL );
+    free( threads );
+#else
+    FT_UNUSED( i );
+    FT_UNUSED( jobs );
+#endif
+
+    free( checks );
+
     FT_Done_FreeType( library );
     exit( 0 );      /* for safety reasons */
 
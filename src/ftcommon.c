@@ -18,6 +18,7 @@
 #include <ft2build.h>
 #include <freetype/freetype.h>
 
+#include <freetype/ftadvanc.h>
 #include <freetype/ftbitmap.h>
 #include <freetype/ftcache.h>
 #include <freetype/ftdriver.h>  /* access driver name and properties */
@@ -34,6 +35,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined UNIX
+#include <unistd.h>
+#endif
 
 
 #ifdef _WIN32
@@ -219,6 +228,8 @@
     if ( !display )
       return;
 
+    FTDemo_Display_Export_Wait();
+
     display->bitmap = NULL;
     grDoneSurface( display->surface );
 
@@ -253,6 +264,75 @@
 #define TRUNC( x )  (   (x) >> 6 )
 
 
+  /* monotonic wall clock in microseconds, for the instrumentation */
+  static double
+  get_time( void )
+  {
+#if defined _WIN32
+    static double  interval;
+    LARGE_INTEGER  ticks;
+
+
+    if ( !interval )
+    {
+      LARGE_INTEGER  freq;
+
+
+      QueryPerformanceFrequency( &freq );
+      interval = 1e6 / freq.QuadPart;
+    }
+
+    QueryPerformanceCounter( &ticks );
+
+    return interval * ticks.QuadPart;
+
+#elif defined CLOCK_MONOTONIC
+    struct timespec  tv;
+
+
+    clock_gettime( CLOCK_MONOTONIC, &tv );
+
+    return 1e6 * tv.tv_sec + 1e-3 * tv.tv_nsec;
+
+#else
+    return 1e6 * clock() / CLOCKS_PER_SEC;
+
+#endif
+  }
+
+
+  /* take timestamps only while the statistics are enabled */
+  static double
+  stats_time( FTDemo_Handle*  handle )
+  {
+    return handle->show_stats ? get_time() : 0.0;
+  }
+
+
+  /* the cache manager closes evicted faces and sizes, */
+  /* which calls their finalizers                      */
+  static void
+  face_finalizer( void*  object )
+  {
+    FT_Face         face   = (FT_Face)object;
+    FTDemo_Handle*  handle = (FTDemo_Handle*)face->generic.data;
+
+
+    handle->stats.face_evictions++;
+  }
+
+
+  static void
+  size_finalizer( void*  object )
+  {
+    FT_Size         size   = (FT_Size)object;
+    FTDemo_Handle*  handle = (FTDemo_Handle*)size->generic.data;
+
+
+    handle->stats.size_evictions++;
+  }
+
+
   /*************************************************************************/
   /*                                                                       */
   /* The face requester is a function provided by the client application   */
@@ -267,10 +347,11 @@
                      FT_Pointer  request_data,
                      FT_Face*    aface )
   {
-    PFont  font = (PFont)face_id;
+    PFont           font   = (PFont)face_id;
+    FTDemo_Handle*  handle = (FTDemo_Handle*)request_data;
 
-    FT_UNUSED( request_data );
 
+    handle->stats.face_loads++;
 
     if ( font->file_address != NULL )
       error = FT_New_Memory_Face( lib,
@@ -336,6 +417,9 @@
 
       if ( (*aface)->charmaps && font->cmap_index < (*aface)->num_charmaps )
         (*aface)->charmap = (*aface)->charmaps[font->cmap_index];
+
+      (*aface)->generic.data      = handle;
+      (*aface)->generic.finalizer = face_finalizer;
     }
 
     return error;
@@ -363,7 +447,8 @@
                            "ot-svg", "svg-hooks", &rsvg_hooks );
 
     error = FTC_Manager_New( handle->library, 0, 0, 0,
-                             my_face_requester, 0, &handle->cache_manager );
+                             my_face_requester, handle,
+                             &handle->cache_manager );
     if ( error )
       PanicZ( "could not initialize cache manager" );
 
@@ -394,6 +479,7 @@
     handle->lcd_mode   = LCD_MODE_AA;
 
     handle->use_sbits_cache = 1;
+    handle->subpixel_steps  = 0;
 
     /* string_init */
     memset( handle->string, 0, sizeof ( TGlyph ) * MAX_GLYPHS );
@@ -433,6 +519,18 @@
         FT_Done_Glyph( glyph->image );
     }
 
+    for ( i = 0; i < MAX_SUBPIXEL_GLYPHS; i++ )
+    {
+      PSubpixel  sub = handle->subpixel_glyphs + i;
+
+
+      if ( sub->image )
+        FT_Done_Glyph( sub->image );
+    }
+
+    grDoneBitmap( &handle->atlas.bitmap );
+    free( handle->atlas.glyphs );
+
     FT_Stroker_Done( handle->stroker );
     FT_Bitmap_Done( handle->library, &handle->bitmap );
     FTC_Manager_Done( handle->cache_manager );
@@ -444,6 +542,34 @@
   }
 
 
+  void
+  FTDemo_Stats_Print( FTDemo_Handle*  handle )
+  {
+    FTDemo_Stats*  s = &handle->stats;
+
+
+    /* without the overlay, most columns would be zero */
+    if ( !handle->stats_used )
+      return;
+
+    printf( "face loads     %10lu %12s     (%lu evictions)\n",
+            s->face_loads, "", s->face_evictions );
+    printf( "size loads     %10lu %12s     (%lu evictions)\n",
+            s->size_loads, "", s->size_evictions );
+    printf( "cmap lookups   %10lu %12.0f us\n",
+            s->cmap_lookups, s->cmap_time );
+    printf( "glyph lookups  %10lu %12.0f us  (%lu sbits, %lu misses)\n",
+            s->glyph_lookups, s->lookup_time,
+            s->sbit_lookups, s->glyph_misses );
+    printf( "atlas lookups  %10lu %12s     (%lu misses)\n",
+            s->atlas_lookups, "", s->atlas_misses );
+    printf( "renders        %10lu %12.0f us\n",
+            s->renders, s->render_time );
+    printf( "blits          %10lu %12.0f us\n",
+            s->blits, s->blit_time );
+  }
+
+
   void
   FTDemo_Version( FTDemo_Handle*  handle,
                   FT_String       str[64] )
@@ -943,10 +1069,17 @@
     {
       FTC_FaceID  face_id = handle->scaler.face_id;
       PFont       font    = handle->current_font;
+      FT_UInt     gindex;
+      double      t0      = stats_time( handle );
+
 
+      gindex = FTC_CMapCache_Lookup( handle->cmap_cache, face_id,
+                                     font->cmap_index, charcode );
 
-      return FTC_CMapCache_Lookup( handle->cmap_cache, face_id,
-                                   font->cmap_index, charcode );
+      handle->stats.cmap_lookups++;
+      handle->stats.cmap_time += stats_time( handle ) - t0;
+
+      return gindex;
     }
     else
       return (FT_UInt)charcode;
@@ -963,11 +1096,21 @@
     error = FTC_Manager_LookupSize( handle->cache_manager,
                                     &handle->scaler,
                                     &size );
+    if ( error )
+      return error;
 
-    if ( !error )
-      *asize = size;
+    /* a size created by the cache manager since the last lookup */
+    if ( !size->generic.finalizer )
+    {
+      size->generic.data      = handle;
+      size->generic.finalizer = size_finalizer;
 
-    return error;
+      handle->stats.size_loads++;
+    }
+
+    *asize = size;
+
+    return FT_Err_Ok;
   }
 
 
@@ -1041,6 +1184,11 @@
     /* are of appropriate type, then unloading them explicitly. */
     FTC_Manager_Reset( handle->cache_manager );
 
+    /* also force FTDemo_String_Load to reload all glyphs */
+    /* and the glyph atlas to start over                  */
+    handle->string_scaler.face_id = NULL;
+    handle->atlas.scaler.face_id  = NULL;
+
     return 1;
   }
 
@@ -1335,6 +1483,56 @@
 
     grWriteCellString( display->bitmap, 0, line * HEADER_HEIGHT,
                        strbuf_value( buf ), display->fore_color );
+
+    /* statistics since the previous header, bottom right */
+    if ( handle->show_stats )
+    {
+      FTDemo_Stats*  s = &handle->stats;
+      FTDemo_Stats*  f = &handle->frame_stats;
+
+
+      y = display->bitmap->rows - 3 * HEADER_HEIGHT;
+
+      strbuf_reset( buf );
+      strbuf_format( buf,
+                     "cmap %lu, glyph %lu/%lu (sbits %lu), atlas %lu/%lu",
+                     s->cmap_lookups  - f->cmap_lookups,
+                     s->glyph_misses  - f->glyph_misses,
+                     s->glyph_lookups - f->glyph_lookups,
+                     s->sbit_lookups  - f->sbit_lookups,
+                     s->atlas_misses  - f->atlas_misses,
+                     s->atlas_lookups - f->atlas_lookups );
+      grWriteCellString( display->bitmap,
+                         display->bitmap->width - 8 * (int)strbuf_len( buf ),
+                         y, strbuf_value( buf ), display->fore_color );
+
+      strbuf_reset( buf );
+      strbuf_format( buf,
+                     "faces +%lu -%lu, sizes +%lu -%lu, renders %lu, blits %lu",
+                     s->face_loads     - f->face_loads,
+                     s->face_evictions - f->face_evictions,
+                     s->size_loads     - f->size_loads,
+                     s->size_evictions - f->size_evictions,
+                     s->renders        - f->renders,
+                     s->blits          - f->blits );
+      grWriteCellString( display->bitmap,
+                         display->bitmap->width - 8 * (int)strbuf_len( buf ),
+                         y + HEADER_HEIGHT,
+                         strbuf_value( buf ), display->fore_color );
+
+      strbuf_reset( buf );
+      strbuf_format( buf, "us: cmap %.0f, lookup %.0f, render %.0f, blit %.0f",
+                     s->cmap_time   - f->cmap_time,
+                     s->lookup_time - f->lookup_time,
+                     s->render_time - f->render_time,
+                     s->blit_time   - f->blit_time );
+      grWriteCellString( display->bitmap,
+                         display->bitmap->width - 8 * (int)strbuf_len( buf ),
+                         y + 2 * HEADER_HEIGHT,
+                         strbuf_value( buf ), display->fore_color );
+    }
+
+    handle->frame_stats = handle->stats;
   }
 
 
@@ -1360,6 +1558,7 @@
          glyf->format == FT_GLYPH_FORMAT_SVG     )
     {
       FT_Render_Mode  render_mode;
+      double          t0;
 
 
       switch ( handle->lcd_mode )
@@ -1387,8 +1586,14 @@
         render_mode = FT_RENDER_MODE_NORMAL;
       }
 
+      t0 = stats_time( handle );
+
       /* render the glyph to a bitmap, don't destroy original */
       error = FT_Glyph_To_Bitmap( &glyf, render_mode, NULL, 0 );
+
+      handle->stats.renders++;
+      handle->stats.render_time += stats_time( handle ) - t0;
+
       if ( error )
         return error;
 
@@ -1460,6 +1665,33 @@
   }
 
 
+  /* On a miss, the caches load the glyph into the glyph slot of the */
+  /* face; with the statistics enabled, mark the slot beforehand to   */
+  /* detect this.                                                     */
+  static FT_GlyphSlot
+  stats_miss_begin( FTDemo_Handle*  handle )
+  {
+    FT_Size  size;
+
+
+    if ( !handle->show_stats || FTDemo_Get_Size( handle, &size ) )
+      return NULL;
+
+    size->face->glyph->glyph_index = ~0U;
+
+    return size->face->glyph;
+  }
+
+
+  static void
+  stats_miss_end( FTDemo_Handle*  handle,
+                  FT_GlyphSlot    slot )
+  {
+    if ( slot && slot->glyph_index != ~0U )
+      handle->stats.glyph_misses++;
+  }
+
+
   FT_Error
   FTDemo_Index_To_Bitmap( FTDemo_Handle*  handle,
                           FT_ULong        Index,
@@ -1490,8 +1722,10 @@
 
     if ( handle->use_sbits_cache && width < 48 && height < 48 )
     {
-      FTC_SBit   sbit;
-      FT_Bitmap  source;
+      FTC_SBit      sbit;
+      FT_Bitmap     source;
+      FT_GlyphSlot  slot = stats_miss_begin( handle );
+      double        t0   = stats_time( handle );
 
 
       error = FTC_SBitCache_LookupScaler( handle->sbits_cache,
@@ -1500,6 +1734,12 @@
                                           Index,
                                           &sbit,
                                           NULL );
+
+      handle->stats.glyph_lookups++;
+      handle->stats.sbit_lookups++;
+      handle->stats.lookup_time += stats_time( handle ) - t0;
+      stats_miss_end( handle, slot );
+
       if ( error )
         goto Exit;
 
@@ -1570,7 +1810,9 @@
     /* otherwise, use an image cache to store glyph outlines, and render */
     /* them on demand. we can thus support very large sizes easily..     */
     {
-      FT_Glyph  glyf;
+      FT_Glyph      glyf;
+      FT_GlyphSlot  slot = stats_miss_begin( handle );
+      double        t0   = stats_time( handle );
 
 
       error = FTC_ImageCache_LookupScaler( handle->image_cache,
@@ -1580,6 +1822,10 @@
                                            &glyf,
                                            NULL );
 
+      handle->stats.glyph_lookups++;
+      handle->stats.lookup_time += stats_time( handle ) - t0;
+      stats_miss_end( handle, slot );
+
       if ( !error )
         error = FTDemo_Glyph_To_Bitmap( handle, glyf, target, left, top,
                                         x_advance, y_advance, aglyf );
@@ -1594,6 +1840,249 @@
   }
 
 
+  static int
+  scaler_equal( FTC_Scaler  a,
+                FTC_Scaler  b )
+  {
+    return a->face_id == b->face_id &&
+           a->width   == b->width   &&
+           a->height  == b->height  &&
+           a->pixel   == b->pixel   &&
+           a->x_res   == b->x_res   &&
+           a->y_res   == b->y_res;
+  }
+
+
+  /* forget all glyphs, keeping the allocated memory */
+  static void
+  atlas_reset( FTDemo_Atlas*  atlas )
+  {
+    if ( atlas->height )
+      memset( atlas->bitmap.buffer, 0,
+              (size_t)atlas->height * (size_t)atlas->bitmap.pitch );
+
+    atlas->height      = 0;
+    atlas->num_shelves = 0;
+    atlas->num_packed  = 0;
+    atlas->area        = 0;
+    atlas->generation++;
+  }
+
+
+  /* find room for a glyph, using the best-fitting shelf or a new one */
+  static int
+  atlas_pack( FTDemo_Atlas*  atlas,
+              int            width,
+              int            rows,
+              int*           x,
+              int*           y )
+  {
+    PAtlasShelf  shelf;
+    PAtlasShelf  best  = NULL;
+    PAtlasShelf  limit = atlas->shelves + atlas->num_shelves;
+
+
+    width += ATLAS_PADDING;
+    rows  += ATLAS_PADDING;
+
+    if ( width > ATLAS_WIDTH )
+      return 0;
+
+    for ( shelf = atlas->shelves; shelf < limit; shelf++ )
+      if ( shelf->height >= rows                &&
+           ATLAS_WIDTH - shelf->x >= width      &&
+           ( !best || shelf->height < best->height ) )
+        best = shelf;
+
+    /* open a new shelf rather than wasting too much of an existing one */
+    if ( ( !best || best->height > rows + rows / 2 ) &&
+         atlas->num_shelves < ATLAS_MAX_SHELVES      &&
+         atlas->height + rows <= ATLAS_MAX_ROWS      )
+    {
+      if ( atlas->height + rows > atlas->bitmap.rows )
+      {
+        int  new_rows = atlas->bitmap.rows ? atlas->bitmap.rows : 256;
+
+
+        while ( atlas->height + rows > new_rows )
+          new_rows *= 2;
+        if ( new_rows > ATLAS_MAX_ROWS )
+          new_rows = ATLAS_MAX_ROWS;
+
+        /* the pitch is unchanged, so the packed glyphs are preserved */
+        if ( grNewBitmap( gr_pixel_mode_gray, 256,
+                          ATLAS_WIDTH, new_rows, &atlas->bitmap ) )
+          return 0;
+
+        memset( atlas->bitmap.buffer +
+                  (size_t)atlas->height * (size_t)atlas->bitmap.pitch,
+                0,
+                (size_t)( new_rows - atlas->height ) *
+                  (size_t)atlas->bitmap.pitch );
+      }
+
+      best = limit;
+
+      best->y      = atlas->height;
+      best->height = rows;
+      best->x      = 0;
+
+      atlas->height += rows;
+      atlas->num_shelves++;
+    }
+
+    if ( !best )
+      return 0;
+
+    *x = best->x;
+    *y = best->y;
+
+    best->x += width;
+
+    return 1;
+  }
+
+
+  /* get the atlas entry of a glyph, adding it if necessary; */
+  /* return NULL if the glyph cannot be in the atlas         */
+  static PAtlasGlyph
+  atlas_get_glyph( FTDemo_Handle*  handle,
+                   FT_UInt         gindex )
+  {
+    FTDemo_Atlas*  atlas = &handle->atlas;
+    PAtlasGlyph    slot;
+    grBitmap       source;
+    FT_Glyph       glyf;
+    int            y_advance;
+    int            i;
+
+
+    /* without hinting, several LCD modes share the load flags */
+    if ( !scaler_equal( &atlas->scaler, &handle->scaler ) ||
+         atlas->load_flags != handle->load_flags          ||
+         atlas->lcd_mode   != handle->lcd_mode            )
+    {
+      FT_Face  face;
+
+
+      error = FTC_Manager_LookupFace( handle->cache_manager,
+                                      handle->scaler.face_id, &face );
+      if ( error )
+        return NULL;
+
+      if ( atlas->num_glyphs < face->num_glyphs )
+      {
+        slot = (PAtlasGlyph)realloc( atlas->glyphs,
+                                     (size_t)face->num_glyphs *
+                                       sizeof ( TAtlasGlyph ) );
+        if ( !slot )
+          return NULL;
+
+        memset( slot + atlas->num_glyphs, 0,
+                (size_t)( face->num_glyphs - atlas->num_glyphs ) *
+                  sizeof ( TAtlasGlyph ) );
+
+        atlas->glyphs     = slot;
+        atlas->num_glyphs = face->num_glyphs;
+      }
+
+      atlas->scaler     = handle->scaler;
+      atlas->load_flags = handle->load_flags;
+      atlas->lcd_mode   = handle->lcd_mode;
+
+      atlas_reset( atlas );
+    }
+
+    if ( gindex >= (FT_UInt)atlas->num_glyphs )
+      return NULL;
+
+    slot = atlas->glyphs + gindex;
+
+    handle->stats.atlas_lookups++;
+
+    if ( slot->generation == atlas->generation )
+      return slot->packed ? slot : NULL;
+
+    handle->stats.atlas_misses++;
+
+    slot->generation = atlas->generation;
+    slot->packed     = 0;
+
+    error = FTDemo_Index_To_Bitmap( handle, gindex, &source,
+                                    &slot->left, &slot->top,
+                                    &slot->x_advance, &y_advance, &glyf );
+    if ( error )
+      return NULL;
+
+    if ( source.mode == gr_pixel_mode_gray && source.grays == 256 )
+    {
+      slot->width = source.width;
+      slot->rows  = source.rows;
+      slot->x     = 0;
+      slot->y     = 0;
+
+      /* start over if the atlas is full */
+      if ( slot->width && slot->rows                     &&
+           !atlas_pack( atlas, slot->width, slot->rows,
+                        &slot->x, &slot->y )             )
+      {
+        atlas_reset( atlas );
+        slot->generation = atlas->generation;
+
+        if ( !atlas_pack( atlas, slot->width, slot->rows,
+                          &slot->x, &slot->y ) )
+          goto Exit;
+      }
+
+      {
+        unsigned char*  src = source.buffer;
+        unsigned char*  dst = atlas->bitmap.buffer +
+                                slot->y * atlas->bitmap.pitch + slot->x;
+
+
+        if ( source.pitch < 0 )
+          src -= ( source.rows - 1 ) * source.pitch;
+
+        for ( i = 0; i < slot->rows; i++ )
+        {
+          memcpy( dst, src, (size_t)slot->width );
+          src += source.pitch;
+          dst += atlas->bitmap.pitch;
+        }
+
+        slot->packed = 1;
+
+        atlas->num_packed++;
+        atlas->area += slot->width * slot->rows;
+      }
+    }
+
+  Exit:
+    if ( glyf )
+      FT_Done_Glyph( glyf );
+
+    return slot->packed ? slot : NULL;
+  }
+
+
+  static void
+  blit_glyph( FTDemo_Handle*  handle,
+              grSurface*      surface,
+              grBitmap*       bitmap,
+              int             x,
+              int             y,
+              grColor         color )
+  {
+    double  t0 = stats_time( handle );
+
+
+    grBlitGlyphToSurface( surface, bitmap, x, y, color );
+
+    handle->stats.blits++;
+    handle->stats.blit_time += stats_time( handle ) - t0;
+  }
+
+
   FT_Error
   FTDemo_Draw_Index( FTDemo_Handle*   handle,
                      FTDemo_Display*  display,
@@ -1606,6 +2095,36 @@
     FT_Glyph  glyf;
 
 
+    if ( handle->use_atlas )
+    {
+      PAtlasGlyph  slot = atlas_get_glyph( handle, gindex );
+
+
+      if ( slot )
+      {
+        FTDemo_Atlas*  atlas = &handle->atlas;
+
+
+        /* copy from the atlas */
+        bit3.rows   = slot->rows;
+        bit3.width  = slot->width;
+        bit3.pitch  = atlas->bitmap.pitch;
+        bit3.mode   = gr_pixel_mode_gray;
+        bit3.grays  = 256;
+        bit3.buffer = atlas->bitmap.buffer +
+                        slot->y * atlas->bitmap.pitch + slot->x;
+
+        if ( bit3.rows && bit3.width )
+          blit_glyph( handle, display->surface, &bit3,
+                      *pen_x + slot->left, *pen_y - slot->top,
+                      display->fore_color );
+
+        *pen_x += slot->x_advance;
+
+        return FT_Err_Ok;
+      }
+    }
+
     error = FTDemo_Index_To_Bitmap( handle,
                                     gindex,
                                     &bit3,
@@ -1616,8 +2135,8 @@
       return error;
 
     /* now render the bitmap into the display surface */
-    grBlitGlyphToSurface( display->surface, &bit3, *pen_x + left,
-                          *pen_y - top, display->fore_color );
+    blit_glyph( handle, display->surface, &bit3, *pen_x + left,
+                *pen_y - top, display->fore_color );
 
     if ( glyf )
       FT_Done_Glyph( glyf );
@@ -1651,8 +2170,8 @@
     }
 
     /* now render the bitmap into the display surface */
-    grBlitGlyphToSurface( display->surface, &bit3, *pen_x + left,
-                          *pen_y - top, color );
+    blit_glyph( handle, display->surface, &bit3, *pen_x + left,
+                *pen_y - top, color );
 
     if ( glyf )
       FT_Done_Glyph( glyf );
@@ -1706,13 +2225,23 @@
     const char*    end = p + strlen( string );
     int            ch;
     PGlyph         glyph = handle->string;
+    FT_UInt        glyph_index;
+    int            old_length = handle->string_length;
 
 
     handle->string_length = 0;
 
     while ( ( ch = utf8_next( &p, end ) ) >= 0 )
     {
-      glyph->glyph_index = FTDemo_Get_Index( handle, (FT_UInt32)ch );
+      glyph_index = FTDemo_Get_Index( handle, (FT_UInt32)ch );
+
+      /* keep unchanged glyphs for FTDemo_String_Load */
+      if ( handle->string_length >= old_length ||
+           glyph->glyph_index != glyph_index   )
+      {
+        glyph->glyph_index = glyph_index;
+        glyph->loaded      = 0;
+      }
 
       glyph++;
       handle->string_length++;
@@ -1723,16 +2252,254 @@
   }
 
 
+  /* load the glyph image and the metrics needed at drawing time */
+  static FT_Error
+  string_load_image( FTDemo_Handle*  handle,
+                     FT_Face         face,
+                     PGlyph          glyph )
+  {
+    FT_Glyph_Metrics*  metrics = &face->glyph->metrics;
+    double             t0      = stats_time( handle );
+
+
+    error = FT_Load_Glyph( face, glyph->glyph_index, handle->load_flags );
+    if ( !error )
+      error = FT_Get_Glyph( face->glyph, &glyph->image );
+
+    /* loaded without the caches, i.e., always a miss */
+    handle->stats.glyph_lookups++;
+    handle->stats.lookup_time += stats_time( handle ) - t0;
+    if ( handle->show_stats )
+      handle->stats.glyph_misses++;
+
+    if ( error )
+      return error;
+
+    /* note that in vertical layout, y-positive goes downwards */
+
+    glyph->vvector.x  =  metrics->vertBearingX - metrics->horiBearingX;
+    glyph->vvector.y  = -metrics->vertBearingY - metrics->horiBearingY;
+
+    return FT_Err_Ok;
+  }
+
+
+  /* load a glyph image and its unkerned metrics */
+  static void
+  string_load_glyph( FTDemo_Handle*  handle,
+                     FT_Face         face,
+                     PGlyph          glyph )
+  {
+    /* clear existing image if there is one */
+    if ( glyph->image )
+    {
+      FT_Done_Glyph( glyph->image );
+      glyph->image = NULL;
+    }
+
+    /* load the glyph and get the image */
+    glyph->loaded = !string_load_image( handle, face, glyph );
+    if ( glyph->loaded )
+    {
+      FT_Glyph_Metrics*  metrics = &face->glyph->metrics;
+
+
+      glyph->vadvance.x = 0;
+      glyph->vadvance.y = -metrics->vertAdvance;
+
+      glyph->lsb_delta = face->glyph->lsb_delta;
+      glyph->rsb_delta = face->glyph->rsb_delta;
+
+      glyph->advance = metrics->horiAdvance;
+    }
+    else
+      glyph->advance = 0;
+  }
+
+
+  /* load glyph images and unkerned metrics; unless `reload' is set, */
+  /* only glyphs changed by FTDemo_String_Set are processed          */
+  static void
+  string_load_glyphs( FTDemo_Handle*  handle,
+                      FT_Face         face,
+                      int             reload )
+  {
+    PGlyph  glyph = handle->string;
+    PGlyph  limit = handle->string + handle->string_length;
+
+
+    for ( ; glyph < limit; glyph++ )
+      if ( reload || !glyph->loaded )
+        string_load_glyph( handle, face, glyph );
+  }
+
+
+  /* get the advances of `count' glyphs scaled exactly like the    */
+  /* loaded metrics, or an error if the driver cannot provide them */
+  /* quickly; FT_Get_Advances rounds its 16.16 results differently */
+  static FT_Error
+  string_get_advances( FT_Face    face,
+                       FT_UInt    start,
+                       FT_UInt    count,
+                       FT_Int32   flags,
+                       FT_Fixed*  advances )
+  {
+    FT_Fixed  scale = ( flags & FT_LOAD_VERTICAL_LAYOUT )
+                      ? face->size->metrics.y_scale
+                      : face->size->metrics.x_scale;
+    FT_UInt   i;
+
+
+    /* hinted vertical metrics may be synthesized from the size metrics */
+    if ( ( flags & FT_LOAD_VERTICAL_LAYOUT ) &&
+         !( flags & FT_LOAD_NO_HINTING )     )
+      return FT_Err_Unimplemented_Feature;
+
+    error = FT_Get_Advances( face, start, count,
+                             flags | FT_ADVANCE_FLAG_FAST_ONLY, advances );
+    if ( !error )
+      error = FT_Get_Advances( face, start, count,
+                               FT_LOAD_NO_SCALE |
+                                 ( flags & FT_LOAD_VERTICAL_LAYOUT ),
+                               advances );
+    if ( error )
+      return error;
+
+    /* hinted advances are rounded to full pixels */
+    for ( i = 0; i < count; i++ )
+    {
+      advances[i] = FT_MulFix( advances[i], scale );
+
+      if ( !( flags & FT_LOAD_NO_HINTING ) )
+        advances[i] = ROUND( advances[i] );
+    }
+
+    return FT_Err_Ok;
+  }
+
+
+  /* get advances without glyph images, using runs of consecutive  */
+  /* glyph indices; if the driver cannot provide them quickly, load */
+  /* the glyph images right away, keeping them for later drawing    */
+  static void
+  string_load_advances( FTDemo_Handle*  handle,
+                        FT_Face         face,
+                        FT_Int32        flags,
+                        int             vertical,
+                        int             reload )
+  {
+    PGlyph    glyph = handle->string;
+    PGlyph    limit = handle->string + handle->string_length;
+    FT_Fixed  advances[64];
+    int       n, i;
+
+
+    for ( ; glyph < limit; glyph += n )
+    {
+      n = 1;
+      if ( !reload && glyph->loaded )
+        continue;
+
+      for ( ; glyph + n < limit && n < 64; n++ )
+        if ( glyph[n].glyph_index != glyph[n - 1].glyph_index + 1 ||
+             ( !reload && glyph[n].loaded )                         )
+          break;
+
+      if ( string_get_advances( face, glyph->glyph_index, (FT_UInt)n,
+                                flags, advances ) )
+      {
+        for ( i = 0; i < n; i++ )
+          string_load_glyph( handle, face, glyph + i );
+
+        continue;
+      }
+
+      for ( i = 0; i < n; i++ )
+      {
+        if ( glyph[i].image )
+        {
+          FT_Done_Glyph( glyph[i].image );
+          glyph[i].image = NULL;
+        }
+
+        glyph[i].advance   = advances[i];
+        glyph[i].lsb_delta = 0;
+        glyph[i].rsb_delta = 0;
+        glyph[i].loaded    = 1;
+      }
+
+      if ( !vertical )
+        continue;
+
+      if ( string_get_advances( face, glyph->glyph_index, (FT_UInt)n,
+                                flags | FT_LOAD_VERTICAL_LAYOUT,
+                                advances ) )
+      {
+        for ( i = 0; i < n; i++ )
+          string_load_glyph( handle, face, glyph + i );
+
+        continue;
+      }
+
+      for ( i = 0; i < n; i++ )
+      {
+        glyph[i].vadvance.x = 0;
+        glyph[i].vadvance.y = -advances[i];
+      }
+    }
+  }
+
+
+  /* look up unfitted kerning in the per-size memo */
+  static void
+  string_get_kerning( FTDemo_Handle*  handle,
+                      FT_Face         face,
+                      FT_UInt         left,
+                      FT_UInt         right,
+                      FT_Vector*      kern )
+  {
+    PKern      pair;
+    FT_UInt32  hash;
+
+
+    if ( !scaler_equal( &handle->kern_scaler, &handle->scaler ) )
+    {
+      handle->kern_scaler = handle->scaler;
+
+      for ( pair = handle->kern_pairs;
+            pair < handle->kern_pairs + MAX_KERN_PAIRS;
+            pair++ )
+        pair->left = pair->right = ~0U;  /* no such glyph index */
+    }
+
+    hash = ( ( (FT_UInt32)left << 16 ) ^ right ) * 0x9E3779B1UL;
+    pair = handle->kern_pairs + ( ( hash >> 16 ) & ( MAX_KERN_PAIRS - 1 ) );
+
+    if ( pair->left != left || pair->right != right )
+    {
+      FT_Get_Kerning( face, left, right, FT_KERNING_UNFITTED, &pair->kern );
+
+      pair->left  = left;
+      pair->right = right;
+    }
+
+    *kern = pair->kern;
+  }
+
+
   FT_Error
   FTDemo_String_Load( FTDemo_Handle*          handle,
                       FTDemo_String_Context*  sc )
   {
-    FT_Size  size;
-    FT_Face  face;
-    FT_Int   i;
-    FT_Int   length = handle->string_length;
-    PGlyph   glyph, prev;
-    FT_Pos   track_kern   = 0;
+    FT_Size   size;
+    FT_Face   face;
+    FT_Int    i;
+    FT_Int    length = handle->string_length;
+    PGlyph    glyph, prev;
+    FT_Pos    track_kern   = 0;
+    FT_Int32  flags        = handle->load_flags;
+    int       layout       = 0;
+    int       reload;
 
 
     error = FTDemo_Get_Size( handle, &size );
@@ -1741,39 +2508,46 @@
 
     face = size->face;
 
-    for ( glyph = handle->string, i = 0; i < length; glyph++, i++ )
+    if ( sc->layout_only )
     {
-      /* clear existing image if there is one */
-      if ( glyph->image )
-      {
-        FT_Done_Glyph( glyph->image );
-        glyph->image = NULL;
-      }
-
-      /* load the glyph and get the image */
-      if ( !FT_Load_Glyph( face, glyph->glyph_index,
-                           handle->load_flags )        &&
-           !FT_Get_Glyph( face->glyph, &glyph->image ) )
-      {
-        FT_Glyph_Metrics*  metrics = &face->glyph->metrics;
+      layout = sc->vertical ? 2 : 1;
 
+      /* hinting is irrelevant for subpixel positioning */
+      if ( handle->lcd_mode == LCD_MODE_LIGHT_SUBPIXEL )
+        flags |= FT_LOAD_NO_HINTING;
+    }
 
-        /* note that in vertical layout, y-positive goes downwards */
+    /* glyphs depend on size, load flags, and layout mode only; */
+    /* everything else just needs the advances recomputed       */
+    reload = !scaler_equal( &handle->string_scaler, &handle->scaler ) ||
+             handle->string_flags  != flags                         ||
+             handle->string_layout != layout;
 
-        glyph->vvector.x  =  metrics->vertBearingX - metrics->horiBearingX;
-        glyph->vvector.y  = -metrics->vertBearingY - metrics->horiBearingY;
+    if ( reload )
+    {
+      PSubpixel  sub;
 
-        glyph->vadvance.x = 0;
-        glyph->vadvance.y = -metrics->vertAdvance;
 
-        glyph->lsb_delta = face->glyph->lsb_delta;
-        glyph->rsb_delta = face->glyph->rsb_delta;
+      handle->string_scaler = handle->scaler;
+      handle->string_flags  = flags;
+      handle->string_layout = layout;
 
-        glyph->hadvance.x = metrics->horiAdvance;
-        glyph->hadvance.y = 0;
-      }
+      /* the rendered glyphs are stale now */
+      for ( sub = handle->subpixel_glyphs;
+            sub < handle->subpixel_glyphs + MAX_SUBPIXEL_GLYPHS;
+            sub++ )
+        if ( sub->image )
+        {
+          FT_Done_Glyph( sub->image );
+          sub->image = NULL;
+        }
     }
 
+    if ( layout )
+      string_load_advances( handle, face, flags, sc->vertical, reload );
+    else
+      string_load_glyphs( handle, face, reload );
+
     if ( sc->kerning_degree )
     {
       /* this function needs and returns points, not pixels */
@@ -1784,11 +2558,17 @@
         track_kern = ( track_kern >> 10 ) * (FT_Long)handle->scaler.x_res / 72;
     }
 
+    for ( glyph = handle->string, i = 0; i < length; glyph++, i++ )
+    {
+      glyph->hadvance.x = glyph->advance;
+      glyph->hadvance.y = 0;
+    }
+
     for ( prev = handle->string + length, glyph = handle->string, i = 0;
           i < length;
           prev = glyph, glyph++, i++ )
     {
-      if ( !glyph->image )
+      if ( !glyph->loaded )
         continue;
 
       if ( handle->lcd_mode == LCD_MODE_LIGHT_SUBPIXEL )
@@ -1801,8 +2581,8 @@
         FT_Vector  kern;
 
 
-        FT_Get_Kerning( face, prev->glyph_index, glyph->glyph_index,
-                        FT_KERNING_UNFITTED, &kern );
+        string_get_kerning( handle, face,
+                            prev->glyph_index, glyph->glyph_index, &kern );
 
         prev->hadvance.x += kern.x;
         prev->hadvance.y += kern.y;
@@ -1829,6 +2609,75 @@
   }
 
 
+  /* get glyph bitmap rendered at a quantized horizontal offset; */
+  /* the returned image is owned by the cache                    */
+  static FT_Error
+  string_get_subpixel( FTDemo_Handle*  handle,
+                       PGlyph          glyph,
+                       FT_Pos          phase,
+                       FT_Glyph*       aimage )
+  {
+    PSubpixel  sub;
+    FT_Glyph   image;
+    FT_Vector  delta;
+    FT_UInt32  hash;
+    double     t0;
+
+
+    hash = ( (FT_UInt32)glyph->glyph_index * 64 + (FT_UInt32)phase ) *
+             0x9E3779B1UL;
+    sub  = handle->subpixel_glyphs +
+             ( ( hash >> 16 ) & ( MAX_SUBPIXEL_GLYPHS - 1 ) );
+
+    handle->subpixel_lookups++;
+
+    if ( sub->image                             &&
+         sub->glyph_index == glyph->glyph_index &&
+         sub->phase       == phase              )
+    {
+      handle->subpixel_hits++;
+      *aimage = sub->image;
+
+      return FT_Err_Ok;
+    }
+
+    if ( sub->image )
+    {
+      FT_Done_Glyph( sub->image );
+      sub->image = NULL;
+    }
+
+    error = FT_Glyph_Copy( glyph->image, &image );
+    if ( error )
+      return error;
+
+    delta.x = phase;
+    delta.y = 0;
+
+    t0    = stats_time( handle );
+    error = FT_Glyph_Transform( image, NULL, &delta );
+    if ( !error )
+      error = FT_Glyph_To_Bitmap( &image, FT_RENDER_MODE_LIGHT, NULL, 1 );
+
+    handle->stats.renders++;
+    handle->stats.render_time += stats_time( handle ) - t0;
+
+    if ( error )
+    {
+      FT_Done_Glyph( image );
+      return error;
+    }
+
+    sub->glyph_index = glyph->glyph_index;
+    sub->phase       = phase;
+    sub->image       = image;
+
+    *aimage = image;
+
+    return FT_Err_Ok;
+  }
+
+
   int
   FTDemo_String_Draw( FTDemo_Handle*          handle,
                       FTDemo_Display*         display,
@@ -1841,6 +2690,7 @@
     int        m, n;
     FT_Vector  pen = { 0, 0};
     FT_Vector  advance;
+    FT_Face    face = NULL;
 
 
     if ( x < 0                      ||
@@ -1896,8 +2746,74 @@
       FT_BBox   bbox;
 
 
+      if ( !glyph->loaded )
+        continue;
+
+      /* load deferred image, see FTDemo_String_Load */
       if ( !glyph->image )
+      {
+        FT_Size  size;
+
+
+        if ( !face )
+        {
+          if ( FTDemo_Get_Size( handle, &size ) )
+            break;
+          face = size->face;
+        }
+
+        if ( string_load_image( handle, face, glyph ) )
+          continue;
+      }
+
+      /* reuse bitmaps rendered at the same subpixel phase */
+      if ( handle->lcd_mode == LCD_MODE_LIGHT_SUBPIXEL       &&
+           handle->subpixel_steps                            &&
+           !sc->matrix                                       &&
+           !sc->vertical                                     &&
+           !( pen.y & 63 )                                   &&
+           glyph->image->format == FT_GLYPH_FORMAT_OUTLINE   )
+      {
+        FT_Pos          step = 64 / handle->subpixel_steps;
+        FT_Pos          x    = ( pen.x + step / 2 ) & -step;
+        FT_Pos          y    = pen.y;
+        FT_BitmapGlyph  bitmap;
+
+
+        pen.x += glyph->hadvance.x;
+        pen.y += glyph->hadvance.y;
+
+        if ( string_get_subpixel( handle, glyph, x & 63, &image ) )
+          continue;
+
+        bitmap = (FT_BitmapGlyph)image;
+
+        bbox.xMin = ( x >> 6 ) + bitmap->left;
+        bbox.xMax = bbox.xMin + (FT_Pos)bitmap->bitmap.width;
+        bbox.yMax = ( y >> 6 ) + bitmap->top;
+        bbox.yMin = bbox.yMax - (FT_Pos)bitmap->bitmap.rows;
+
+        if ( bbox.xMax > 0                      &&
+             bbox.yMax > 0                      &&
+             bbox.xMin < display->bitmap->width &&
+             bbox.yMin < display->bitmap->rows  )
+        {
+          int       left, top, dummy1, dummy2;
+          grBitmap  bit3;
+          FT_Glyph  glyf;
+
+
+          error = FTDemo_Glyph_To_Bitmap( handle, image, &bit3, &left, &top,
+                                          &dummy1, &dummy2, &glyf );
+          if ( !error )
+            blit_glyph( handle, display->surface, &bit3,
+                        (int)bbox.xMin,
+                        display->bitmap->rows - (int)bbox.yMax,
+                        display->fore_color );
+        }
+
         continue;
+      }
 
       /* copy image */
       error = FT_Glyph_Copy( glyph->image, &image );
@@ -1973,8 +2889,8 @@
           top = display->bitmap->rows - top;
 
           /* now render the bitmap into the display surface */
-          grBlitGlyphToSurface( display->surface, &bit3, left, top,
-                                display->fore_color );
+          blit_glyph( handle, display->surface, &bit3, left, top,
+                      display->fore_color );
 
           if ( glyf )
             FT_Done_Glyph( glyf );
@@ -1988,6 +2904,28 @@
   }
 
 
+  int
+  FTDemo_Atlas_Print( FTDemo_Handle*  handle,
+                      const char*     filename,
+                      FT_String*      ver_str )
+  {
+    FTDemo_Display  display;
+    grBitmap        bit = handle->atlas.bitmap;
+
+
+    if ( !handle->atlas.height )
+      return 1;
+
+    bit.rows = handle->atlas.height;
+
+    /* the atlas holds linear coverage values */
+    display.bitmap = &bit;
+    display.gamma  = 1.0;
+
+    return FTDemo_Display_Print( &display, filename, ver_str );
+  }
+
+
   FT_Error
   FTDemo_Sketch_Glyph_Color( FTDemo_Handle*     handle,
                              FTDemo_Display*    display,
@@ -114,6 +114,40 @@
                         const char*      filename,
                         FT_String*       ver_str );
 
+  /* PNG row filters for `FTDemo_Display_Export' */
+#define FTDEMO_FILTER_NONE   1
+#define FTDEMO_FILTER_SUB    2
+#define FTDEMO_FILTER_UP     4
+#define FTDEMO_FILTER_AVG    8
+#define FTDEMO_FILTER_PAETH  16
+#define FTDEMO_FILTER_ALL    31
+
+  /* dump display image as uncompressed PAM, PGM/PPM, or PNG, depending */
+  /* on the file extension; `level' (0-9, or -1 for the default) is the */
+  /* zlib compression level and `filters' the set of PNG row filters to */
+  /* try (0 for the default).  If `async' is set, a snapshot of the     */
+  /* image is encoded on a background thread once any earlier export    */
+  /* is done; the return value then only indicates whether the export   */
+  /* could be started                                                   */
+  int
+  FTDemo_Display_Export( FTDemo_Display*  display,
+                         const char*      filename,
+                         FT_String*       ver_str,
+                         int              level,
+                         int              filters,
+                         int              async );
+
+  /* wait until the background export is written */
+  void
+  FTDemo_Display_Export_Wait( void );
+
+  /* export display image in the background to `<basename>.png', or as */
+  /* selected by the `FTDEMO_EXPORT' environment variable              */
+  int
+  FTDemo_Display_Snapshot( FTDemo_Display*  display,
+                           const char*      basename,
+                           FT_String*       ver_str );
+
   /*************************************************************************/
   /*************************************************************************/
   /*****                                                               *****/
@@ -124,6 +158,13 @@
 
 #define MAX_GLYPHS 512            /* at most 512 glyphs in the string */
 #define MAX_GLYPH_BYTES  150000   /* 150kB for the glyph image cache */
+#define MAX_KERN_PAIRS  1024      /* memoized kerning pairs, power of 2 */
+#define MAX_SUBPIXEL_GLYPHS  1024 /* cached subpixel bitmaps, power of 2 */
+
+#define ATLAS_WIDTH       1024    /* glyph atlas width in pixels     */
+#define ATLAS_MAX_ROWS    4096    /* glyph atlas height limit        */
+#define ATLAS_MAX_SHELVES  512    /* shelves in the glyph atlas      */
+#define ATLAS_PADDING        1    /* empty pixels between glyphs     */
 
 
   typedef struct  TGlyph_
@@ -133,13 +174,101 @@
 
     FT_Pos     lsb_delta; /* delta caused by hinting */
     FT_Pos     rsb_delta; /* delta caused by hinting */
+    FT_Pos     advance;   /* unkerned horizontal advance */
     FT_Vector  hadvance;  /* kerned horizontal advance */
 
     FT_Vector  vvector;   /* vert. origin => hori. origin */
     FT_Vector  vadvance;  /* vertical advance */
 
+    FT_Bool    loaded;    /* advances are valid, image may be deferred */
+
   } TGlyph, *PGlyph;
 
+  /* a kerning pair memoized for the current size */
+  typedef struct  TKern_
+  {
+    FT_UInt    left;
+    FT_UInt    right;
+    FT_Vector  kern;      /* unfitted kerning vector */
+
+  } TKern, *PKern;
+
+  /* a glyph bitmap rendered at a quantized subpixel offset */
+  typedef struct  TSubpixel_
+  {
+    FT_UInt    glyph_index;
+    FT_Pos     phase;     /* horizontal offset in 26.6 pixels */
+    FT_Glyph   image;     /* bitmap glyph, NULL if unused */
+
+  } TSubpixel, *PSubpixel;
+
+  /* a glyph in the atlas, valid only for the current atlas generation */
+  typedef struct  TAtlasGlyph_
+  {
+    unsigned int  generation;
+    int           packed;     /* otherwise drawn directly */
+    int           x, y;       /* position in the atlas    */
+    int           width, rows;
+    int           left, top;
+    int           x_advance;
+
+  } TAtlasGlyph, *PAtlasGlyph;
+
+  /* a row of glyphs in the atlas */
+  typedef struct  TAtlasShelf_
+  {
+    int  y;
+    int  height;
+    int  x;                   /* first free column */
+
+  } TAtlasShelf, *PAtlasShelf;
+
+  /* a shelf-packed glyph atlas for the current face and size */
+  typedef struct
+  {
+    grBitmap       bitmap;    /* 8-bit coverage, grown on demand */
+    int            height;    /* rows occupied by the shelves    */
+
+    TAtlasShelf    shelves[ATLAS_MAX_SHELVES];
+    int            num_shelves;
+
+    PAtlasGlyph    glyphs;    /* indexed by glyph index */
+    long           num_glyphs;
+    unsigned int   generation;
+
+    FTC_ScalerRec  scaler;    /* size, flags, and LCD mode of the atlas */
+    FT_Int32       load_flags;
+    int            lcd_mode;
+
+    long           num_packed;
+    long           area;      /* pixels occupied by glyphs */
+
+  } FTDemo_Atlas;
+
+  /* instrumentation counters; times are in microseconds; times */
+  /* and glyph misses are only collected while `show_stats' is set */
+  typedef struct
+  {
+    unsigned long  face_loads;      /* faces opened by the cache manager */
+    unsigned long  face_evictions;
+    unsigned long  size_loads;      /* sizes seen by FTDemo_Get_Size     */
+    unsigned long  size_evictions;
+    unsigned long  cmap_lookups;
+    unsigned long  glyph_lookups;   /* image and sbits cache lookups     */
+    unsigned long  glyph_misses;
+    unsigned long  sbit_lookups;
+    unsigned long  atlas_lookups;
+    unsigned long  atlas_misses;
+    unsigned long  renders;         /* glyph images converted to bitmaps */
+    unsigned long  blits;
+
+    double         cmap_time;
+    double         lookup_time;     /* including loads on cache misses   */
+    double         render_time;
+    double         blit_time;
+
+  } FTDemo_Stats;
+
   /* this simple record is used to model a given `installed' face */
   typedef struct  TFont_
   {
@@ -192,6 +321,8 @@
     FT_Pos      extent;            /* extent to fill, glyphs recycled */
     int         offset;            /* initial glyph */
 
+    int         layout_only;       /* advances only, images at draw time */
+
   } FTDemo_String_Context;
 
   typedef struct
@@ -207,6 +338,9 @@
     int             max_fonts;
 
     int             use_sbits_cache;   /* toggle sbits cache */
+    int             use_atlas;         /* toggle glyph atlas */
+    int             show_stats;        /* toggle statistics overlay */
+    int             stats_used;        /* `show_stats' was ever set */
 
     /* use FTDemo_Set_Current_XXX to set the following two fields */
     PFont           current_font;      /* selected font */
@@ -223,12 +357,34 @@
     int             lcd_mode;          /* mono, aa, light, vrgb, ...      */
     int             preload;           /* force font file preloading      */
 
+    /* pen positions per pixel for LCD_MODE_LIGHT_SUBPIXEL string   */
+    /* rendering; 0 (the default) renders at exact positions,      */
+    /* bypassing the cache                                         */
+    int             subpixel_steps;
+
     /* don't touch the following fields! */
 
     /* used for string rendering */
     TGlyph          string[MAX_GLYPHS];
     int             string_length;
 
+    FTC_ScalerRec   string_scaler;     /* inputs of the loaded glyphs */
+    FT_Int32        string_flags;
+    int             string_layout;
+
+    FTC_ScalerRec   kern_scaler;       /* size of the memoized pairs */
+    TKern           kern_pairs[MAX_KERN_PAIRS];
+
+    /* rendered glyphs of the loaded string, see FTDemo_String_Draw */
+    TSubpixel       subpixel_glyphs[MAX_SUBPIXEL_GLYPHS];
+    unsigned long   subpixel_lookups;
+    unsigned long   subpixel_hits;
+
+    FTDemo_Atlas    atlas;             /* used by FTDemo_Draw_Index */
+
+    FTDemo_Stats    stats;             /* totals since FTDemo_New */
+    FTDemo_Stats    frame_stats;       /* totals at the previous header */
+
     unsigned long   encoding;
     FT_Stroker      stroker;
     FT_Bitmap       bitmap;            /* used as bitmap conversion buffer */
@@ -244,6 +400,11 @@
   FTDemo_Done( FTDemo_Handle*  handle );
 
 
+  /* print the statistics totals to stdout if `stats_used' is set */
+  void
+  FTDemo_Stats_Print( FTDemo_Handle*  handle );
+
+
   /* append version information */
   void
   FTDemo_Version( FTDemo_Handle*  handle,
@@ -302,7 +463,8 @@
   FTDemo_Hinting_Engine_Change( FTDemo_Handle*  handle );
 
 
-  /* draw common header */
+  /* draw common header, and the statistics of */
+  /* the last frame if handle->show_stats is set */
   void
   FTDemo_Draw_Header( FTDemo_Handle*   handle,
                       FTDemo_Display*  display,
@@ -337,7 +499,9 @@
                           FT_Glyph*       aglyf );
 
 
-  /* given glyph index, draw a glyph on the display */
+  /* given glyph index, draw a glyph on the display; */
+  /* with handle->use_atlas, gray glyphs are copied  */
+  /* from the glyph atlas, packing them as needed    */
   FT_Error
   FTDemo_Draw_Index( FTDemo_Handle*   handle,
                      FTDemo_Display*  display,
@@ -377,7 +541,11 @@
                      const char*     string );
 
 
-  /* load kerned advances with hinting compensation */
+  /* load kerned advances with hinting compensation; glyphs are  */
+  /* reloaded only if the size, the flags, or the string changed; */
+  /* with `sc->layout_only', fetch advances only and defer glyph  */
+  /* images to FTDemo_String_Draw; side bearing deltas are then   */
+  /* unavailable and vertical advances need `sc->vertical'        */
   FT_Error
   FTDemo_String_Load( FTDemo_Handle*          handle,
                       FTDemo_String_Context*  sc );
@@ -386,6 +554,7 @@
   /* draw a string centered at (center_x, center_y) --  */
   /* returns the number of rendered glyphs              */
   /* note that handle->use_sbits_cache is not supported */
+  /* but unrotated subpixel glyphs are cached instead   */
   int
   FTDemo_String_Draw( FTDemo_Handle*          handle,
                       FTDemo_Display*         display,
@@ -394,6 +563,13 @@
                       int                     center_y );
 
 
+  /* dump the used part of the glyph atlas in PNG format */
+  int
+  FTDemo_Atlas_Print( FTDemo_Handle*  handle,
+                      const char*     filename,
+                      FT_String*      ver_str );
+
+
   /* draw an outline glyph directly onto display surface */
   FT_Error
   FTDemo_Sketch_Glyph_Color( FTDemo_Handle*     handle,
@@ -27,6 +27,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#define FTDIFF_THREADS
+#include <pthread.h>
+#endif
+
 
   static void
   usage( const char*  execname )
@@ -164,6 +169,55 @@
 
   /** RENDER STATE **/
 
+  /* the settings a column's FreeType objects have been set up with */
+  typedef struct  ColumnConfigRec_
+  {
+    int            face_index;
+    double         char_size;
+    unsigned int   resolution;
+    unsigned int   cff_hinting_engine;
+    unsigned int   type1_hinting_engine;
+    unsigned int   t1cid_hinting_engine;
+    unsigned int   tt_interpreter_version;
+    HintMode       hint_mode;
+    int            use_lcd_filter;
+    FT_LcdFilter   lcd_filter;
+    int            use_custom_lcd_filter;
+    unsigned char  filter_weights[5];
+
+  } ColumnConfigRec, *ColumnConfig;
+
+
+  /* a rendered glyph image, shifted by a sub-pixel offset */
+  typedef struct  CachedImageRec_
+  {
+    FT_Bool    is_outline;
+    FT_Pos     cbox_xMax;     /* of the shifted outline */
+    int        left;
+    int        top;
+    FT_Bitmap  bitmap;        /* with its own buffer */
+
+  } CachedImageRec, *CachedImage;
+
+
+  typedef struct  CachedGlyphRec_
+  {
+    struct CachedGlyphRec_*  next;
+
+    FT_UInt      gindex;
+    FT_Pos       advance;         /* `advance.x'                */
+    FT_Pos       linear_advance;  /* `linearHoriAdvance' (26.6) */
+    FT_Pos       lsb_delta;
+    FT_Pos       rsb_delta;
+    CachedImage  images[64];      /* indexed by sub-pixel shift */
+
+  } CachedGlyphRec, *CachedGlyph;
+
+
+#define GLYPH_CACHE_BUCKETS  256
+#define GLYPH_CACHE_BUDGET   ( 16UL * 1024 * 1024 )
+
+
   typedef struct  ColumnStateRec_
   {
     int            use_cboxes;
@@ -185,6 +239,16 @@
     int            num_tt_interpreter_versions;
     int            tt_interpreter_version_idx;
 
+    /* each column has its own library so that property changes do not */
+    /* affect the other columns; everything below is brought in sync    */
+    /* with the settings above by `column_state_update'                 */
+    FT_Library       library;
+    FT_Face          face;
+    ColumnConfigRec  config;
+    FT_Long          slot_gindex;  /* unmodified glyph in slot, or -1 */
+    CachedGlyph      glyphs[GLYPH_CACHE_BUCKETS];
+    unsigned long    cache_size;
+
   } ColumnStateRec, *ColumnState;
 
 
@@ -211,8 +275,6 @@
     int             face_index;
     const char*     filepath;
     const char*     filename;
-    FT_Face         face;
-    FT_Size         size;
     char**          files;
     DisplayRec      display;
     char            filepath0[1024];
@@ -311,13 +373,70 @@
     state->columns[2]                        = state->columns[0];
     state->columns[2].hint_mode              = HINT_MODE_UNHINTED;
 
+    for ( i = 0; i < 3; i++ )
+      if ( FT_Init_FreeType( &state->columns[i].library ) )
+        panic( "could not initialize FreeType\n" );
+
     state->col = 1;
   }
 
 
+  /* discard all cached glyphs of a column */
+  static void
+  column_state_flush( ColumnState  column )
+  {
+    int  i, j;
+
+
+    for ( i = 0; i < GLYPH_CACHE_BUCKETS; i++ )
+    {
+      CachedGlyph  glyph = column->glyphs[i];
+
+
+      while ( glyph )
+      {
+        CachedGlyph  next = glyph->next;
+
+
+        for ( j = 0; j < 64; j++ )
+          if ( glyph->images[j] )
+          {
+            free( glyph->images[j]->bitmap.buffer );
+            free( glyph->images[j] );
+          }
+
+        free( glyph );
+        glyph = next;
+      }
+
+      column->glyphs[i] = NULL;
+    }
+
+    column->cache_size = 0;
+  }
+
+
+  static void
+  column_state_done( ColumnState  column )
+  {
+    column_state_flush( column );
+
+    if ( column->library )
+    {
+      /* this also discards the face */
+      FT_Done_FreeType( column->library );
+      column->library = NULL;
+      column->face    = NULL;
+    }
+  }
+
+
   static void
   render_state_done( RenderState  state )
   {
+    int  i;
+
+
     if ( state->filepath != state->filepath0 )
     {
       free( (char*)state->filepath );
@@ -326,12 +445,8 @@
     state->filepath0[0] = 0;
     state->filename     = 0;
 
-    if ( state->face )
-    {
-      FT_Done_Face( state->face );
-      state->face = NULL;
-      state->size = NULL;
-    }
+    for ( i = 0; i < 3; i++ )
+      column_state_done( &state->columns[i] );
 
     if ( state->library )
     {
@@ -357,21 +472,17 @@
   }
 
 
+  static int
+  render_state_set_file( RenderState  state );
+
+
   static void
   render_state_set_face_index( RenderState  state,
                                int          idx )
   {
     state->face_index = idx;
-  }
-
 
-  static void
-  _render_state_rescale( RenderState  state )
-  {
-    if ( state->size )
-      FT_Set_Char_Size( state->face, 0,
-                        (FT_F26Dot6)( state->char_size * 64.0 ),
-                        0, state->resolution );
+    render_state_set_file( state );
   }
 
 
@@ -477,10 +588,12 @@
       usage( execname );
     }
 
-    state->face_index = 0;
+    render_state_set_face_index( state, 0 );
   }
 
 
+  /* record the file name of the current face; */
+  /* the columns load the face themselves      */
   static int
   render_state_set_file( RenderState  state )
   {
@@ -489,22 +602,8 @@
 
     filepath = state->faces[state->face_index].filepath;
 
-    if ( state->face )
-    {
-      FT_Done_Face( state->face );
-      state->face = NULL;
-      state->size = NULL;
-    }
-
     if ( filepath != NULL && filepath[0] != 0 )
     {
-      error = FT_New_Face( state->library,
-                           filepath,
-                           state->faces[state->face_index].index,
-                           &state->face );
-      if ( error )
-        return -1;
-
       {
         unsigned int  len = strlen( filepath ) + 1;
         char*         p;
@@ -526,18 +625,253 @@
 
         state->filename = p ? p + 1 : state->filepath;
       }
+    }
+
+    return 0;
+  }
+
+
+  static void
+  column_state_get_config( RenderState   state,
+                           ColumnState   column,
+                           ColumnConfig  config )
+  {
+    /* clear padding, too, since configurations are compared bytewise */
+    memset( config, 0, sizeof ( *config ) );
+
+    config->face_index             = state->face_index;
+    config->char_size              = state->char_size;
+    config->resolution             = state->resolution;
+    config->cff_hinting_engine     = column->cff_hinting_engine;
+    config->type1_hinting_engine   = column->type1_hinting_engine;
+    config->t1cid_hinting_engine   = column->t1cid_hinting_engine;
+    config->tt_interpreter_version =
+      column->tt_interpreter_versions[column->tt_interpreter_version_idx];
+    config->hint_mode              = column->hint_mode;
+    config->use_lcd_filter         = column->use_lcd_filter;
+    config->lcd_filter             = column->lcd_filter;
+    config->use_custom_lcd_filter  = column->use_custom_lcd_filter;
+
+    memcpy( config->filter_weights, column->filter_weights, 5 );
+  }
+
+
+  /* Bring the face, size, and glyph cache of a column in sync with its */
+  /* settings; nothing is done if they are unchanged since last time.   */
+  static int
+  column_state_update( RenderState  state,
+                       ColumnState  column )
+  {
+    ColumnConfigRec  config;
+    ColumnConfig     old = &column->config;
+    FT_Bool          reload;
+    FT_Error         err;
+
+
+    column_state_get_config( state, column, &config );
+
+    if ( column->face && !memcmp( &config, old, sizeof ( config ) ) )
+      return 0;
+
+    /* changing a property is in most cases a global operation; */
+    /* we are on the safe side if we reload the face completely */
+    /* (this is something a normal program doesn't need to do)  */
+    reload = !column->face                                              ||
+             config.face_index != old->face_index                       ||
+             config.cff_hinting_engine != old->cff_hinting_engine       ||
+             config.type1_hinting_engine != old->type1_hinting_engine   ||
+             config.t1cid_hinting_engine != old->t1cid_hinting_engine   ||
+             config.tt_interpreter_version != old->tt_interpreter_version;
+
+    column_state_flush( column );
+    column->slot_gindex = -1;
+
+    if ( reload )
+    {
+      /* no need to check for errors: the values used here are always */
+      /* valid                                                         */
+      FT_Property_Set( column->library,
+                       "cff",
+                       "hinting-engine",
+                       &config.cff_hinting_engine );
+      FT_Property_Set( column->library,
+                       "type1",
+                       "hinting-engine",
+                       &config.type1_hinting_engine );
+      FT_Property_Set( column->library,
+                       "t1cid",
+                       "hinting-engine",
+                       &config.t1cid_hinting_engine );
+      FT_Property_Set( column->library,
+                       "truetype",
+                       "interpreter-version",
+                       &config.tt_interpreter_version );
+
+      if ( column->face )
+      {
+        FT_Done_Face( column->face );
+        column->face = NULL;
+      }
 
-      state->size = state->face->size;
+      err = FT_New_Face( column->library,
+                         state->faces[config.face_index].filepath,
+                         state->faces[config.face_index].index,
+                         &column->face );
+      if ( err )
+      {
+        column->face = NULL;
+        return -1;
+      }
     }
 
+    if ( reload                                 ||
+         config.char_size != old->char_size     ||
+         config.resolution != old->resolution   )
+      FT_Set_Char_Size( column->face, 0,
+                        (FT_F26Dot6)( config.char_size * 64.0 ),
+                        0, config.resolution );
+
+    if ( config.use_lcd_filter )
+      FT_Library_SetLcdFilter( column->library, config.lcd_filter );
+
+    if ( config.use_custom_lcd_filter )
+      FT_Library_SetLcdFilterWeights( column->library,
+                                      config.filter_weights );
+
+    *old = config;
+
     return 0;
   }
 
 
+  /* Return the metrics of glyph `gindex', loading it if not cached. */
+  /* The result stays valid until the next call.                     */
+  static CachedGlyph
+  column_state_get_glyph( ColumnState  column,
+                          FT_UInt      gindex,
+                          FT_Int32     load_flags )
+  {
+    FT_GlyphSlot  slot   = column->face->glyph;
+    CachedGlyph*  bucket = &column->glyphs[gindex % GLYPH_CACHE_BUCKETS];
+    CachedGlyph   glyph;
+
+
+    for ( glyph = *bucket; glyph; glyph = glyph->next )
+      if ( glyph->gindex == gindex )
+        return glyph;
+
+    if ( column->cache_size > GLYPH_CACHE_BUDGET )
+    {
+      column_state_flush( column );
+      bucket = &column->glyphs[gindex % GLYPH_CACHE_BUCKETS];
+    }
+
+    if ( FT_Load_Glyph( column->face, gindex, load_flags ) )
+    {
+      column->slot_gindex = -1;
+      return NULL;
+    }
+
+    glyph = (CachedGlyph)calloc( 1, sizeof ( *glyph ) );
+    if ( glyph == NULL )
+      panic( "ftdiff: not enough memory\n" );
+
+    glyph->gindex         = gindex;
+    glyph->advance        = slot->advance.x;
+    glyph->linear_advance = slot->linearHoriAdvance >> 10;
+    glyph->lsb_delta      = slot->lsb_delta;
+    glyph->rsb_delta      = slot->rsb_delta;
+
+    glyph->next = *bucket;
+    *bucket     = glyph;
+
+    column->cache_size += sizeof ( *glyph );
+    column->slot_gindex = gindex;
+
+    return glyph;
+  }
+
+
+  /* Return the image of `glyph' shifted horizontally by `shift', */
+  /* rendering it if not cached.                                  */
+  static CachedImage
+  column_state_get_image( ColumnState  column,
+                          CachedGlyph  glyph,
+                          FT_Pos       shift,
+                          FT_Int32     load_flags )
+  {
+    FT_GlyphSlot  slot  = column->face->glyph;
+    CachedImage   image = glyph->images[shift];
+    size_t        size;
+
+
+    if ( image )
+      return image;
+
+    /* the slot is still untouched if the glyph has just been loaded */
+    if ( column->slot_gindex != (FT_Long)glyph->gindex )
+    {
+      if ( FT_Load_Glyph( column->face, glyph->gindex, load_flags ) )
+      {
+        column->slot_gindex = -1;
+        return NULL;
+      }
+    }
+    column->slot_gindex = -1;
+
+    image = (CachedImage)calloc( 1, sizeof ( *image ) );
+    if ( image == NULL )
+      panic( "ftdiff: not enough memory\n" );
+
+    if ( slot->format == FT_GLYPH_FORMAT_OUTLINE )
+    {
+      FT_BBox  cbox;
+
+
+      FT_Outline_Translate( &slot->outline, shift, 0 );
+      FT_Outline_Get_CBox( &slot->outline, &cbox );
+
+      image->is_outline = 1;
+      image->cbox_xMax  = cbox.xMax;
+
+      FT_Render_Glyph( slot,
+                       column->use_lcd_filter ? FT_RENDER_MODE_LCD
+                                              : FT_RENDER_MODE_NORMAL );
+    }
+
+    image->left   = slot->bitmap_left;
+    image->top    = slot->bitmap_top;
+    image->bitmap = slot->bitmap;
+
+    size = (size_t)( slot->bitmap.pitch < 0 ? -slot->bitmap.pitch
+                                            : slot->bitmap.pitch ) *
+           slot->bitmap.rows;
+
+    image->bitmap.buffer = NULL;
+    if ( size )
+    {
+      image->bitmap.buffer = (unsigned char*)malloc( size );
+      if ( image->bitmap.buffer == NULL )
+        panic( "ftdiff: not enough memory\n" );
+
+      memcpy( image->bitmap.buffer, slot->bitmap.buffer, size );
+    }
+
+    glyph->images[shift] = image;
+    column->cache_size  += sizeof ( *image ) + size;
+
+    return image;
+  }
+
+
   /** RENDERING **/
 
+  /* Draw the text of column `idx' to `display'.  This only accesses */
+  /* the column's own FreeType objects and may run concurrently for  */
+  /* different columns, drawing to different displays.               */
   static void
   render_state_draw( RenderState  state,
+                     Display      display,
                      const char*  text,
                      int          idx,
                      int          x,
@@ -562,43 +896,13 @@
     FT_Bool      have_0x0D      = 0;
 
 
-    /* no need to check for errors: the values used here are always valid */
-    FT_Property_Set( state->library,
-                     "cff",
-                     "hinting-engine",
-                     &column->cff_hinting_engine );
-    FT_Property_Set( state->library,
-                     "type1",
-                     "hinting-engine",
-                     &column->type1_hinting_engine );
-    FT_Property_Set( state->library,
-                     "t1cid",
-                     "hinting-engine",
-                     &column->t1cid_hinting_engine );
-
-    FT_Property_Set( state->library,
-                     "truetype",
-                     "interpreter-version",
-                     &column->tt_interpreter_versions
-                       [column->tt_interpreter_version_idx] );
-
-    /* changing a property is in most cases a global operation; */
-    /* we are on the safe side if we reload the face completely */
-    /* (this is something a normal program doesn't need to do)  */
-    render_state_set_file( state );
-    _render_state_rescale( state );
-
-    face = state->face;
-
-    if ( column->use_lcd_filter )
-      FT_Library_SetLcdFilter( face->glyph->library, column->lcd_filter );
+    if ( column_state_update( state, column ) )
+      return;
 
-    if ( column->use_custom_lcd_filter )
-      FT_Library_SetLcdFilterWeights( face->glyph->library,
-                                      column->filter_weights );
+    face = column->face;
 
-    y          += state->size->metrics.ascender / 64;
-    line_height = state->size->metrics.height / 64;
+    y          += face->size->metrics.ascender / 64;
+    line_height = face->size->metrics.height / 64;
 
     if ( rmode == HINT_MODE_AUTOHINT )
       load_flags = FT_LOAD_FORCE_AUTOHINT;
@@ -612,11 +916,13 @@
 
     while ( 1 )
     {
-      int           ch;
-      FT_UInt       gindex;
-      FT_GlyphSlot  slot = face->glyph;
-      FT_Bitmap*    map  = &slot->bitmap;
-      FT_Long       xmax;
+      int          ch;
+      FT_UInt      gindex;
+      CachedGlyph  glyph;
+      CachedImage  image;
+      FT_Bitmap*   map;
+      FT_Pos       shift = 0;
+      FT_Long      xmax;
 
 
       ch = utf8_next( &p, p_end );
@@ -673,10 +979,10 @@
         have_0x0D = 0;
       }
 
-      gindex = FT_Get_Char_Index( state->face, (FT_ULong)ch );
-      error  = FT_Load_Glyph( face, gindex, load_flags );
+      gindex = FT_Get_Char_Index( face, (FT_ULong)ch );
+      glyph  = column_state_get_glyph( column, gindex, load_flags );
 
-      if ( error )
+      if ( !glyph )
         continue;
 
       if ( column->use_kerning && gindex != 0 && prev_glyph != 0 )
@@ -696,57 +1002,46 @@
       if ( rmode != HINT_MODE_AUTOHINT_LIGHT_SUBPIXEL &&
            column->use_deltas                         )
       {
-        if ( prev_rsb_delta - face->glyph->lsb_delta > 32 )
+        if ( prev_rsb_delta - glyph->lsb_delta > 32 )
           x_origin -= 64;
-        else if ( prev_rsb_delta - face->glyph->lsb_delta < -31 )
+        else if ( prev_rsb_delta - glyph->lsb_delta < -31 )
           x_origin += 64;
       }
-      prev_rsb_delta = face->glyph->rsb_delta;
+      prev_rsb_delta = glyph->rsb_delta;
 
       /* implement sub-pixel positioning for       */
       /* un-hinted and (second) light hinting mode */
-      if ( ( rmode == HINT_MODE_UNHINTED                ||
-             rmode == HINT_MODE_AUTOHINT_LIGHT_SUBPIXEL ) &&
-           slot->format == FT_GLYPH_FORMAT_OUTLINE        )
-      {
-        FT_Pos  shift = x_origin & 63;
+      if ( rmode == HINT_MODE_UNHINTED                ||
+           rmode == HINT_MODE_AUTOHINT_LIGHT_SUBPIXEL )
+        shift = x_origin & 63;
 
+      image = column_state_get_image( column, glyph, shift, load_flags );
+      if ( !image )
+        continue;
 
-        FT_Outline_Translate( &slot->outline, shift, 0 );
-      }
+      map = &image->bitmap;
 
       if ( column->use_cboxes )
       {
-        if ( slot->format == FT_GLYPH_FORMAT_OUTLINE )
-        {
-          FT_BBox  cbox;
-
-
-          FT_Outline_Get_CBox( &slot->outline, &cbox );
-          xmax = ( x_origin + cbox.xMax + 63 ) >> 6;
-        }
+        if ( image->is_outline )
+          xmax = ( x_origin + image->cbox_xMax + 63 ) >> 6;
         else
           xmax = ( x_origin >> 6 ) +
-                 slot->bitmap_left + (FT_Long)slot->bitmap.width;
+                 image->left + (FT_Long)map->width;
       }
       else
       {
         if ( rmode == HINT_MODE_UNHINTED                ||
              rmode == HINT_MODE_AUTOHINT_LIGHT_SUBPIXEL )
-          xmax = slot->linearHoriAdvance >> 10;
+          xmax = glyph->linear_advance;
         else
-          xmax = slot->advance.x;
+          xmax = glyph->advance;
 
         xmax  += x_origin;
         xmax >>= 6;
         xmax  -= 1;
       }
 
-      if ( slot->format == FT_GLYPH_FORMAT_OUTLINE )
-        FT_Render_Glyph( slot,
-                         column->use_lcd_filter ? FT_RENDER_MODE_LCD
-                                                : FT_RENDER_MODE_NORMAL );
-
       if ( xmax >= right )
       {
         x  = left;
@@ -762,171 +1057,184 @@
         DisplayMode  mode = DISPLAY_MODE_MONO;
 
 
-        if ( slot->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY )
+        if ( map->pixel_mode == FT_PIXEL_MODE_GRAY )
           mode = DISPLAY_MODE_GRAY;
-        else if ( slot->bitmap.pixel_mode == FT_PIXEL_MODE_LCD )
+        else if ( map->pixel_mode == FT_PIXEL_MODE_LCD )
           mode = DISPLAY_MODE_LCD;
 
-        state->display.disp_draw( state->display.disp, mode,
-                                  ( x_origin >> 6 ) + slot->bitmap_left,
-                                  y - slot->bitmap_top,
-                                  (int)map->width, (int)map->rows,
-                                  map->pitch, map->buffer );
+        display->disp_draw( display->disp, mode,
+                            ( x_origin >> 6 ) + image->left,
+                            y - image->top,
+                            (int)map->width, (int)map->rows,
+                            map->pitch, map->buffer );
       }
       if ( rmode == HINT_MODE_UNHINTED                ||
            rmode == HINT_MODE_AUTOHINT_LIGHT_SUBPIXEL )
-        x_origin += slot->linearHoriAdvance >> 10;
+        x_origin += glyph->linear_advance;
       else
-        x_origin += slot->advance.x;
+        x_origin += glyph->advance;
 
       prev_glyph = gindex;
     }
+  }
 
-    /* display footer on this column */
-    {
-      const char*  module_name = FT_FACE_DRIVER_NAME( state->face );
-      void*        disp        = state->display.disp;
 
-      const char*  extra;
-      const char*  msg;
-      char         temp[64];
+  /* Draw the footer of column `idx', placed at `left' below `bottom'. */
+  static void
+  render_state_draw_footer( RenderState  state,
+                            int          idx,
+                            int          left,
+                            int          bottom )
+  {
+    ColumnState  column = &state->columns[idx];
+    HintMode     rmode  = column->hint_mode;
+    void*        disp   = state->display.disp;
+
+    const char*  module_name;
+    const char*  extra;
+    const char*  msg;
+    char         temp[64];
 
 
-      extra = "";
-      if ( rmode == HINT_MODE_BYTECODE )
+    if ( !column->face )
+      return;
+
+    module_name = FT_FACE_DRIVER_NAME( column->face );
+
+    extra = "";
+    if ( rmode == HINT_MODE_BYTECODE )
+    {
+      if ( !strcmp( module_name, "cff" ) )
       {
-        if ( !strcmp( module_name, "cff" ) )
+        switch ( column->cff_hinting_engine )
         {
-          switch ( column->cff_hinting_engine )
-          {
-          case FT_HINTING_FREETYPE:
-            extra = " (CFF FT)";
-            break;
-          case FT_HINTING_ADOBE:
-            extra = " (CFF Adobe)";
-            break;
-          }
+        case FT_HINTING_FREETYPE:
+          extra = " (CFF FT)";
+          break;
+        case FT_HINTING_ADOBE:
+          extra = " (CFF Adobe)";
+          break;
         }
+      }
 
-        else if ( !strcmp( module_name, "type1" ) )
+      else if ( !strcmp( module_name, "type1" ) )
+      {
+        switch ( column->type1_hinting_engine )
         {
-          switch ( column->type1_hinting_engine )
-          {
-          case FT_HINTING_FREETYPE:
-            extra = " (T1 FT)";
-            break;
-          case FT_HINTING_ADOBE:
-            extra = " (T1 Adobe)";
-            break;
-          }
+        case FT_HINTING_FREETYPE:
+          extra = " (T1 FT)";
+          break;
+        case FT_HINTING_ADOBE:
+          extra = " (T1 Adobe)";
+          break;
         }
+      }
 
-        else if ( !strcmp( module_name, "t1cid" ) )
+      else if ( !strcmp( module_name, "t1cid" ) )
+      {
+        switch ( column->t1cid_hinting_engine )
         {
-          switch ( column->t1cid_hinting_engine )
-          {
-          case FT_HINTING_FREETYPE:
-            extra = " (CID FT)";
-            break;
-          case FT_HINTING_ADOBE:
-            extra = " (CID Adobe)";
-            break;
-          }
+        case FT_HINTING_FREETYPE:
+          extra = " (CID FT)";
+          break;
+        case FT_HINTING_ADOBE:
+          extra = " (CID Adobe)";
+          break;
         }
+      }
 
-        else if ( !strcmp( module_name, "truetype" ) )
+      else if ( !strcmp( module_name, "truetype" ) )
+      {
+        switch ( column->tt_interpreter_versions[
+                   column->tt_interpreter_version_idx] )
         {
-          switch ( column->tt_interpreter_versions[
-                     column->tt_interpreter_version_idx] )
-          {
-          case TT_INTERPRETER_VERSION_35:
-            extra = " (TT v35)";
-            break;
-          case TT_INTERPRETER_VERSION_40:
-            extra = " (TT v40)";
-            break;
-          }
+        case TT_INTERPRETER_VERSION_35:
+          extra = " (TT v35)";
+          break;
+        case TT_INTERPRETER_VERSION_40:
+          extra = " (TT v40)";
+          break;
         }
       }
+    }
 
-      snprintf( temp, sizeof ( temp ), "%s%s",
-                render_mode_names[column->hint_mode], extra );
-      state->display.disp_text( disp, left,
-                                bottom + 5, temp );
+    snprintf( temp, sizeof ( temp ), "%s%s",
+              render_mode_names[column->hint_mode], extra );
+    state->display.disp_text( disp, left,
+                              bottom + 5, temp );
 
-      if ( column->use_lcd_filter )
-        msg = "LCD rendering";
-      else
-        msg = "gray rendering";
-      state->display.disp_text( disp, left,
-                                bottom + HEADER_HEIGHT + 5, msg );
+    if ( column->use_lcd_filter )
+      msg = "LCD rendering";
+    else
+      msg = "gray rendering";
+    state->display.disp_text( disp, left,
+                              bottom + HEADER_HEIGHT + 5, msg );
 
-      if ( column->use_lcd_filter )
+    if ( column->use_lcd_filter )
+    {
+      if ( column->use_custom_lcd_filter )
       {
-        if ( column->use_custom_lcd_filter )
-        {
-          int             fwi = column->fw_index;
-          unsigned char*  fw  = column->filter_weights;
-
-
-          snprintf( temp, sizeof ( temp ),
-                    "%s0x%02X%s0x%02X%s0x%02X%s0x%02X%s0x%02X%s",
-                    fwi == 0 ? "[" : " ",
-                      fw[0],
-                    fwi == 0 ? "]" : ( fwi == 1 ? "[" : " " ),
-                      fw[1],
-                    fwi == 1 ? "]" : ( fwi == 2 ? "[" : " " ),
-                      fw[2],
-                    fwi == 2 ? "]" : ( fwi == 3 ? "[" : " " ),
-                      fw[3],
-                    fwi == 3 ? "]" : ( fwi == 4 ? "[" : " " ),
-                      fw[4],
-                    fwi == 4 ? "]" : " " );
-          state->display.disp_text( disp, left,
-                                    bottom + 2 * HEADER_HEIGHT + 5, temp );
-        }
-        else
-        {
-          switch ( column->lcd_filter )
-          {
-          case FT_LCD_FILTER_NONE:
-            msg = "LCD without filtering";
-            break;
-          case FT_LCD_FILTER_DEFAULT:
-            msg = "default LCD filter";
-            break;
-          case FT_LCD_FILTER_LIGHT:
-            msg = "light LCD filter";
-            break;
-          default:
-            msg = "legacy LCD filter";
-          }
-          state->display.disp_text( disp, left,
-                                    bottom + 2 * HEADER_HEIGHT + 5, msg );
-        }
+        int             fwi = column->fw_index;
+        unsigned char*  fw  = column->filter_weights;
+
+
+        snprintf( temp, sizeof ( temp ),
+                  "%s0x%02X%s0x%02X%s0x%02X%s0x%02X%s0x%02X%s",
+                  fwi == 0 ? "[" : " ",
+                    fw[0],
+                  fwi == 0 ? "]" : ( fwi == 1 ? "[" : " " ),
+                    fw[1],
+                  fwi == 1 ? "]" : ( fwi == 2 ? "[" : " " ),
+                    fw[2],
+                  fwi == 2 ? "]" : ( fwi == 3 ? "[" : " " ),
+                    fw[3],
+                  fwi == 3 ? "]" : ( fwi == 4 ? "[" : " " ),
+                    fw[4],
+                  fwi == 4 ? "]" : " " );
+        state->display.disp_text( disp, left,
+                                  bottom + 2 * HEADER_HEIGHT + 5, temp );
       }
       else
       {
-        msg = "";
+        switch ( column->lcd_filter )
+        {
+        case FT_LCD_FILTER_NONE:
+          msg = "LCD without filtering";
+          break;
+        case FT_LCD_FILTER_DEFAULT:
+          msg = "default LCD filter";
+          break;
+        case FT_LCD_FILTER_LIGHT:
+          msg = "light LCD filter";
+          break;
+        default:
+          msg = "legacy LCD filter";
+        }
         state->display.disp_text( disp, left,
                                   bottom + 2 * HEADER_HEIGHT + 5, msg );
       }
-
-      snprintf( temp, sizeof ( temp ), "%s %s %s",
-                column->use_kerning ? "+kern"
-                                    : "-kern",
-                column->use_deltas ? "+delta"
-                                   : "-delta",
-                column->use_cboxes ? "glyph boxes"
-                                   : "adv. widths" );
+    }
+    else
+    {
+      msg = "";
       state->display.disp_text( disp, left,
-                                bottom + 3 * HEADER_HEIGHT + 5, temp );
-
-      if ( state->col == idx )
-        state->display.disp_text( disp, left,
-                                  bottom + 4 * HEADER_HEIGHT + 5,
-                                  "************************" );
+                                bottom + 2 * HEADER_HEIGHT + 5, msg );
     }
+
+    snprintf( temp, sizeof ( temp ), "%s %s %s",
+              column->use_kerning ? "+kern"
+                                  : "-kern",
+              column->use_deltas ? "+delta"
+                                 : "-delta",
+              column->use_cboxes ? "glyph boxes"
+                                 : "adv. widths" );
+    state->display.disp_text( disp, left,
+                              bottom + 3 * HEADER_HEIGHT + 5, temp );
+
+    if ( state->col == idx )
+      state->display.disp_text( disp, left,
+                                bottom + 4 * HEADER_HEIGHT + 5,
+                                "************************" );
   }
 
 
@@ -1075,6 +1383,216 @@
   }
 
 
+  /* A column is rendered into an off-screen surface covering the */
+  /* column and its borders at full window height; the surfaces of */
+  /* all columns are rendered concurrently, then copied to the     */
+  /* window.                                                       */
+  typedef struct  ColumnJobRec_
+  {
+    RenderState  state;
+    const char*  text;
+    int          idx;
+    int          x;         /* text area, in surface coordinates */
+    int          y;
+    int          width;
+    int          height;
+    int          x0;        /* left edge of surface in the window */
+
+    grSurface    surface;
+    ADisplayRec  adisplay;
+    DisplayRec   display;
+
+  } ColumnJobRec, *ColumnJob;
+
+
+  static int
+  bytes_per_pixel( grPixelMode  mode )
+  {
+    switch ( mode )
+    {
+    case gr_pixel_mode_gray:
+    case gr_pixel_mode_pal8:
+      return 1;
+    case gr_pixel_mode_rgb555:
+    case gr_pixel_mode_rgb565:
+      return 2;
+    case gr_pixel_mode_rgb24:
+      return 3;
+    case gr_pixel_mode_rgb32:
+      return 4;
+    default:
+      return 0;  /* not byte-aligned */
+    }
+  }
+
+
+  static unsigned char*
+  bitmap_row( grBitmap*  bit,
+              int        y )
+  {
+    if ( bit->pitch < 0 )
+      return bit->buffer + ( y - bit->rows + 1 ) * bit->pitch;
+    else
+      return bit->buffer + y * bit->pitch;
+  }
+
+
+  /* (re)allocate the surface of a job for the current window */
+  static int
+  column_job_init( ColumnJob  job,
+                   ADisplay   display,
+                   int        x0,
+                   int        width )
+  {
+    grBitmap*  bit    = &job->surface.bitmap;
+    grBitmap*  target = display->bitmap;
+
+
+    if ( !bit->buffer                 ||
+         bit->width != width          ||
+         bit->rows  != target->rows   ||
+         bit->mode  != target->mode   )
+    {
+      if ( grNewBitmap( target->mode, target->grays,
+                        width, target->rows, bit ) )
+        return -1;
+
+      job->adisplay.gamma = -1.0;  /* force blender initialization */
+    }
+
+    if ( job->adisplay.gamma != display->gamma )
+      grSetTargetGamma( &job->surface, display->gamma );
+
+    job->adisplay         = *display;
+    job->adisplay.width   = width;
+    job->adisplay.height  = target->rows;
+    job->adisplay.surface = &job->surface;
+    job->adisplay.bitmap  = bit;
+
+    job->display.disp      = &job->adisplay;
+    job->display.disp_draw = adisplay_draw_glyph;
+    job->display.disp_text = adisplay_draw_text;
+
+    job->x0 = x0;
+
+    return 0;
+  }
+
+
+  static void*
+  column_job_run( void*  arg )
+  {
+    ColumnJob  job = (ColumnJob)arg;
+
+
+    adisplay_clear( &job->adisplay );
+    render_state_draw( job->state, &job->display, job->text, job->idx,
+                       job->x, job->y, job->width, job->height );
+
+    return NULL;
+  }
+
+
+  static void
+  column_job_done( ColumnJob  job )
+  {
+    if ( job->surface.bitmap.buffer )
+      grDoneBitmap( &job->surface.bitmap );
+  }
+
+
+  /* Draw the text of all three columns; with threads, each column */
+  /* is rendered off-screen on its own thread.                     */
+  static void
+  draw_columns( RenderState  state,
+                ColumnJob    jobs,
+                const char*  text,
+                const int*   x,
+                int          border,
+                int          y,
+                int          width,
+                int          height )
+  {
+    ADisplay  display = (ADisplay)state->display.disp;
+    int       bpp     = bytes_per_pixel( display->bitmap->mode );
+    int       i;
+
+#ifdef FTDIFF_THREADS
+    pthread_t  threads[3];
+    int        started[3] = { 0, 0, 0 };
+#endif
+
+
+    for ( i = 0; i < 3 && bpp; i++ )
+    {
+      if ( column_job_init( jobs + i, display,
+                            x[i] - border, width + 2 * border ) )
+        break;
+
+      jobs[i].state  = state;
+      jobs[i].text   = text;
+      jobs[i].idx    = i;
+      jobs[i].x      = border;
+      jobs[i].y      = y;
+      jobs[i].width  = width;
+      jobs[i].height = height;
+    }
+
+#ifdef FTDIFF_THREADS
+    if ( i == 3 && bpp )
+    {
+      int  j, row;
+
+
+      /* the first column is rendered in this thread */
+      for ( i = 1; i < 3; i++ )
+        started[i] = !pthread_create( &threads[i], NULL,
+                                      column_job_run, jobs + i );
+
+      for ( i = 0; i < 3; i++ )
+      {
+        if ( started[i] )
+          pthread_join( threads[i], NULL );
+        else
+          column_job_run( jobs + i );
+      }
+
+      for ( i = 0; i < 3; i++ )
+      {
+        grBitmap*  src = &jobs[i].surface.bitmap;
+        int        x0  = jobs[i].x0;
+        int        w   = src->width;
+
+
+        /* clip to the window */
+        j = 0;
+        if ( x0 < 0 )
+        {
+          j  = -x0;
+          w += x0;
+        }
+        if ( x0 + j + w > display->bitmap->width )
+          w = display->bitmap->width - x0 - j;
+        if ( w <= 0 )
+          continue;
+
+        for ( row = 0; row < src->rows && row < display->bitmap->rows; row++ )
+          memcpy( bitmap_row( display->bitmap, row ) + ( x0 + j ) * bpp,
+                  bitmap_row( src, row ) + j * bpp,
+                  (size_t)( w * bpp ) );
+      }
+
+      return;
+    }
+#endif
+
+    /* draw directly to the window */
+    for ( i = 0; i < 3; i++ )
+      render_state_draw( state, &state->display, text, i,
+                         x[i], y, width, height );
+  }
+
+
   static void
   event_help( RenderState  state )
   {
@@ -1263,29 +1781,34 @@
 
     case grKEY( 'H' ):
       {
-        const char*  module_name = FT_FACE_DRIVER_NAME( state->face );
+        const char*  module_name;
+
 
+        if ( !column->face )
+          break;
+
+        module_name = FT_FACE_DRIVER_NAME( column->face );
 
         if ( column->hint_mode == HINT_MODE_BYTECODE )
         {
           if ( !strcmp( module_name, "cff" ) )
           {
             FTDemo_Event_Cff_Hinting_Engine_Change(
-              state->library,
+              column->library,
               &column->cff_hinting_engine,
               1 );
           }
           else if ( !strcmp( module_name, "type1" ) )
           {
             FTDemo_Event_Type1_Hinting_Engine_Change(
-              state->library,
+              column->library,
               &column->type1_hinting_engine,
               1 );
           }
           else if ( !strcmp( module_name, "t1cid" ) )
           {
             FTDemo_Event_T1cid_Hinting_Engine_Change(
-              state->library,
+              column->library,
               &column->t1cid_hinting_engine,
               1 );
           }
@@ -1295,7 +1818,7 @@
             column->tt_interpreter_version_idx %=
               column->num_tt_interpreter_versions;
 
-            FT_Property_Set( state->library,
+            FT_Property_Set( column->library,
                              "truetype",
                              "interpreter-version",
                              &column->tt_interpreter_versions[
@@ -1441,6 +1964,7 @@
     ADisplayRec     adisplay[1];
     RenderStateRec  state[1];
     DisplayRec      display[1];
+    ColumnJobRec    jobs[3];
     int             width      = 640;
     int             height     = 480;
     int             resolution = -1;
@@ -1454,6 +1978,8 @@
 
     execname  = ft_basename( argv[0] );
 
+    memset( jobs, 0, sizeof ( jobs ) );
+
     if ( FT_Init_FreeType( &library ) != 0 )
       panic( "could not initialize FreeType\n" );
 
@@ -1610,15 +2136,16 @@
       column_y_start = 10 + 2 * HEADER_HEIGHT;
       column_height  = height - 8 * HEADER_HEIGHT - 5;
 
-      render_state_draw( state, text, 0,
-                         column_x_start[0], column_y_start,
-                         column_width, column_height );
-      render_state_draw( state, text, 1,
-                         column_x_start[1], column_y_start,
-                         column_width, column_height );
-      render_state_draw( state, text, 2,
-                         column_x_start[2], column_y_start,
-                         column_width, column_height );
+      draw_columns( state, jobs, text,
+                    column_x_start, border_width, column_y_start,
+                    column_width, column_height );
+
+      render_state_draw_footer( state, 0, column_x_start[0],
+                                column_y_start + column_height );
+      render_state_draw_footer( state, 1, column_x_start[1],
+                                column_y_start + column_height );
+      render_state_draw_footer( state, 2, column_x_start[2],
+                                column_y_start + column_height );
 
       write_global_info( state );
 
@@ -1634,6 +2161,10 @@
         break;
     }
 
+    column_job_done( jobs + 0 );
+    column_job_done( jobs + 1 );
+    column_job_done( jobs + 2 );
+
     render_state_done( state );
     adisplay_done( adisplay );
     exit( 0 );  /* for safety reasons */
@@ -34,6 +34,7 @@
 
 #include "common.h"
 #include "output.h"
+#include "strbuf.h"
 #include "mlgetopt.h"
 
 #include <stdio.h>
@@ -41,6 +42,13 @@
 #include <string.h>
 #include <time.h>
 
+#ifndef _WIN32
+#define DUMP_THREADS
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
 
   static FT_Error  error;
 
@@ -50,6 +58,20 @@
   static int  bytecode    = 0;
   static int  tables      = 0;
   static int  utf8        = 0;
+  static int  json        = 0;
+
+
+  static const char*
+  Error_String( FT_Error  err )
+  {
+    const FT_String  *str;
+
+
+    switch( err )
+    #include <freetype/fterrors.h>
+
+    return str;
+  }
 
 
   /* PanicZ */
@@ -57,15 +79,10 @@
   PanicZ( FT_Library   library,
           const char*  message )
   {
-    const FT_String  *str;
-
-
     FT_Done_FreeType( library );
 
-    switch( error )
-    #include <freetype/fterrors.h>
-
-    fprintf( stderr, "%s\n  error = 0x%04x, %s\n", message, error, str );
+    fprintf( stderr, "%s\n  error = 0x%04x, %s\n",
+             message, error, Error_String( error ) );
     exit( 1 );
   }
 
@@ -111,8 +128,9 @@
       "----------------------------------------------------------\n"
       "\n"
       "Usage: %s [options] fontname\n"
+      "       %s -J [-j N] [-n] [-t] file_or_directory...\n"
       "\n",
-             execname );
+             execname, execname );
 
     fprintf( stderr,
       "  -c, -C    Print charmap coverage and/or CID coverage.\n"
@@ -121,6 +139,10 @@
       "  -t        Print SFNT table list.\n"
       "  -u        Emit UTF8.\n"
       "\n"
+      "  -J        Print one line of JSON per face of all given files;\n"
+      "            directories are searched recursively.\n"
+      "  -j N      Use N threads with `-J' (default: 1).\n"
+      "\n"
       "  -v        Show version.\n"
       "\n" );
 
@@ -144,6 +166,35 @@
   }
 
 
+  /* Format an SFNT `LONGDATETIME' value as `YYYY-MM-DD' into `buf', */
+  /* which must hold 11 bytes.  Return 0 for pre-epoch times.         */
+  static int
+  Sfnt_Date( char*            buf,
+             const FT_ULong*  date )
+  {
+    time_t     t = (time_t)date[1];
+    struct tm  tm;
+
+
+    /* ignore most of upper bits until 2176 and adjust epoch */
+    t = date[0] == 1 ? t + 2212122496U
+                     : t - 2082844800U;
+
+    /* ignore pre-epoch time that gmtime cannot handle on some systems */
+    if ( t < 0 )
+      return 0;
+
+#ifdef DUMP_THREADS
+    gmtime_r( &t, &tm );
+#else
+    tm = *gmtime( &t );
+#endif
+    strftime( buf, 11, "%Y-%m-%d", &tm );
+
+    return 1;
+  }
+
+
 #define Print_Type_Number( name ) \
   printf( "%s%d\n", Name_Field ( #name ), face->name )
 
@@ -171,28 +222,13 @@
     head = (TT_Header*)FT_Get_Sfnt_Table( face, FT_SFNT_HEAD );
     if ( head )
     {
-      char    buf[11];
-      time_t  created  = (time_t)head->Created [1];
-      time_t  modified = (time_t)head->Modified[1];
+      char  buf[11];
 
 
-      /* ignore most of upper bits until 2176 and adjust epoch */
-      created  = head->Created [0] == 1 ? created  + 2212122496U
-                                        : created  - 2082844800U;
-      modified = head->Modified[0] == 1 ? modified + 2212122496U
-                                        : modified - 2082844800U;
-
-      /* ignore pre-epoch time that gmtime cannot handle on some systems */
-      if ( created >= 0 )
-      {
-        strftime( buf, sizeof ( buf ), "%Y-%m-%d", gmtime( &created ) );
+      if ( Sfnt_Date( buf, head->Created ) )
         printf( "%s%s\n", Name_Field( "created" ), buf );
-      }
-      if ( modified >= 0 )
-      {
-        strftime( buf, sizeof ( buf ), "%Y-%m-%d", gmtime( &modified ) );
+      if ( Sfnt_Date( buf, head->Modified ) )
         printf( "%s%s\n", Name_Field( "modified" ), buf );
-      }
 
       printf( head->Font_Revision & 0xFFC0 ? "%s%.4g\n" : "%s%.2f\n",
               Name_Field( "revision" ), head->Font_Revision / 65536.0 );
@@ -850,8 +886,7 @@
 
     for ( i = 0; i < num_names; i++ )
     {
-      error = FT_Get_Sfnt_Name( face, i, &name );
-      if ( error )
+      if ( FT_Get_Sfnt_Name( face, i, &name ) )
         continue;
 
       if ( name.name_id == strid )
@@ -1025,9 +1060,9 @@
 
 
   static void
-  Print_Bytecode( FT_Byte*     buffer,
-                  FT_UShort    length,
-                  const char*  tag )
+  Print_Bytecode( const FT_Byte*  buffer,
+                  FT_UShort       length,
+                  const char*     tag )
   {
     FT_UShort  i;
     int        j = 0;  /* status counter */
@@ -1067,81 +1102,222 @@
   }
 
 
+  /* A font table, either pointing into the font stream or copied. */
+  typedef struct  Table_
+  {
+    const FT_Byte*  data;
+    FT_ULong        length;
+    FT_Byte*        copy;    /* heap copy, if any */
+
+  } Table;
+
+
+#define PEEK_ULONG( p )  ( (FT_ULong)(p)[0] << 24 | \
+                           (FT_ULong)(p)[1] << 16 | \
+                           (FT_ULong)(p)[2] <<  8 | \
+                           (FT_ULong)(p)[3]       )
+#define PEEK_USHORT( p )  ( (FT_UShort)( (p)[0] << 8 | (p)[1] ) )
+
+
+  /* If the font stream resides in memory, which is the case for       */
+  /* memory-mapped font files and decompressed WOFF fonts, find table  */
+  /* `tag' in the SFNT directory.  Only entries that agree with the    */
+  /* table length reported by FreeType are used.  `available' is set   */
+  /* to the number of bytes from the table start to the stream end.    */
+  static const FT_Byte*
+  Find_Table( FT_Face    face,
+              FT_ULong   tag,
+              FT_ULong*  length,
+              FT_ULong*  available )
+  {
+    FT_Stream       stream = face->stream;
+    const FT_Byte*  base;
+    FT_ULong        size, dir, num_tables;
+    FT_ULong        i, ft_tag, ft_length = 0;
+
+
+    if ( !stream || !stream->base )
+      return NULL;
+
+    base = stream->base;
+    size = stream->size;
+
+    if ( FT_Sfnt_Table_Info( face, 0, NULL, &num_tables ) )
+      return NULL;
+
+    for ( i = 0; i < num_tables; i++ )
+      if ( !FT_Sfnt_Table_Info( face, (FT_UInt)i, &ft_tag, &ft_length ) &&
+           ft_tag == tag                                                  )
+        break;
+
+    if ( i == num_tables || size < 12 )
+      return NULL;
+
+    dir = 0;
+    if ( PEEK_ULONG( base ) == TTAG_ttcf )
+    {
+      FT_ULong  index = (FT_ULong)( face->face_index & 0xFFFF );
+
+
+      if ( size < 16                       ||
+           index >= PEEK_ULONG( base + 8 ) ||
+           index > ( size - 16 ) / 4       )
+        return NULL;
+
+      dir = PEEK_ULONG( base + 12 + 4 * index );
+      if ( dir > size - 12 )
+        return NULL;
+    }
+
+    num_tables = PEEK_USHORT( base + dir + 4 );
+    dir       += 12;
+
+    if ( num_tables > ( size - dir ) / 16 )
+      return NULL;
+
+    for ( i = 0; i < num_tables; i++, dir += 16 )
+    {
+      FT_ULong  offset;
+
+
+      if ( PEEK_ULONG( base + dir ) != tag )
+        continue;
+
+      offset = PEEK_ULONG( base + dir + 8 );
+      if ( PEEK_ULONG( base + dir + 12 ) != ft_length || offset > size )
+        return NULL;
+
+      *length    = ft_length;
+      *available = size - offset;
+
+      return base + offset;
+    }
+
+    return NULL;
+  }
+
+
+  /* Get the first `length' bytes of table `tag', or all of it if      */
+  /* `length' is zero.  Copy the data only if the font stream is not   */
+  /* in memory.                                                        */
+  static FT_Error
+  Get_Table( FT_Face   face,
+             FT_ULong  tag,
+             FT_ULong  length,
+             Table*    table )
+  {
+    FT_ULong  table_length, available;
+    FT_Error  err;
+
+
+    table->copy   = NULL;
+    table->length = 0;
+    table->data   = Find_Table( face, tag, &table_length, &available );
+
+    if ( table->data )
+    {
+      if ( !length )
+        length = table_length;
+
+      /* like `FT_Load_Sfnt_Table', allow reading beyond the table end */
+      if ( length > available )
+      {
+        table->data = NULL;
+        return FT_Err_Invalid_Stream_Operation;
+      }
+
+      table->length = length;
+      return FT_Err_Ok;
+    }
+
+    if ( !length )
+    {
+      err = FT_Load_Sfnt_Table( face, tag, 0, NULL, &length );
+      if ( err || !length )
+        return err;
+    }
+
+    table->copy = (FT_Byte*)malloc( length );
+    if ( !table->copy )
+      return FT_Err_Out_Of_Memory;
+
+    err = FT_Load_Sfnt_Table( face, tag, 0, table->copy, &length );
+    if ( err )
+      return err;
+
+    table->data   = table->copy;
+    table->length = length;
+
+    return FT_Err_Ok;
+  }
+
+
+  static void
+  Free_Table( Table*  table )
+  {
+    free( table->copy );
+
+    table->copy   = NULL;
+    table->data   = NULL;
+    table->length = 0;
+  }
+
+
   static void
   Print_Programs( FT_Face  face )
   {
-    FT_ULong    fpgm_length = 0;
-    FT_ULong    prep_length = 0;
-    FT_ULong    loca_length;
-    FT_ULong    glyf_length = 0;
-    FT_UShort   i;
-    FT_Byte*    buffer = NULL;
-    FT_Byte*    offset = NULL;
+    FT_ULong         glyf_length;
+    FT_UShort        i;
+    const FT_Byte*   buffer;
+    const FT_Byte*   offset;
+    Table            table = { NULL, 0, NULL };
+    Table            loca  = { NULL, 0, NULL };
+    Table            glyf  = { NULL, 0, NULL };
 
     TT_Header*      head;
     TT_MaxProfile*  maxp;
 
 
-    error = FT_Load_Sfnt_Table( face, TTAG_fpgm, 0, NULL, &fpgm_length );
-    if ( error || fpgm_length == 0 )
+    error = Get_Table( face, TTAG_fpgm, 0, &table );
+    if ( error || table.length == 0 )
       goto Prep;
 
-    buffer = (FT_Byte*)malloc( fpgm_length );
-    if ( buffer == NULL )
-      goto Exit;
-
-    error = FT_Load_Sfnt_Table( face, TTAG_fpgm, 0, buffer, &fpgm_length );
-    if ( error )
-      goto Exit;
-
     printf( "font program" );
-    Print_Bytecode( buffer, (FT_UShort)fpgm_length, "fpgm" );
+    Print_Bytecode( table.data, (FT_UShort)table.length, "fpgm" );
 
   Prep:
-    error = FT_Load_Sfnt_Table( face, TTAG_prep, 0, NULL, &prep_length );
-    if ( error || prep_length == 0 )
-      goto Glyf;
-
-    buffer = (FT_Byte*)realloc( buffer, prep_length );
-    if ( buffer == NULL )
-      goto Exit;
+    Free_Table( &table );
 
-    error = FT_Load_Sfnt_Table( face, TTAG_prep, 0, buffer, &prep_length );
-    if ( error )
-      goto Exit;
+    error = Get_Table( face, TTAG_prep, 0, &table );
+    if ( error || table.length == 0 )
+      goto Glyf;
 
     printf( "\ncontrol value program" );
-    Print_Bytecode( buffer, (FT_UShort)prep_length, "prep" );
+    Print_Bytecode( table.data, (FT_UShort)table.length, "prep" );
 
   Glyf:
+    Free_Table( &table );
+
     head =     (TT_Header*)FT_Get_Sfnt_Table( face, FT_SFNT_HEAD );
     maxp = (TT_MaxProfile*)FT_Get_Sfnt_Table( face, FT_SFNT_MAXP );
 
     if ( head == NULL || maxp == NULL )
       goto Exit;
 
-    loca_length = head->Index_To_Loc_Format ? 4 * maxp->numGlyphs + 4
-                                            : 2 * maxp->numGlyphs + 2;
-
-    offset = (FT_Byte*)malloc( loca_length );
-    if ( offset == NULL )
-      goto Exit;
-
-    error = FT_Load_Sfnt_Table( face, TTAG_loca, 0, offset, &loca_length );
+    error = Get_Table( face, TTAG_loca,
+                       head->Index_To_Loc_Format ? 4 * maxp->numGlyphs + 4
+                                                 : 2 * maxp->numGlyphs + 2,
+                       &loca );
     if ( error )
       goto Exit;
 
-    error = FT_Load_Sfnt_Table( face, TTAG_glyf, 0, NULL, &glyf_length );
-    if ( error || glyf_length == 0 )
+    error = Get_Table( face, TTAG_glyf, 0, &glyf );
+    if ( error || glyf.length == 0 )
       goto Exit;
 
-    buffer = (FT_Byte*)realloc( buffer, glyf_length );
-    if ( buffer == NULL )
-      goto Exit;
-
-    error = FT_Load_Sfnt_Table( face, TTAG_glyf, 0, buffer, &glyf_length );
-    if ( error )
-      goto Exit;
+    offset      = loca.data;
+    buffer      = glyf.data;
+    glyf_length = glyf.length;
 
     for ( i = 0; i < maxp->numGlyphs; i++ )
     {
@@ -1244,58 +1420,61 @@
     }
 
   Exit:
-    free( buffer );
-    free( offset );
+    Free_Table( &glyf );
+    Free_Table( &loca );
   }
 
 
-  static void
-  Print_Glyfs( FT_Face  face )
+  typedef struct  GlyfStats_
   {
-    FT_ULong    loca_length;
-    FT_ULong    glyf_length = 0;
-    FT_UShort   i;
-    FT_Byte*    buffer = NULL;
-    FT_Byte*    offset = NULL;
-
-    FT_Int      simple            = 0;
-    FT_Int      simple_overlap    = 0;
-    FT_Int      composite         = 0;
-    FT_Int      composite_overlap = 0;
-    FT_Int      empty             = 0;
+    FT_Int  simple;
+    FT_Int  simple_overlap;
+    FT_Int  composite;
+    FT_Int  composite_overlap;
+    FT_Int  empty;
+    FT_Int  invalid;
+
+  } GlyfStats;
+
+
+  /* Classify the glyphs of the `glyf' table; return 0 if it is missing. */
+  static int
+  Count_Glyfs( FT_Face     face,
+               GlyfStats*  stats,
+               FT_Bool     verbose )
+  {
+    FT_ULong         glyf_length;
+    FT_UShort        i;
+    const FT_Byte*   buffer;
+    const FT_Byte*   offset;
+    Table            loca   = { NULL, 0, NULL };
+    Table            glyf   = { NULL, 0, NULL };
+    int              result = 0;
 
     TT_Header*      head;
     TT_MaxProfile*  maxp;
 
 
+    memset( stats, 0, sizeof ( *stats ) );
+
     head =     (TT_Header*)FT_Get_Sfnt_Table( face, FT_SFNT_HEAD );
     maxp = (TT_MaxProfile*)FT_Get_Sfnt_Table( face, FT_SFNT_MAXP );
 
     if ( head == NULL || maxp == NULL )
-      return;
-
-    loca_length = head->Index_To_Loc_Format ? 4 * maxp->numGlyphs + 4
-                                            : 2 * maxp->numGlyphs + 2;
+      return 0;
 
-    offset = (FT_Byte*)malloc( loca_length );
-    if ( offset == NULL )
+    if ( Get_Table( face, TTAG_loca,
+                    head->Index_To_Loc_Format ? 4 * maxp->numGlyphs + 4
+                                              : 2 * maxp->numGlyphs + 2,
+                    &loca ) )
       goto Exit;
 
-    error = FT_Load_Sfnt_Table( face, TTAG_loca, 0, offset, &loca_length );
-    if ( error )
-      goto Exit;
-
-    error = FT_Load_Sfnt_Table( face, TTAG_glyf, 0, NULL, &glyf_length );
-    if ( error || glyf_length == 0 )
+    if ( Get_Table( face, TTAG_glyf, 0, &glyf ) || glyf.length == 0 )
       goto Exit;
 
-    buffer = (FT_Byte*)malloc( glyf_length );
-    if ( buffer == NULL )
-      goto Exit;
-
-    error = FT_Load_Sfnt_Table( face, TTAG_glyf, 0, buffer, &glyf_length );
-    if ( error )
-      goto Exit;
+    offset      = loca.data;
+    buffer      = glyf.data;
+    glyf_length = glyf.length;
 
     for ( i = 0; i < maxp->numGlyphs; i++ )
     {
@@ -1328,37 +1507,31 @@
 
       if ( loc == end )
       {
-        empty++;
+        stats->empty++;
         continue;
       }
 
       if ( loc + 1 >= end )
-      {
-        printf( "\nglyph %hd: invalid offset (%d)\n", i, loc );
-        continue;
-      }
+        goto Invalid;
 
       len  = (FT_UInt16)( buffer[loc] << 8 | buffer[loc + 1] );
       loc += 10;
 
       if ( (FT_Int16)len < 0 )  /* composite */
       {
-        composite++;
+        stats->composite++;
 
         if ( loc + 1 >= end )
-        {
-          printf( "\nglyph %hd: invalid offset (%d)\n", i, loc );
-          continue;
-        }
+          goto Invalid;
 
         flags = (FT_UInt16)( buffer[loc] << 8 | buffer[loc + 1] );
 
-        composite_overlap += ( flags & 0x400 ) >> 10;
+        stats->composite_overlap += ( flags & 0x400 ) >> 10;
 
         continue;
       }
 
-      simple++;
+      stats->simple++;
 
       loc += 2 * len;
 
@@ -1366,7 +1539,7 @@
       {
         /* zero-contour glyphs can have no data */
         if ( len )
-          printf( "\nglyph %hd: invalid offset (%d)\n", i, loc );
+          goto Invalid;
         continue;
       }
 
@@ -1375,30 +1548,663 @@
       loc += 2 + len;
 
       if ( len >= end )
-      {
+        goto Invalid;
+
+      flags = (FT_UInt16)buffer[loc];
+
+      stats->simple_overlap += ( flags & 0x40 ) >> 6;
+      continue;
+
+    Invalid:
+      stats->invalid++;
+      if ( verbose )
         printf( "\nglyph %hd: invalid offset (%d)\n", i, loc );
+    }
+
+    result = 1;
+
+  Exit:
+    Free_Table( &glyf );
+    Free_Table( &loca );
+
+    return result;
+  }
+
+
+  static void
+  Print_Glyfs( FT_Face  face )
+  {
+    GlyfStats  stats;
+
+
+    if ( !Count_Glyfs( face, &stats, 1 ) )
+      return;
+
+    printf( "%s%d", Name_Field( "   simple" ), stats.simple );
+    printf( stats.simple_overlap    ? ", with overlap flagged in %d\n"
+                                    : "\n",
+            stats.simple_overlap );
+    printf( "%s%d", Name_Field( "   composite" ), stats.composite );
+    printf( stats.composite_overlap ? ", with overlap flagged in %d\n"
+                                    : "\n",
+            stats.composite_overlap );
+    if ( stats.empty )
+      printf( "%s%d\n", Name_Field( "   empty" ), stats.empty );
+  }
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* Batch mode: each face of each file becomes one line of JSON.          */
+  /*                                                                       */
+  /*************************************************************************/
+
+  /* Append `len' bytes of Latin-1 text as a JSON string. */
+  static void
+  Json_Latin1( StrBuf*         sb,
+               const FT_Byte*  str,
+               FT_UInt         len )
+  {
+    FT_UInt  i;
+
+
+    strbuf_addc( sb, '"' );
+    for ( i = 0; i < len; i++ )
+    {
+      if ( str[i] == '"' || str[i] == '\\' )
+      {
+        strbuf_addc( sb, '\\' );
+        strbuf_addc( sb, (char)str[i] );
+      }
+      else if ( str[i] < 0x20 || str[i] >= 0x7F )
+        strbuf_format( sb, "\\u%04x", str[i] );
+      else
+        strbuf_addc( sb, (char)str[i] );
+    }
+    strbuf_addc( sb, '"' );
+  }
+
+
+  /* Append UTF-16BE text as a JSON string; surrogates stay escaped. */
+  static void
+  Json_UTF16BE( StrBuf*         sb,
+                const FT_Byte*  str,
+                FT_UInt         len )
+  {
+    FT_UInt  i;
+
+
+    strbuf_addc( sb, '"' );
+    for ( i = 0; i + 1 < len; i += 2 )
+    {
+      FT_UInt  ch = (FT_UInt)str[i] << 8 | str[i + 1];
+
+
+      if ( ch == '"' || ch == '\\' )
+      {
+        strbuf_addc( sb, '\\' );
+        strbuf_addc( sb, (char)ch );
+      }
+      else if ( ch < 0x20 || ch >= 0x7F )
+        strbuf_format( sb, "\\u%04x", ch );
+      else
+        strbuf_addc( sb, (char)ch );
+    }
+    strbuf_addc( sb, '"' );
+  }
+
+
+  /* Append an SFNT name entry, using the same decoding as `-n'. */
+  static void
+  Json_Sfnt_Name( StrBuf*       sb,
+                  FT_SfntName*  name )
+  {
+    switch ( name->platform_id )
+    {
+    case TT_PLATFORM_APPLE_UNICODE:
+      if ( name->encoding_id <= TT_APPLE_ID_UNICODE_2_0 )
+      {
+        Json_UTF16BE( sb, name->string, name->string_len );
+        return;
+      }
+      break;
+
+    case TT_PLATFORM_MACINTOSH:
+      if ( name->encoding_id == TT_MAC_ID_ROMAN )
+      {
+        Json_Latin1( sb, name->string, name->string_len );
+        return;
+      }
+      break;
+
+    case TT_PLATFORM_ISO:
+      if ( name->encoding_id == TT_ISO_ID_10646 )
+      {
+        Json_UTF16BE( sb, name->string, name->string_len );
+        return;
+      }
+      if ( name->encoding_id == TT_ISO_ID_7BIT_ASCII ||
+           name->encoding_id == TT_ISO_ID_8859_1     )
+      {
+        Json_Latin1( sb, name->string, name->string_len );
+        return;
+      }
+      break;
+
+    case TT_PLATFORM_MICROSOFT:
+      if ( name->encoding_id == TT_MS_ID_SYMBOL_CS  ||
+           name->encoding_id == TT_MS_ID_UNICODE_CS )
+      {
+        Json_UTF16BE( sb, name->string, name->string_len );
+        return;
+      }
+      break;
+    }
+
+    strbuf_add( sb, "null" );
+  }
+
+
+  static void
+  Json_Tag( StrBuf*   sb,
+            FT_ULong  tag )
+  {
+    FT_Byte  buf[4];
+
+
+    buf[0] = (FT_Byte)( tag >> 24 );
+    buf[1] = (FT_Byte)( tag >> 16 );
+    buf[2] = (FT_Byte)( tag >>  8 );
+    buf[3] = (FT_Byte)( tag );
+
+    Json_Latin1( sb, buf, 4 );
+  }
+
+
+  static void
+  Json_Face( StrBuf*      sb,
+             const char*  fname,
+             FT_Face      face )
+  {
+    TT_Header*  head;
+    GlyfStats   stats;
+    FT_Int      i;
+
+
+    strbuf_add( sb, "{\"file\":" );
+    strbuf_add_json( sb, fname );
+    strbuf_format( sb, ",\"face\":%ld,\"num_faces\":%ld",
+                   face->face_index, face->num_faces );
+
+    strbuf_add( sb, ",\"family\":" );
+    strbuf_add_json( sb, face->family_name );
+    strbuf_add( sb, ",\"style\":" );
+    strbuf_add_json( sb, face->style_name );
+    strbuf_add( sb, ",\"postscript\":" );
+    strbuf_add_json( sb, FT_Get_Postscript_Name( face ) );
+    strbuf_add( sb, ",\"driver\":" );
+    strbuf_add_json( sb, FT_FACE_DRIVER_NAME( face ) );
+
+    strbuf_format( sb, ",\"sfnt\":%s,\"scalable\":%s,\"multiple_masters\":%s"
+                       ",\"fixed_width\":%s,\"glyph_names\":%s"
+                       ",\"horizontal\":%s,\"vertical\":%s",
+                   FT_IS_SFNT( face )              ? "true" : "false",
+                   FT_IS_SCALABLE( face )          ? "true" : "false",
+                   FT_HAS_MULTIPLE_MASTERS( face ) ? "true" : "false",
+                   FT_IS_FIXED_WIDTH( face )       ? "true" : "false",
+                   FT_HAS_GLYPH_NAMES( face )      ? "true" : "false",
+                   FT_HAS_HORIZONTAL( face )       ? "true" : "false",
+                   FT_HAS_VERTICAL( face )         ? "true" : "false" );
+
+    strbuf_format( sb, ",\"num_glyphs\":%ld", face->num_glyphs );
+
+    if ( FT_IS_SCALABLE( face ) )
+      strbuf_format( sb, ",\"units_per_EM\":%d,\"bbox\":[%ld,%ld,%ld,%ld]"
+                         ",\"ascender\":%d,\"descender\":%d,\"height\":%d"
+                         ",\"max_advance_width\":%d"
+                         ",\"max_advance_height\":%d"
+                         ",\"underline_position\":%d"
+                         ",\"underline_thickness\":%d",
+                     face->units_per_EM,
+                     face->bbox.xMin, face->bbox.yMin,
+                     face->bbox.xMax, face->bbox.yMax,
+                     face->ascender, face->descender, face->height,
+                     face->max_advance_width, face->max_advance_height,
+                     face->underline_position,
+                     face->underline_thickness );
+
+    head = (TT_Header*)FT_Get_Sfnt_Table( face, FT_SFNT_HEAD );
+    if ( head )
+    {
+      char  buf[11];
+
+
+      if ( Sfnt_Date( buf, head->Created ) )
+        strbuf_format( sb, ",\"created\":\"%s\"", buf );
+      if ( Sfnt_Date( buf, head->Modified ) )
+        strbuf_format( sb, ",\"modified\":\"%s\"", buf );
+      strbuf_format( sb, ",\"revision\":%.4f",
+                     head->Font_Revision / 65536.0 );
+    }
+
+    if ( FT_IS_SFNT( face ) && Count_Glyfs( face, &stats, 0 ) )
+      strbuf_format( sb, ",\"glyf\":{\"simple\":%d,\"simple_overlap\":%d"
+                         ",\"composite\":%d,\"composite_overlap\":%d"
+                         ",\"empty\":%d,\"invalid\":%d}",
+                     stats.simple, stats.simple_overlap,
+                     stats.composite, stats.composite_overlap,
+                     stats.empty, stats.invalid );
+
+    strbuf_add( sb, ",\"fixed_sizes\":[" );
+    for ( i = 0; i < face->num_fixed_sizes; i++ )
+    {
+      FT_Bitmap_Size*  bsize = face->available_sizes + i;
+
+
+      strbuf_format( sb, "%s{\"height\":%d,\"width\":%d,\"size\":%.3f"
+                         ",\"x_ppem\":%.3f,\"y_ppem\":%.3f}",
+                     i ? "," : "",
+                     bsize->height, bsize->width,
+                     bsize->size / 64.0,
+                     bsize->x_ppem / 64.0, bsize->y_ppem / 64.0 );
+    }
+
+    strbuf_add( sb, "],\"charmaps\":[" );
+    for ( i = 0; i < face->num_charmaps; i++ )
+    {
+      FT_CharMap  cmap    = face->charmaps[i];
+      FT_Long     format  = FT_Get_CMap_Format( cmap );
+      FT_ULong    lang_id = FT_Get_CMap_Language_ID( cmap );
+
+
+      strbuf_add( sb, i ? ",{\"encoding\":" : "{\"encoding\":" );
+      if ( cmap->encoding )
+        Json_Tag( sb, cmap->encoding );
+      else
+        strbuf_add( sb, "null" );
+      strbuf_format( sb, ",\"platform_id\":%u,\"encoding_id\":%u",
+                     cmap->platform_id, cmap->encoding_id );
+      if ( format >= 0 )
+        strbuf_format( sb, lang_id != 0xFFFFFFFFUL ? ",\"format\":%ld"
+                                                     ",\"language\":%lu"
+                                                   : ",\"format\":%ld",
+                       format, lang_id );
+      strbuf_addc( sb, '}' );
+    }
+    strbuf_addc( sb, ']' );
+
+    if ( tables && FT_IS_SFNT( face ) )
+    {
+      FT_ULong  num_tables, tag, length;
+      FT_UInt   n;
+
+
+      FT_Sfnt_Table_Info( face, 0, NULL, &num_tables );
+
+      strbuf_add( sb, ",\"tables\":[" );
+      for ( n = 0; n < num_tables; n++ )
+      {
+        FT_Sfnt_Table_Info( face, n, &tag, &length );
+
+        strbuf_add( sb, n ? ",{\"tag\":" : "{\"tag\":" );
+        Json_Tag( sb, tag );
+        strbuf_format( sb, ",\"length\":%lu}", length );
+      }
+      strbuf_addc( sb, ']' );
+    }
+
+    if ( name_tables && FT_IS_SFNT( face ) )
+    {
+      FT_SfntName  name;
+      FT_UInt      num_names, n;
+      int          count = 0;
+
+
+      num_names = FT_Get_Sfnt_Name_Count( face );
+
+      strbuf_add( sb, ",\"names\":[" );
+      for ( n = 0; n < num_names; n++ )
+      {
+        if ( FT_Get_Sfnt_Name( face, n, &name ) )
+          continue;
+
+        strbuf_format( sb, "%s{\"name_id\":%u,\"platform_id\":%u"
+                           ",\"encoding_id\":%u,\"language_id\":%u"
+                           ",\"value\":",
+                       count++ ? "," : "",
+                       name.name_id, name.platform_id,
+                       name.encoding_id, name.language_id );
+        Json_Sfnt_Name( sb, &name );
+        strbuf_addc( sb, '}' );
+      }
+      strbuf_addc( sb, ']' );
+    }
+
+    if ( FT_HAS_MULTIPLE_MASTERS( face ) )
+    {
+      FT_MM_Var*  mm;
+
+
+      if ( !FT_Get_MM_Var( face, &mm ) )
+      {
+        FT_UInt  n;
+
+
+        strbuf_add( sb, ",\"axes\":[" );
+        for ( n = 0; n < mm->num_axis; n++ )
+        {
+          strbuf_add( sb, n ? ",{\"tag\":" : "{\"tag\":" );
+          Json_Tag( sb, mm->axis[n].tag );
+          strbuf_add( sb, ",\"name\":" );
+          strbuf_add_json( sb, mm->axis[n].name );
+          strbuf_format( sb, ",\"minimum\":%g,\"default\":%g,\"maximum\":%g}",
+                         mm->axis[n].minimum / 65536.0,
+                         mm->axis[n].def / 65536.0,
+                         mm->axis[n].maximum / 65536.0 );
+        }
+        strbuf_format( sb, "],\"named_instances\":%u", mm->num_namedstyles );
+
+        FT_Done_MM_Var( face->glyph->library, mm );
+      }
+    }
+
+    strbuf_add( sb, "}\n" );
+  }
+
+
+  /* The output of one font file. */
+  typedef struct  Dump_
+  {
+    const char*  fname;
+    char*        text;
+    size_t       length;
+    size_t       size;
+    int          done;
+
+  } Dump;
+
+
+  static Dump*   dumps;
+  static size_t  num_dumps;
+  static size_t  max_dumps;
+
+
+  static void
+  Add_Dump( const char*  fname )
+  {
+    if ( num_dumps == max_dumps )
+    {
+      max_dumps = max_dumps ? 2 * max_dumps : 64;
+      dumps     = (Dump*)realloc( dumps, max_dumps * sizeof ( Dump ) );
+      if ( !dumps )
+      {
+        fprintf( stderr, "out of memory\n" );
+        exit( 1 );
+      }
+    }
+
+    memset( dumps + num_dumps, 0, sizeof ( Dump ) );
+    dumps[num_dumps++].fname = fname;
+  }
+
+
+#ifdef DUMP_THREADS
+
+  static int
+  Compare_Names( const void*  a,
+                 const void*  b )
+  {
+    return strcmp( *(char* const*)a, *(char* const*)b );
+  }
+
+
+  /* Queue a file, or all files below a directory in sorted order. */
+  static void
+  Add_Path( const char*  path )
+  {
+    struct stat     st;
+    DIR*            dir;
+    struct dirent*  entry;
+    char**          names     = NULL;
+    size_t          num_names = 0;
+    size_t          max_names = 0;
+    size_t          i;
+
+
+    if ( stat( path, &st ) || !S_ISDIR( st.st_mode ) )
+    {
+      Add_Dump( path );
+      return;
+    }
+
+    dir = opendir( path );
+    if ( !dir )
+    {
+      Add_Dump( path );
+      return;
+    }
+
+    while ( ( entry = readdir( dir ) ) != NULL )
+    {
+      size_t  len;
+
+
+      /* skip `.', `..', and hidden files */
+      if ( entry->d_name[0] == '.' )
         continue;
+
+      if ( num_names == max_names )
+      {
+        max_names = max_names ? 2 * max_names : 64;
+        names     = (char**)realloc( names, max_names * sizeof ( char* ) );
+        if ( !names )
+        {
+          fprintf( stderr, "out of memory\n" );
+          exit( 1 );
+        }
       }
 
-      flags = (FT_UInt16)buffer[loc];
+      len              = strlen( path ) + strlen( entry->d_name ) + 2;
+      names[num_names] = (char*)malloc( len );
+      if ( !names[num_names] )
+      {
+        fprintf( stderr, "out of memory\n" );
+        exit( 1 );
+      }
+      snprintf( names[num_names++], len, "%s/%s", path, entry->d_name );
+    }
+    closedir( dir );
+
+    qsort( names, num_names, sizeof ( char* ), Compare_Names );
+
+    /* the names are kept until exit */
+    for ( i = 0; i < num_names; i++ )
+      Add_Path( names[i] );
+
+    free( names );
+  }
+
+#else /* !DUMP_THREADS */
+
+  static void
+  Add_Path( const char*  path )
+  {
+    Add_Dump( path );
+  }
+
+#endif /* !DUMP_THREADS */
+
+
+  /* Render all faces of a font file into `dump->text'. */
+  static void
+  Dump_File( FT_Library  library,
+             Dump*       dump )
+  {
+    FT_Face   face;
+    FT_Long   i, num_faces = 1;
+    FT_Error  err;
+
+
+    for ( i = 0; i < num_faces; i++ )
+    {
+      StrBuf  sb;
+
 
-      simple_overlap += ( flags & 0x40 ) >> 6;
+      err = FT_New_Face( library, dump->fname, i, &face );
+      if ( !err )
+        num_faces = face->num_faces;
+
+      /* retry with a larger buffer until the line fits */
+      for (;;)
+      {
+        if ( dump->size - dump->length > 1 )
+        {
+          dump->text[dump->length] = '\0';
+          strbuf_init( &sb, dump->text + dump->length,
+                       dump->size - dump->length );
+
+          if ( err )
+          {
+            strbuf_add( &sb, "{\"file\":" );
+            strbuf_add_json( &sb, dump->fname );
+            strbuf_format( &sb, ",\"face\":%ld,\"error\":", i );
+            strbuf_add_json( &sb, Error_String( err ) );
+            strbuf_add( &sb, "}\n" );
+          }
+          else
+            Json_Face( &sb, dump->fname, face );
+
+          if ( strbuf_available( &sb ) )
+            break;
+        }
+
+        dump->size = dump->size ? 2 * dump->size : 4096;
+        dump->text = (char*)realloc( dump->text, dump->size );
+        if ( !dump->text )
+        {
+          fprintf( stderr, "out of memory\n" );
+          exit( 1 );
+        }
+      }
+
+      dump->length += strbuf_len( &sb );
+
+      if ( err )
+        break;
+
+      FT_Done_Face( face );
     }
+  }
 
-    printf( "%s%d", Name_Field( "   simple" ), simple );
-    printf( simple_overlap    ? ", with overlap flagged in %d\n"
-                              : "\n",
-            simple_overlap );
-    printf( "%s%d", Name_Field( "   composite" ), composite );
-    printf( composite_overlap ? ", with overlap flagged in %d\n"
-                              : "\n",
-            composite_overlap );
-    if ( empty )
-      printf( "%s%d\n", Name_Field( "   empty" ), empty );
 
-  Exit:
-    free( buffer );
-    free( offset );
+#ifdef DUMP_THREADS
+
+  static struct
+  {
+    size_t           next;
+    pthread_mutex_t  lock;
+    pthread_cond_t   done;
+
+  } pool = { 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+
+  static void*
+  Worker( void*  arg )
+  {
+    FT_Library  library = NULL;
+
+
+    FT_UNUSED( arg );
+
+    /* FreeType objects must not be shared between threads; */
+    /* without a library, every file gets an error line      */
+    (void)FT_Init_FreeType( &library );
+
+    for (;;)
+    {
+      Dump*  dump;
+
+
+      pthread_mutex_lock( &pool.lock );
+      dump = pool.next < num_dumps ? dumps + pool.next++ : NULL;
+      pthread_mutex_unlock( &pool.lock );
+
+      if ( !dump )
+        break;
+
+      Dump_File( library, dump );
+
+      pthread_mutex_lock( &pool.lock );
+      dump->done = 1;
+      pthread_cond_broadcast( &pool.done );
+      pthread_mutex_unlock( &pool.lock );
+    }
+
+    FT_Done_FreeType( library );
+
+    return NULL;
+  }
+
+#endif /* DUMP_THREADS */
+
+
+  /* Dump all queued files, printing them in the order of the queue. */
+  static void
+  Run_Dumps( FT_Library  library,
+             int         jobs )
+  {
+    size_t  i;
+
+#ifdef DUMP_THREADS
+    pthread_t*  threads = NULL;
+    int         n       = 0;
+
+
+    if ( jobs > 1 )
+    {
+      threads = (pthread_t*)malloc( (size_t)jobs * sizeof ( pthread_t ) );
+      if ( !threads )
+        jobs = 1;
+    }
+
+    if ( jobs > 1 )
+      for ( n = 0; n < jobs; n++ )
+        if ( pthread_create( &threads[n], NULL, Worker, NULL ) )
+          break;
+
+    /* fall back to serial mode if no thread could be started */
+    if ( n > 0 )
+    {
+      for ( i = 0; i < num_dumps; i++ )
+      {
+        pthread_mutex_lock( &pool.lock );
+        while ( !dumps[i].done )
+          pthread_cond_wait( &pool.done, &pool.lock );
+        pthread_mutex_unlock( &pool.lock );
+
+        fwrite( dumps[i].text, 1, dumps[i].length, stdout );
+        free( dumps[i].text );
+      }
+
+      while ( n-- )
+        pthread_join( threads[n], NULL );
+
+      free( threads );
+      return;
+    }
+
+    free( threads );
+#else
+    FT_UNUSED( jobs );
+#endif
+
+    for ( i = 0; i < num_dumps; i++ )
+    {
+      Dump_File( library, dumps + i );
+
+      fwrite( dumps[i].text, 1, dumps[i].length, stdout );
+      free( dumps[i].text );
+    }
   }
 
 
@@ -1410,6 +2216,7 @@
     char   filename[1024];
     int    num_faces;
     int    option;
+    int    jobs = 1;
 
     FT_Library  library;      /* the FreeType library */
     FT_Face     face;         /* the font face        */
@@ -1424,7 +2231,7 @@
 
     while ( 1 )
     {
-      option = getopt( argc, argv, "Ccnptuv" );
+      option = getopt( argc, argv, "CcJj:nptuv" );
 
       if ( option == -1 )
         break;
@@ -1439,6 +2246,16 @@
         coverage = 1;
         break;
 
+      case 'J':
+        json = 1;
+        break;
+
+      case 'j':
+        jobs = atoi( optarg );
+        if ( jobs < 1 )
+          jobs = 1;
+        break;
+
       case 'n':
         name_tables = 1;
         break;
@@ -1479,6 +2296,21 @@
     argc -= optind;
     argv += optind;
 
+    if ( json )
+    {
+      if ( argc < 1 )
+        usage( library, execname );
+
+      for ( file = 0; file < argc; file++ )
+        Add_Path( argv[file] );
+
+      Run_Dumps( library, jobs );
+      free( dumps );
+
+      FT_Done_FreeType( library );
+      exit( 0 );
+    }
+
     if ( argc != 1 )
       usage( library, execname );
 
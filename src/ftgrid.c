@@ -885,7 +885,7 @@
     grWriteln( "                                          F3, F4    adjust current axis by  " );
     grWriteln( "F5, F6      cycle through                            1/50 of its range      " );
     grWriteln( "             anti-aliasing modes                                            " );
-    grWriteln( "L           cycle through LCD           P           print PNG file          " );
+    grWriteln( "L           cycle through LCD           P           print image file        " );
     grWriteln( "             filters                    q, ESC      quit ftgrid             " );
     grLn();
     grWriteln( "g, v        adjust gamma value" );
@@ -1380,7 +1380,7 @@
 
 
         FTDemo_Version( handle, str );
-        FTDemo_Display_Print( display, "ftgrid.png", str );
+        FTDemo_Display_Snapshot( display, "ftgrid", str );
       }
       break;
 
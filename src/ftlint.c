@@ -17,10 +17,13 @@
 #include <freetype/freetype.h>
 #include <freetype/ftoutln.h>
 #include <freetype/ftbitmap.h>
+#include <freetype/ftsizes.h>
 
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
 #include <limits.h>
 
 #include "common.h"
@@ -32,16 +35,103 @@
 #include "mlgetopt.h"
 #endif
 
+#ifndef _WIN32
+#define LINT_THREADS
+#include <pthread.h>
+#endif
+
+
+  /* glyphs per unit of work in parallel mode */
+#define CHUNK_SIZE  64
+
+#define MAX_SIZES  256
+
+  /* values of a face's `changed' count without a comparison */
+#define CHANGED_UNKNOWN  -1  /* no database */
+#define CHANGED_NEW      -2  /* face not yet in the database */
+
 
-  static FT_Error        error;
-  static FT_Library      library;
-  static FT_Face         face;
   static FT_Render_Mode  render_mode = FT_RENDER_MODE_NORMAL;
   static FT_Int32        load_flags  = FT_LOAD_DEFAULT;
 
-  static int           ptsize;
+  static int           sizes[MAX_SIZES];  /* ppem values */
+  static int           num_sizes;
+  static int           sweep;              /* ppem list given with `-s' */
+  static int           quiet;
+  static int           fast_hash;
+
+
+  /* output goes directly to a file or is collected in a buffer */
+  typedef struct  Output_
+  {
+    FILE*   file;
+    char*   buffer;
+    size_t  length;
+    size_t  size;
+
+  } Output;
+
+
+  /* Golden-hash database record: the glyph checksums of a face range */
+  /* rendered with the given settings; the font file is identified by */
+  /* its checksum, not its name.                                      */
+  typedef struct  Record_
+  {
+    unsigned char   font[16];
+    unsigned long   face_index;
+    unsigned long   ptsize;
+    unsigned long   load_flags;
+    unsigned long   render_mode;
+    unsigned long   first;
+    unsigned long   last;
+    unsigned long   hash;      /* 1 for the fast hash, 0 for MD5 */
+
+    unsigned char*  digests;   /* 16 bytes per glyph */
+    int             replaced;  /* superseded in this run */
+
+  } Record;
+
 
-  static int  Fail;
+  static struct
+  {
+    const char*  name;
+    int          same_version;  /* written by this FreeType version */
+
+    Record*      old;           /* sorted for `bsearch' */
+    size_t       num_old;
+    Record*      added;
+    size_t       num_added;
+    size_t       max_added;
+
+  } db;
+
+
+  /* parallel mode splits the work into chunks of a face's glyph range; */
+  /* the first chunk of a face also carries the preceding headers       */
+  typedef struct  Chunk_
+  {
+    const char*           fname;
+    FT_Long               face_index;
+    int                   ptsize;
+    unsigned int          first;
+    unsigned int          last;
+    int                   summary;  /* print the face's summary afterwards */
+
+    const unsigned char*  golden;   /* checksums of glyph `first' and up   */
+    unsigned char*        digests;
+    int                   compare;  /* 0 or CHANGED_XXX                    */
+
+    unsigned char*        face_digests;  /* set in the summary chunk */
+    unsigned int          face_glyphs;
+    int                   free_digests;
+
+    Output                head;     /* written by the main thread */
+    Output                body;     /* written by a worker thread */
+    int                   fails;
+    int                   changed;
+    int                   done;
+
+  } Chunk;
 
 
   /* error messages */
@@ -52,7 +142,72 @@
 
 
   static void
-  Error( const FT_String  *msg )
+  Print( Output*      out,
+         const char*  fmt,
+         ... )
+  {
+    va_list  ap;
+    int      n;
+
+
+    if ( out->file )
+    {
+      va_start( ap, fmt );
+      vfprintf( out->file, fmt, ap );
+      va_end( ap );
+
+      return;
+    }
+
+    for (;;)
+    {
+      size_t  available = out->size - out->length;
+      size_t  size;
+      char*   p;
+
+
+      n = 0;
+      if ( available )
+      {
+        va_start( ap, fmt );
+        n = vsnprintf( out->buffer + out->length, available, fmt, ap );
+        va_end( ap );
+
+        /* NOTE: On Windows, vsnprintf() returns -1 in case of truncation! */
+        if ( n >= 0 && (size_t)n < available )
+        {
+          out->length += (size_t)n;
+          return;
+        }
+      }
+
+      size = 2 * out->size + ( n > 0 ? (size_t)n : 0 ) + 1024;
+      p    = (char*)realloc( out->buffer, size );
+      if ( !p )
+        return;
+
+      out->buffer = p;
+      out->size   = size;
+    }
+  }
+
+
+  static void
+  Flush( Output*  out )
+  {
+    if ( out->length )
+      fwrite( out->buffer, 1, out->length, stdout );
+
+    free( out->buffer );
+    out->buffer = NULL;
+    out->length = out->size = 0;
+  }
+
+
+  static void
+  Error( Output*           out,
+         const FT_String  *msg,
+         FT_Error          error )
   {
     const FT_String  *str;
 
@@ -60,7 +215,7 @@
     switch( error )
     #include <freetype/fterrors.h>
 
-    printf( "%serror = 0x%04x, %s\n", msg, error, str );
+    Print( out, "%serror = 0x%04x, %s\n", msg, error, str );
   }
 
 
@@ -72,14 +227,23 @@
       "ftlint: simple font tester -- part of the FreeType project\n"
       "----------------------------------------------------------\n"
       "\n"
-      "Usage: %s [options] ppem fontname [fontname2..]\n",
-             name );
+      "Usage: %s [options] ppem fontname [fontname2..]\n"
+      "       %s [options] -s list fontname [fontname2..]\n",
+             name, name );
     fprintf( stderr,
       "\n"
       "  -f L    Use hex number L as load flags (see `FT_LOAD_XXX')\n"
       "  -r N    Set render mode to N\n"
       "  -i I-J  Range of glyph indices to use (default: all)\n"
+      "  -s L    Check the ppem values of comma-separated list L,\n"
+      "          whose items can be ranges with step, e.g., `8-72:2,96'\n"
       "  -q      Quiet mode without the rendering analysis\n"
+      "  -x      Use a fast 128-bit hash instead of MD5 for checksums\n"
+      "  -d F    Compare glyph checksums with database F and update it;\n"
+      "          only changed glyphs are shown, unchanged fonts skipped\n"
+#ifdef LINT_THREADS
+      "  -j N    Use N threads (default: 1)\n"
+#endif
       "\n" );
 
     exit( 1 );
@@ -87,7 +251,8 @@
 
 
   static void
-  Examine( FT_GlyphSlot  slot )
+  Examine( Output*       out,
+           FT_GlyphSlot  slot )
   {
     unsigned long  format = slot->format;
     FT_Outline*    outline = &slot->outline;
@@ -99,12 +264,11 @@
 
     if ( format != FT_GLYPH_FORMAT_OUTLINE )
     {
-      putchar( ' ' );
-      putchar( ( format >> 24 ) & 0xFF );
-      putchar( ( format >> 16 ) & 0xFF );
-      putchar( ( format >>  8 ) & 0xFF );
-      putchar( ( format       ) & 0xFF );
-      putchar( ' ' );
+      Print( out, " %c%c%c%c ",
+                  (int)( ( format >> 24 ) & 0xFF ),
+                  (int)( ( format >> 16 ) & 0xFF ),
+                  (int)( ( format >>  8 ) & 0xFF ),
+                  (int)( ( format       ) & 0xFF ) );
       return;
     }
 
@@ -130,89 +294,1089 @@
     if ( taxi )
     {
       FT_Outline_Get_CBox( outline, &cbox );
-      printf( "%5.2f ", 0.5 * taxi /
-                        ( cbox.xMax - cbox.xMin + cbox.yMax - cbox.yMin ) );
+      Print( out, "%5.2f ", 0.5 * taxi /
+                            ( cbox.xMax - cbox.xMin + cbox.yMax - cbox.yMin ) );
     }
     else
-      printf( " void " );
+      Print( out, " void " );
   }
 
 
-  /* Analyze X- and Y-acutance; bitmap should have positive pitch */
+  /* The acutance is the ratio of the sums of absolute second and first */
+  /* differences of the pixel values, padded with zeros at both ends.   */
+  /* The inner loops are free of branches and loop-carried state so    */
+  /* that compilers can vectorize them (e.g., `gcc -O3', `clang -O2').  */
+
+#define PIXEL( v, j, w )  ( (j) >= 0 && (j) < (w) ? (int)(v)[j] : 0 )
+#define ABS( d )          (unsigned int)( (d) >= 0 ? (d) : -(d) )
+
+
+  /* differences along a row `v' of width `w' */
   static void
-  Analyze( FT_Bitmap* bitmap )
+  Row_Sums( const unsigned char*  v,
+            int                   w,
+            unsigned long*        s1,
+            unsigned long*        s2 )
   {
-    unsigned int   i, j;
-    unsigned char  *b;
-    unsigned long  s1, s2;
-    long           d0, d1;
+    unsigned int  t1 = 0, t2 = 0;
+    int           j, d;
 
 
-    /* X-acutance */
-    for ( b = bitmap->buffer, s1 = s2 = 0, i = 0; i < bitmap->rows; i++ )
+    for ( j = 2; j < w; j++ )
     {
-      for ( d0 = d1 = 0, j = 0; j < bitmap->width; j++, b++ )
-      {
-        d1 -= *b;
-        /* second derivative sum */
-        s2 += (unsigned long)( d1 >= d0 ? d1 - d0 : d0 - d1 );
-        /*  first derivative sum */
-        s1 += (unsigned long)( d1 >= 0 ? d1 : -d1 );
-        d0  = d1;
-        d1  = *b;
-      }
-      s2 += (unsigned long)( d1 > d0 ? d1 - d0 : d0 - d1 );
-      s2 += (unsigned long)d1;
-      s1 += (unsigned long)d1;
+      t1 += ABS( v[j - 1] - v[j] );
+      t2 += ABS( v[j - 2] - 2 * v[j - 1] + v[j] );
+    }
+    if ( w > 1 )
+      t1 += ABS( v[0] - v[1] );
+
+    /* the padded ends */
+    t1 += (unsigned int)( PIXEL( v, 0, w ) + PIXEL( v, w - 1, w ) );
+
+    for ( j = 0; j < 2; j++ )
+    {
+      d   = PIXEL( v, j - 2, w ) - 2 * PIXEL( v, j - 1, w ) + PIXEL( v, j, w );
+      t2 += ABS( d );
+    }
+    for ( j = w > 2 ? w : 2; j < w + 2; j++ )
+    {
+      d   = PIXEL( v, j - 2, w ) - 2 * PIXEL( v, j - 1, w );
+      t2 += ABS( d );
+    }
+
+    *s1 += t1;
+    *s2 += t2;
+  }
+
+
+  /* differences across rows `r0', `r1', and `r2' of width `w' */
+  static void
+  Column_Sums( const unsigned char*  r0,
+               const unsigned char*  r1,
+               const unsigned char*  r2,
+               int                   w,
+               unsigned long*        s1,
+               unsigned long*        s2 )
+  {
+    unsigned int  t1 = 0, t2 = 0;
+    int           j;
+
+
+    for ( j = 0; j < w; j++ )
+    {
+      t1 += ABS( r1[j] - r2[j] );
+      t2 += ABS( r0[j] - 2 * r1[j] + r2[j] );
+    }
+
+    *s1 += t1;
+    *s2 += t2;
+  }
+
+
+  /* Analyze X- and Y-acutance in a single pass over the rows; */
+  /* bitmap should have positive pitch                         */
+  static void
+  Analyze( Output*     out,
+           FT_Bitmap*  bitmap )
+  {
+    int             rows  = (int)bitmap->rows;
+    int             width = (int)bitmap->width;
+    unsigned char*  zero;
+    unsigned long   x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+    int             i;
+
+
+    /* a blank row pads the columns at both ends */
+    zero = (unsigned char*)calloc( (size_t)width + 1, 1 );
+    if ( !zero )
+      Panic( "out of memory\n" );
+
+#define ROW( i )  ( (i) >= 0 && (i) < rows                           \
+                      ? bitmap->buffer + (i) * bitmap->pitch : zero )
+
+    for ( i = 0; i < rows + 2; i++ )
+    {
+      if ( i < rows )
+        Row_Sums( ROW( i ), width, &x1, &x2 );
+
+      Column_Sums( ROW( i - 2 ), ROW( i - 1 ), ROW( i ), width, &y1, &y2 );
+    }
+
+#undef ROW
+
+    free( zero );
+
+    if ( x1 )
+      Print( out, "%.4lf ", (double)x2 / x1 );
+    else
+      Print( out, "  void " );
+
+    if ( y1 )
+      Print( out, "%.4lf ", (double)y2 / y1 );
+    else
+      Print( out, "  void " );
+  }
+
+
+  /* A non-cryptographic 128-bit hash in the spirit of xxHash64: */
+  /* four 64-bit lanes are fed with 32-byte stripes and folded   */
+  /* into two halves with a final avalanche.                     */
+
+#define PRIME1  0x9E3779B185EBCA87ULL
+#define PRIME2  0xC2B2AE3D27D4EB4FULL
+#define PRIME3  0x165667B19E3779F9ULL
+
+#define ROTL( x, r )  ( ( (x) << (r) ) | ( (x) >> ( 64 - (r) ) ) )
+
+  typedef unsigned long long  UInt64;
+
+
+  static UInt64
+  Read64( const unsigned char*  p )
+  {
+    return   (UInt64)p[0]         | ( (UInt64)p[1] <<  8 ) |
+           ( (UInt64)p[2] << 16 ) | ( (UInt64)p[3] << 24 ) |
+           ( (UInt64)p[4] << 32 ) | ( (UInt64)p[5] << 40 ) |
+           ( (UInt64)p[6] << 48 ) | ( (UInt64)p[7] << 56 );
+  }
+
+
+  static UInt64
+  Round( UInt64  acc,
+         UInt64  input )
+  {
+    acc += input * PRIME2;
+    acc  = ROTL( acc, 31 );
+
+    return acc * PRIME1;
+  }
+
+
+  static UInt64
+  Avalanche( UInt64  h )
+  {
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+
+    return h;
+  }
+
+
+  static void
+  Fast_Hash( const unsigned char*  p,
+             unsigned long         size,
+             unsigned char*        digest )
+  {
+    UInt64  v1 = PRIME1 + PRIME2;
+    UInt64  v2 = PRIME2;
+    UInt64  v3 = 0;
+    UInt64  v4 = 0 - PRIME1;
+    UInt64  h1, h2;
+    int     i;
+
+
+    for ( ; size >= 32; size -= 32, p += 32 )
+    {
+      v1 = Round( v1, Read64( p      ) );
+      v2 = Round( v2, Read64( p +  8 ) );
+      v3 = Round( v3, Read64( p + 16 ) );
+      v4 = Round( v4, Read64( p + 24 ) );
+    }
+
+    h1 = ROTL( v1, 1 ) + ROTL( v3, 12 );
+    h2 = ROTL( v2, 7 ) + ROTL( v4, 18 );
+
+    for ( ; size >= 8; size -= 8, p += 8 )
+    {
+      h1 ^= Round( 0, Read64( p ) );
+      h1  = ROTL( h1, 27 ) * PRIME1 + h2;
+      h2  = ROTL( h2, 29 ) ^ h1;
+    }
+
+    for ( ; size; size--, p++ )
+    {
+      h1 ^= *p * PRIME3;
+      h1  = ROTL( h1, 11 ) * PRIME1;
+    }
+
+    h1 = Avalanche( h1 ^ ( v1 + v2 + v3 + v4 ) );
+    h2 = Avalanche( h2 + h1 );
+
+    for ( i = 0; i < 8; i++ )
+    {
+      digest[i]     = (unsigned char)( h1 >> ( 56 - 8 * i ) );
+      digest[i + 8] = (unsigned char)( h2 >> ( 56 - 8 * i ) );
     }
+  }
+
 
-    if ( s1 )
-      printf( "%.4lf ", (double)s2 / s1 );
+  static void
+  Hash( const void*     data,
+        unsigned long   size,
+        unsigned char*  digest )
+  {
+    if ( fast_hash )
+      Fast_Hash( (const unsigned char*)data, size, digest );
     else
-      printf( "  void " );
+    {
+      MD5_CTX  ctx;
+
+
+      MD5_Init( &ctx );
+      if ( data )
+        MD5_Update( &ctx, data, size );
+      MD5_Final( digest, &ctx );
+    }
+  }
+
+
+  /* Calculate glyph checksum; bitmap should have positive pitch */
+  static void
+  Checksum( Output*         out,
+            FT_Bitmap*      bitmap,
+            unsigned char*  digest )
+  {
+    unsigned char  buffer[16];
+    int            i;
+
+
+    if ( !digest )
+      digest = buffer;
+
+    Hash( bitmap->buffer,
+          bitmap->buffer ? (unsigned long)bitmap->rows *
+                             (unsigned long)bitmap->pitch
+                         : 0,
+          digest );
+
+    for ( i = 0; i < 16; i++ )
+       Print( out, "%02X", digest[i] );
+  }
+
+
+  /* The database file starts with a magic string, the FreeType version */
+  /* and the number of records; each record consists of its key fields  */
+  /* followed by the glyph checksums.  Numbers are 32-bit big-endian.   */
+
+#define DB_MAGIC  "FTLINT\0\2"
+
+
+  static void
+  DB_Put( FILE*          fp,
+          unsigned long  value )
+  {
+    putc( (int)( ( value >> 24 ) & 0xFF ), fp );
+    putc( (int)( ( value >> 16 ) & 0xFF ), fp );
+    putc( (int)( ( value >>  8 ) & 0xFF ), fp );
+    putc( (int)(   value         & 0xFF ), fp );
+  }
+
+
+  static unsigned long
+  DB_Get( FILE*  fp )
+  {
+    unsigned char  b[4];
+
+
+    if ( fread( b, 1, 4, fp ) != 4 )
+      return 0;
+
+    return ( (unsigned long)b[0] << 24 ) | ( (unsigned long)b[1] << 16 ) |
+           ( (unsigned long)b[2] <<  8 ) |   (unsigned long)b[3];
+  }
+
+
+  static int
+  DB_Compare( const void*  a_,
+              const void*  b_ )
+  {
+    const Record*  a = (const Record*)a_;
+    const Record*  b = (const Record*)b_;
+    int            r = memcmp( a->font, b->font, 16 );
+
+
+#define CMP( f )  if ( a->f != b->f ) return a->f < b->f ? -1 : 1
+
+    if ( r )
+      return r;
+
+    CMP( face_index );
+    CMP( ptsize );
+    CMP( load_flags );
+    CMP( render_mode );
+    CMP( first );
+    CMP( last );
+    CMP( hash );
+
+#undef CMP
+
+    return 0;
+  }
+
+
+  static void
+  DB_Load( FT_Library   library,
+           const char*  name )
+  {
+    FILE*          fp;
+    char           magic[8];
+    FT_Int         major, minor, patch;
+    unsigned long  v[3];
+    unsigned long  i, n;
+
+
+    db.name = name;
+
+    FT_Library_Version( library, &major, &minor, &patch );
+
+    fp = fopen( name, "rb" );
+    if ( !fp )
+      return;  /* start a new database */
+
+    if ( fread( magic, 1, 8, fp ) != 8 || memcmp( magic, DB_MAGIC, 8 ) )
+      goto Bad;
+
+    v[0] = DB_Get( fp );
+    v[1] = DB_Get( fp );
+    v[2] = DB_Get( fp );
+    n    = DB_Get( fp );
+
+    db.same_version = v[0] == (unsigned long)major &&
+                      v[1] == (unsigned long)minor &&
+                      v[2] == (unsigned long)patch;
 
-    /* Y-acutance */
-    for ( s1 = s2 = 0, j = 0; j < bitmap->width; j++ )
+    db.old = (Record*)calloc( n ? n : 1, sizeof ( Record ) );
+    if ( !db.old )
+      goto Bad;
+
+    for ( i = 0; i < n; i++ )
+    {
+      Record*  r = db.old + i;
+      size_t   size;
+
+
+      if ( fread( r->font, 1, 16, fp ) != 16 )
+        goto Bad;
+
+      r->face_index  = DB_Get( fp );
+      r->ptsize      = DB_Get( fp );
+      r->load_flags  = DB_Get( fp );
+      r->render_mode = DB_Get( fp );
+      r->first       = DB_Get( fp );
+      r->last        = DB_Get( fp );
+      r->hash        = DB_Get( fp );
+
+      if ( r->last < r->first || r->last - r->first >= 0x10000UL )
+        goto Bad;
+
+      size       = 16 * (size_t)( r->last - r->first + 1 );
+      r->digests = (unsigned char*)malloc( size );
+      if ( !r->digests || fread( r->digests, 1, size, fp ) != size )
+        goto Bad;
+
+      db.num_old++;
+    }
+
+    fclose( fp );
+
+    qsort( db.old, db.num_old, sizeof ( Record ), DB_Compare );
+    return;
+
+  Bad:
+    fprintf( stderr, "%s: invalid database, starting a new one\n", name );
+    fclose( fp );
+
+    for ( i = 0; i < db.num_old; i++ )
+      free( db.old[i].digests );
+    free( db.old );
+
+    db.old          = NULL;
+    db.num_old      = 0;
+    db.same_version = 0;
+  }
+
+
+  /* write the records of this run and all old records not superseded */
+  static void
+  DB_Save( FT_Library  library )
+  {
+    FILE*          fp;
+    FT_Int         major, minor, patch;
+    unsigned long  count;
+    size_t         i;
+    int            pass;
+
+
+    fp = fopen( db.name, "wb" );
+    if ( !fp )
+    {
+      fprintf( stderr, "%s: could not write database\n", db.name );
+      return;
+    }
+
+    FT_Library_Version( library, &major, &minor, &patch );
+
+    /* copies of a font file produce identical records */
+    qsort( db.added, db.num_added, sizeof ( Record ), DB_Compare );
+    for ( i = 1; i < db.num_added; i++ )
+      if ( !DB_Compare( db.added + i - 1, db.added + i ) )
+        db.added[i].replaced = 1;
+
+    count = 0;
+    for ( i = 0; i < db.num_added; i++ )
+      if ( !db.added[i].replaced )
+        count++;
+    for ( i = 0; i < db.num_old; i++ )
+      if ( !db.old[i].replaced )
+        count++;
+
+    fwrite( DB_MAGIC, 1, 8, fp );
+    DB_Put( fp, (unsigned long)major );
+    DB_Put( fp, (unsigned long)minor );
+    DB_Put( fp, (unsigned long)patch );
+    DB_Put( fp, count );
+
+    for ( pass = 0; pass < 2; pass++ )
     {
-      b = bitmap->buffer + j;
-      for ( d0 = d1 = 0, i = 0; i < bitmap->rows; i++, b += bitmap->pitch )
+      Record*  records = pass ? db.old     : db.added;
+      size_t   num     = pass ? db.num_old : db.num_added;
+
+
+      for ( i = 0; i < num; i++ )
       {
-        d1 -= *b;
-        /* second derivative sum */
-        s2 += (unsigned long)( d1 >= d0 ? d1 - d0 : d0 - d1 );
-        /*  first derivative sum */
-        s1 += (unsigned long)( d1 >= 0 ? d1 : -d1 );
-        d0  = d1;
-        d1  = *b;
+        Record*  r = records + i;
+
+
+        if ( r->replaced )
+          continue;
+
+        fwrite( r->font, 1, 16, fp );
+        DB_Put( fp, r->face_index );
+        DB_Put( fp, r->ptsize );
+        DB_Put( fp, r->load_flags );
+        DB_Put( fp, r->render_mode );
+        DB_Put( fp, r->first );
+        DB_Put( fp, r->last );
+        DB_Put( fp, r->hash );
+        fwrite( r->digests, 16, (size_t)( r->last - r->first + 1 ), fp );
       }
-      s2 += (unsigned long)( d1 > d0 ? d1 - d0 : d0 - d1 );
-      s2 += (unsigned long)d1;
-      s1 += (unsigned long)d1;
     }
 
-    if ( s1 )
-      printf( "%.4lf ", (double)s2 / s1 );
-    else
-      printf( "  void " );
+    if ( fclose( fp ) )
+      fprintf( stderr, "%s: could not write database\n", db.name );
   }
 
 
-  /* Calculate MD5 checksum; bitmap should have positive pitch */
   static void
-  Checksum( FT_Bitmap* bitmap )
+  DB_Key( Record*               key,
+          const unsigned char*  font,
+          FT_Long               face_index,
+          int                   ptsize,
+          unsigned int          first,
+          unsigned int          last )
   {
+    memset( key, 0, sizeof ( Record ) );
+
+    memcpy( key->font, font, 16 );
+    key->face_index  = (unsigned long)face_index;
+    key->ptsize      = (unsigned long)ptsize;
+    key->load_flags  = (unsigned long)load_flags;
+    key->render_mode = (unsigned long)render_mode;
+    key->first       = first;
+    key->last        = last;
+    key->hash        = (unsigned long)fast_hash;
+  }
+
+
+  static Record*
+  DB_Find( const Record*  key )
+  {
+    if ( !db.num_old )
+      return NULL;
+
+    return (Record*)bsearch( key, db.old, db.num_old,
+                             sizeof ( Record ), DB_Compare );
+  }
+
+
+  /* add a record for this run with zeroed checksums */
+  static Record*
+  DB_Add( const Record*  key )
+  {
+    Record*  r;
+
+
+    if ( db.num_added == db.max_added )
+    {
+      size_t  max = db.max_added ? 2 * db.max_added : 256;
+
+
+      r = (Record*)realloc( db.added, max * sizeof ( Record ) );
+      if ( !r )
+        Panic( "out of memory\n" );
+
+      db.added     = r;
+      db.max_added = max;
+    }
+
+    r  = db.added + db.num_added++;
+    *r = *key;
+
+    r->digests = (unsigned char*)calloc( r->last - r->first + 1, 16 );
+    if ( !r->digests )
+      Panic( "out of memory\n" );
+
+    return r;
+  }
+
+
+  /* identify a font file by its contents */
+  static int
+  Hash_File( const char*     fname,
+             unsigned char*  md5 )
+  {
+    FILE*          fp;
     MD5_CTX        ctx;
-    unsigned char  md5[16];
-    int            i;
+    unsigned char  buffer[16384];
+    size_t         n;
+
+
+    fp = fopen( fname, "rb" );
+    if ( !fp )
+      return 0;
 
     MD5_Init( &ctx );
-    if ( bitmap->buffer )
-      MD5_Update( &ctx, bitmap->buffer,
-                  (unsigned long)bitmap->rows * (unsigned long)bitmap->pitch );
+    while ( ( n = fread( buffer, 1, sizeof ( buffer ), fp ) ) > 0 )
+      MD5_Update( &ctx, buffer, (unsigned long)n );
     MD5_Final( md5, &ctx );
 
-    for ( i = 0; i < 16; i++ )
-       printf( "%02X", md5[i] );
+    fclose( fp );
+
+    return 1;
+  }
+
+
+  /* Load, render and analyze glyphs `first' to `last'; return fails.   */
+  /* If `digests' is set, the checksums are stored there.  If `changed'  */
+  /* is set, only glyphs whose checksums differ from `golden' are shown, */
+  /* and counted.                                                        */
+  static int
+  Lint_Glyphs( FT_Library            library,
+               FT_Face               face,
+               unsigned int          first,
+               unsigned int          last,
+               const unsigned char*  golden,
+               unsigned char*        digests,
+               int*                  changed,
+               Output*               out )
+  {
+    FT_Error      error;
+    unsigned int  id;
+    int           fails = 0;
+    Output        line  = { NULL, NULL, 0, 0 };
+    Output*       dest  = changed ? &line : out;
+
+
+    for ( id = first; id <= last; id++ )
+    {
+      FT_Bitmap  bitmap;
+
+
+      line.length = 0;
+
+      error = FT_Load_Glyph( face, id, load_flags );
+      if ( error )
+      {
+        if ( !quiet )
+        {
+          Print( dest, "%5u ", id );
+          Error( dest, "loading ", error );
+        }
+        fails++;
+        goto Next;
+      }
+
+      if ( quiet )
+        continue;
+
+      Print( dest, "%5u ", id );
+
+      Examine( dest, face->glyph );
+
+      error = FT_Render_Glyph( face->glyph, render_mode );
+      if ( error && face->glyph->format != FT_GLYPH_FORMAT_BITMAP )
+      {
+        Error( dest, "rendering ", error );
+        fails++;
+        goto Next;
+      }
+
+      FT_Bitmap_Init( &bitmap );
+
+      /* convert to an 8-bit bitmap with a positive pitch */
+      error = FT_Bitmap_Convert( library, &face->glyph->bitmap, &bitmap, 1 );
+      if ( error )
+      {
+        Error( dest, "converting ", error );
+        goto Next;
+      }
+      else
+        Print( dest, "%3ux%-4u ", bitmap.width, bitmap.rows );
+
+      Analyze( dest, &bitmap );
+      Checksum( dest, &bitmap,
+                digests ? digests + 16 * ( id - first ) : NULL );
+
+      FT_Bitmap_Done( library, &bitmap );
+
+      Print( dest, "\n" );
+
+    Next:
+      /* failed glyphs keep a zero checksum */
+      if ( golden                                      &&
+           memcmp( golden  + 16 * ( id - first ),
+                   digests + 16 * ( id - first ), 16 ) )
+      {
+        (*changed)++;
+        if ( line.length )
+          Print( out, "%s", line.buffer );
+      }
+    }
+
+    free( line.buffer );
+
+    return fails;
+  }
+
+
+  /* print the fail count and the checksum of all glyph checksums */
+  static void
+  Summary( Output*               out,
+           int                   fails,
+           int                   changed,
+           const unsigned char*  digests,
+           unsigned int          count )
+  {
+    if ( digests )
+    {
+      unsigned char  digest[16];
+      int            i;
+
+
+      Hash( digests, 16 * (unsigned long)count, digest );
+
+      Print( out, "  face hashsum " );
+      for ( i = 0; i < 16; i++ )
+        Print( out, "%02X", digest[i] );
+      Print( out, "\n" );
+    }
+
+    if ( fails == 0 )
+      Print( out, "  OK" );
+    else if ( fails == 1 )
+      Print( out, "  1 fail" );
+    else
+      Print( out, "  %d fails", fails );
+
+    if ( changed == CHANGED_NEW )
+      Print( out, ", new" );
+    else if ( changed >= 0 )
+      Print( out, ", %d changed", changed );
+
+    Print( out, ".\n" );
+  }
+
+
+#ifdef LINT_THREADS
+
+  /* The chunks are handed out in order to the first idle thread; */
+  /* the main thread prints them in the same order as they finish. */
+  static struct
+  {
+    Chunk*           chunks;
+    int              num_chunks;
+    int              max_chunks;
+    int              next;
+
+    pthread_mutex_t  lock;
+    pthread_cond_t   done;
+
+  } pool = { NULL, 0, 0, 0,
+             PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+
+  /* split a face's glyph range; the pending headers go to the first chunk */
+  static void
+  Add_Chunks( const char*           fname,
+              FT_Long               face_index,
+              int                   ptsize,
+              unsigned int          first,
+              unsigned int          last,
+              const unsigned char*  golden,
+              unsigned char*        digests,
+              int                   free_digests,
+              int                   compare,
+              Output*               pending )
+  {
+    unsigned int  id = first;
+    Chunk*        chunk;
+
+
+    do
+    {
+      if ( pool.num_chunks == pool.max_chunks )
+      {
+        int  max = pool.max_chunks ? 2 * pool.max_chunks : 256;
+
+
+        chunk = (Chunk*)realloc( pool.chunks, (size_t)max * sizeof ( Chunk ) );
+        if ( !chunk )
+          Panic( "out of memory\n" );
+
+        pool.chunks     = chunk;
+        pool.max_chunks = max;
+      }
+
+      chunk = pool.chunks + pool.num_chunks++;
+      memset( chunk, 0, sizeof ( Chunk ) );
+
+      chunk->fname      = fname;
+      chunk->face_index = face_index;
+      chunk->ptsize     = ptsize;
+      chunk->first      = id;
+      chunk->last       = last - id < CHUNK_SIZE ? last
+                                                 : id + CHUNK_SIZE - 1;
+      chunk->summary    = chunk->last == last;
+      chunk->compare    = compare;
+
+      if ( digests )
+      {
+        chunk->digests = digests + 16 * ( id - first );
+        chunk->golden  = golden ? golden + 16 * ( id - first ) : NULL;
+      }
+
+      if ( chunk->summary )
+      {
+        chunk->face_digests = digests;
+        chunk->face_glyphs  = last - first + 1;
+        chunk->free_digests = free_digests;
+      }
+
+      if ( id == first )
+      {
+        chunk->head      = *pending;
+        pending->buffer  = NULL;
+        pending->length  = pending->size = 0;
+      }
+
+      id = chunk->last + 1;
+
+    } while ( !chunk->summary );
+  }
+
+
+  static void*
+  Worker( void*  arg )
+  {
+    FT_Library   library = NULL;
+    FT_Face      face    = NULL;
+    const char*  fname   = NULL;
+    FT_Long      face_index = 0;
+    int          ptsize     = 0;
+    FT_Error     error;
+
+    FT_UNUSED( arg );
+
+
+    /* FreeType objects must not be shared between threads */
+    (void)FT_Init_FreeType( &library );
+
+    for (;;)
+    {
+      Chunk*  chunk;
+
+
+      pthread_mutex_lock( &pool.lock );
+      chunk = pool.next < pool.num_chunks ? pool.chunks + pool.next++
+                                          : NULL;
+      pthread_mutex_unlock( &pool.lock );
+
+      if ( !chunk )
+        break;
+
+      if ( !face                           ||
+           chunk->fname      != fname      ||
+           chunk->face_index != face_index )
+      {
+        FT_Done_Face( face );
+        face = NULL;
+
+        fname      = chunk->fname;
+        face_index = chunk->face_index;
+        ptsize     = 0;
+
+        error = FT_New_Face( library, fname, face_index, &face );
+        if ( error )
+        {
+          face = NULL;
+          Error( &chunk->body, "  opening ", error );
+        }
+      }
+
+      /* a size sweep only resizes the open face */
+      if ( face && chunk->ptsize != ptsize )
+      {
+        ptsize = chunk->ptsize;
+
+        error = FT_Set_Char_Size( face, ptsize << 6, ptsize << 6, 72, 72 );
+        if ( error )
+        {
+          FT_Done_Face( face );
+          face = NULL;
+          Error( &chunk->body, "  sizing ", error );
+        }
+      }
+
+      if ( face )
+        chunk->fails = Lint_Glyphs( library, face,
+                                    chunk->first, chunk->last,
+                                    chunk->golden, chunk->digests,
+                                    chunk->compare == CHANGED_UNKNOWN
+                                      ? NULL : &chunk->changed,
+                                    &chunk->body );
+      else
+        chunk->fails = (int)( chunk->last - chunk->first + 1 );
+
+      pthread_mutex_lock( &pool.lock );
+      chunk->done = 1;
+      pthread_cond_broadcast( &pool.done );
+      pthread_mutex_unlock( &pool.lock );
+    }
+
+    FT_Done_Face( face );
+    FT_Done_FreeType( library );
+
+    return NULL;
+  }
+
+
+  static void
+  Run_Pool( int  jobs )
+  {
+    pthread_t*  threads;
+    Output      out = { NULL, NULL, 0, 0 };
+    int         i, n, fails = 0, changed = 0;
+
+
+    out.file = stdout;
+
+    threads = (pthread_t*)malloc( (size_t)jobs * sizeof ( pthread_t ) );
+    if ( !threads )
+      Panic( "out of memory\n" );
+
+    for ( n = 0; n < jobs; n++ )
+      if ( pthread_create( threads + n, NULL, Worker, NULL ) )
+        break;
+
+    if ( n == 0 )
+      Worker( NULL );
+
+    for ( i = 0; i < pool.num_chunks; i++ )
+    {
+      Chunk*  chunk = pool.chunks + i;
+
+
+      pthread_mutex_lock( &pool.lock );
+      while ( !chunk->done )
+        pthread_cond_wait( &pool.done, &pool.lock );
+      pthread_mutex_unlock( &pool.lock );
+
+      Flush( &chunk->head );
+      Flush( &chunk->body );
+
+      fails   += chunk->fails;
+      changed += chunk->changed;
+      if ( chunk->summary )
+      {
+        Summary( &out, fails, chunk->compare ? chunk->compare : changed,
+                 chunk->face_digests, chunk->face_glyphs );
+        if ( chunk->free_digests )
+          free( chunk->face_digests );
+
+        fails   = 0;
+        changed = 0;
+      }
+    }
+
+    while ( n-- )
+      pthread_join( threads[n], NULL );
+
+    free( threads );
+    free( pool.chunks );
+  }
+
+#endif /* LINT_THREADS */
+
+
+  /* Parse a comma-separated list of ppem values; each item is either */
+  /* `N', `N-M', or `N-M:STEP'.                                      */
+  static int
+  Parse_Sizes( const char*  list )
+  {
+    char*  end;
+
+
+    num_sizes = 0;
+
+    for (;;)
+    {
+      long  a, b, step = 1;
+
+
+      a = strtol( list, &end, 10 );
+      if ( end == list )
+        return 0;
+      b    = a;
+      list = end;
+
+      if ( *list == '-' )
+      {
+        b = strtol( ++list, &end, 10 );
+        if ( end == list )
+          return 0;
+        list = end;
+
+        if ( *list == ':' )
+        {
+          step = strtol( ++list, &end, 10 );
+          if ( end == list || step < 1 )
+            return 0;
+          list = end;
+        }
+      }
+
+      if ( a < 1 || b < a || b > 0xFFFF )
+        return 0;
+
+      for ( ; a <= b; a += step )
+      {
+        if ( num_sizes == MAX_SIZES )
+          return 0;
+        sizes[num_sizes++] = (int)a;
+      }
+
+      if ( *list != ',' )
+        return *list == '\0';
+      list++;
+    }
+  }
+
+
+  /* Check the glyphs of `face' at the current size. */
+  static void
+  Lint_Size( FT_Library            library,
+             FT_Face               face,
+             const char*           fname,
+             FT_Long               face_index,
+             int                   ptsize,
+             unsigned int          first_index,
+             unsigned int          last_index,
+             const unsigned char*  font_md5,
+             int                   jobs,
+             Output*               out )
+  {
+    unsigned int  fi, li;
+    int           fails, changed;
+
+    const unsigned char*  golden;
+    unsigned char*        digests;
+    int                   free_digests;
+
+
+    /* nothing to do */
+    if ( !face->num_glyphs )
+      return;
+
+    fi = first_index > 0 ? first_index : 0;
+    li = last_index < (unsigned int)face->num_glyphs ?
+                      last_index : (unsigned int)face->num_glyphs - 1;
+
+    golden       = NULL;
+    digests      = NULL;
+    free_digests = 0;
+    changed      = CHANGED_UNKNOWN;
+
+    if ( db.name && font_md5 && fi <= li )
+    {
+      Record   key;
+      Record*  old;
+
+
+      DB_Key( &key, font_md5, face_index, ptsize, fi, li );
+
+      old = DB_Find( &key );
+      if ( old && db.same_version )
+      {
+        Print( out, "  skipped (unchanged).\n" );
+        return;
+      }
+
+      if ( old )
+      {
+        old->replaced = 1;
+        golden        = old->digests;
+      }
+
+      digests = DB_Add( &key )->digests;
+      changed = old ? 0 : CHANGED_NEW;
+    }
+
+    /* collect the checksums for the face hashsum */
+    if ( !quiet && !digests && fi <= li )
+    {
+      digests = (unsigned char*)calloc( li - fi + 1, 16 );
+      if ( !digests )
+        Panic( "out of memory\n" );
+
+      free_digests = 1;
+    }
+
+    if ( !quiet && changed == CHANGED_UNKNOWN )
+    {
+      /*             "NNNNN SS.SS WWWxHHHH X.XXXX Y.YYYY MMDD55MMDD55MMDD55MMDD55MMDD55MM" */
+      Print( out, "\n GID  shape imgsize  Xacut  Yacut  %s hashsum",
+                  fast_hash ? "fast" : "MD5" );
+      Print( out, "\n-------------------------------------------------------------------\n" );
+    }
+
+#ifdef LINT_THREADS
+    if ( jobs > 1 )
+    {
+      if ( fi <= li )
+        Add_Chunks( fname, face_index, ptsize, fi, li,
+                    golden, digests, free_digests, changed, out );
+      else
+        Summary( out, 0, changed, NULL, 0 );
+
+      return;
+    }
+#else
+    FT_UNUSED( fname );
+    FT_UNUSED( jobs );
+#endif
+
+    fails = 0;
+    if ( fi <= li )
+      fails = Lint_Glyphs( library, face, fi, li, golden, digests,
+                           changed == CHANGED_UNKNOWN ? NULL : &changed,
+                           out );
+    Summary( out, fails, changed, digests, li - fi + 1 );
+
+    if ( free_digests )
+      free( digests );
   }
 
 
@@ -220,18 +1384,27 @@
   main( int     argc,
         char**  argv )
   {
-    int           file_index, face_index;
-    const char*   execname;
-    char*         fname;
-    int           opt;
-    unsigned int  first_index = 0;
-    unsigned int  last_index = UINT_MAX;
-    int           quiet = 0;
+    FT_Error       error;
+    FT_Library     library;
+    FT_Face        face;
+    int            file_index, face_index;
+    const char*    execname;
+    char*          fname;
+    int            opt;
+    unsigned int   first_index = 0;
+    unsigned int   last_index = UINT_MAX;
+    int            jobs = 1;
+    const char*    db_name = NULL;
+    unsigned char  font_md5[16];
+    int            font_hashed = 0;
+    Output         stdout_output = { NULL, NULL, 0, 0 };
+    Output         pending       = { NULL, NULL, 0, 0 };
+    Output*        out;
 
 
     execname = ft_basename( argv[0] );
 
-    while ( ( opt =  getopt( argc, argv, "f:r:i:q") ) != -1)
+    while ( ( opt =  getopt( argc, argv, "f:r:i:j:d:s:qx") ) != -1)
     {
 
       switch ( opt )
@@ -270,10 +1443,32 @@
         }
         break;
 
+      case 'j':
+#ifdef LINT_THREADS
+        jobs = atoi( optarg );
+        if ( jobs < 1 )
+          jobs = 1;
+#endif
+        break;
+
+      case 'd':
+        db_name = optarg;
+        break;
+
       case 'q':
         quiet = 1;
         break;
 
+      case 'x':
+        fast_hash = 1;
+        break;
+
+      case 's':
+        if ( !Parse_Sizes( optarg ) )
+          Usage( execname );
+        sweep = 1;
+        break;
+
       default:
         Usage( execname );
         break;
@@ -283,121 +1478,84 @@
     argc -= optind;
     argv += optind;
 
-    if ( argc < 2 || sscanf( argv[0], "%d", &ptsize) != 1 )
+    /* without a ppem list, the first argument is the only size */
+    if ( !sweep )
+    {
+      if ( argc < 2 || sscanf( argv[0], "%d", &sizes[0] ) != 1 )
+        Usage( execname );
+
+      num_sizes = 1;
+    }
+    else if ( argc < 1 )
       Usage( execname );
 
+    /* in parallel mode, the headers are collected for the chunks */
+    stdout_output.file = stdout;
+    out = jobs > 1 ? &pending : &stdout_output;
+
     error = FT_Init_FreeType( &library );
     if ( error )
     {
-      Error( "" );
+      Error( &stdout_output, "", error );
       exit( 1 );
     }
 
+    /* checksums are only available with the rendering analysis */
+    if ( db_name && !quiet )
+      DB_Load( library, db_name );
+
     /* Now check all files */
-    for ( face_index = 0, file_index = 1; file_index < argc; file_index++ )
+    for ( face_index = 0, file_index = !sweep;
+          file_index < argc;
+          file_index++ )
     {
-      unsigned int  id, fi, li;
+      int  s;
 
 
       fname = argv[file_index];
 
-      printf( "%s:\n", fname );
+      Print( out, "%s:\n", fname );
+
+      if ( db.name )
+        font_hashed = Hash_File( fname, font_md5 );
 
     Next_Face:
       error = FT_New_Face( library, fname, face_index, &face );
       if ( error )
       {
-        Error( "  opening " );
+        Error( out, "  opening ", error );
         continue;
       }
 
-      printf( quiet ? "  %s %s:" : "  %s %s\n",
-              face->family_name, face->style_name );
+      Print( out, quiet && !sweep ? "  %s %s:" : "  %s %s\n",
+                  face->family_name, face->style_name );
 
-      error = FT_Set_Char_Size( face, ptsize << 6, ptsize << 6, 72, 72 );
-      if ( error )
+      for ( s = 0; s < num_sizes; s++ )
       {
-        Error( "  sizing " );
-        goto Finalize;
-      }
+        FT_Size  size = NULL;
 
-      /* nothing to do */
-      if ( !face->num_glyphs )
-        goto Finalize;
 
-      fi = first_index > 0 ? first_index : 0;
-      li = last_index < (unsigned int)face->num_glyphs ?
-                        last_index : (unsigned int)face->num_glyphs - 1;
+        if ( sweep )
+          Print( out, quiet ? "  %d ppem:" : "  %d ppem:\n", sizes[s] );
 
-      if ( !quiet )
-      {
-        /*        "NNNNN SS.SS WWWxHHHH X.XXXX Y.YYYY MMDD55MMDD55MMDD55MMDD55MMDD55MM" */
-        printf( "\n GID  shape imgsize  Xacut  Yacut  MD5 hashsum" );
-        printf( "\n-------------------------------------------------------------------\n" );
-      }
-
-      Fail = 0;
-      for ( id = fi; id <= li; id++ )
-      {
-        FT_Bitmap  bitmap;
-
-
-        error = FT_Load_Glyph( face, id, load_flags );
+        /* all sizes share the already loaded face */
+        error = FT_New_Size( face, &size );
+        if ( !error )
+          error = FT_Activate_Size( size );
+        if ( !error )
+          error = FT_Set_Char_Size( face, sizes[s] << 6, sizes[s] << 6,
+                                    72, 72 );
         if ( error )
-        {
-          if ( !quiet )
-          {
-            printf( "%5u ", id );
-            Error( "loading " );
-          }
-          Fail++;
-          continue;
-        }
-
-        if ( quiet )
-          continue;
-
-        printf( "%5u ", id );
-
-        Examine( face->glyph );
-
-        error = FT_Render_Glyph( face->glyph, render_mode );
-        if ( error && face->glyph->format != FT_GLYPH_FORMAT_BITMAP )
-        {
-          Error( "rendering " );
-          Fail++;
-          continue;
-        }
-
-        FT_Bitmap_Init( &bitmap );
-
-        /* convert to an 8-bit bitmap with a positive pitch */
-        error = FT_Bitmap_Convert( library, &face->glyph->bitmap, &bitmap, 1 );
-        if ( error )
-        {
-          Error( "converting " );
-          continue;
-        }
+          Error( out, "  sizing ", error );
         else
-          printf( "%3ux%-4u ", bitmap.width, bitmap.rows );
-
-        Analyze( &bitmap );
-        Checksum( &bitmap );
+          Lint_Size( library, face, fname, face_index, sizes[s],
+                     first_index, last_index,
+                     font_hashed ? font_md5 : NULL, jobs, out );
 
-        FT_Bitmap_Done( library, &bitmap );
-
-        printf( "\n" );
+        if ( size )
+          FT_Done_Size( size );
       }
 
-      if ( Fail == 0 )
-        printf( "  OK.\n" );
-      else if ( Fail == 1 )
-        printf( "  1 fail.\n" );
-      else
-        printf( "  %d fails.\n", Fail );
-
-    Finalize:
-
       if ( ++face_index == face->num_faces )
         face_index = 0;
 
@@ -407,6 +1565,17 @@
         goto Next_Face;
     }
 
+#ifdef LINT_THREADS
+    if ( jobs > 1 )
+    {
+      Run_Pool( jobs );
+      Flush( &pending );
+    }
+#endif
+
+    if ( db.name )
+      DB_Save( library );
+
     FT_Done_FreeType( library );
     exit( 0 );      /* for safety reasons */
 
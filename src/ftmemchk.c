@@ -6,6 +6,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+
+#define NUM_SIZE_CLASSES  32
 
 
   FT_Error      error;
@@ -19,6 +23,12 @@
   int  Fail;
   int  Num;
 
+  int    print_phases;  /* print per-phase memory use for each font */
+  FILE*  folded;        /* folded stacks of allocated bytes per phase */
+  FILE*  timeline;      /* CSV of all allocations and releases        */
+
+  const char*  cur_font = "";
+
 
 
 
@@ -27,84 +37,270 @@
 /****************************************************************************/
 /****************************************************************************/
 
-/* Our own memory allocator. To check that a single block isn't freed */
-/* several time, we simply do not call "free"..                       */
+/* Our own memory allocator.  Every block is kept in a dense record    */
+/* array, which is indexed by an open-addressing hash table keyed by   */
+/* the block address; both grow on demand.  Each record is tagged with */
+/* the FreeType operation (`site') that was running when it was        */
+/* created.  Released blocks are really freed, but their record stays  */
+/* until the address is handed out again, so that releasing a block    */
+/* twice is caught in most cases.                                      */
 
-#define MAX_RECORDED_BLOCKS  1638400
 #define CHECK_DUPLICATES
 
+#define MAX_SITES  64
+
 typedef  struct MyBlock
 {
   void*  base;
   long   size;
+  int    site;
 
 } MyBlock;
 
-static  MyBlock my_blocks[ MAX_RECORDED_BLOCKS ];
-static  int     num_my_blocks = 0;
+static  MyBlock*  my_blocks     = NULL;
+static  long      num_my_blocks = 0;
+static  long      max_my_blocks = 0;
+
+/* hash slots hold record indices plus one; zero marks an empty slot */
+static  long*          my_hash      = NULL;
+static  unsigned long  my_hash_mask = 0;
+
+static  const char*  sites[MAX_SITES] = { "ftmemchk" };
+static  int          num_sites        = 1;
+static  int          cur_site         = 0;
+
+/* memory use per site since the last call of `flush_phases' */
+static  long    site_allocs[MAX_SITES];
+static  double  site_bytes [MAX_SITES];
+static  long    site_peak  [MAX_SITES];
+
+static  long    num_allocs = 0;
+static  long    live       = 0;   /* bytes in live blocks            */
+static  long    peak       = 0;   /* maximum of `live' since a flush */
+static  int     peak_site  = 0;
+
+/* allocations and their total size per power-of-two size class */
+static  long    class_blocks[NUM_SIZE_CLASSES];
+static  double  class_bytes [NUM_SIZE_CLASSES];
+
+
+/* tag all blocks allocated from now on with `name' */
+static
+void  set_site( const char*  name )
+{
+  int  n;
+
+  for ( n = 0; n < num_sites; n++ )
+    if ( !strcmp( sites[n], name ) )
+      break;
+
+  if ( n == num_sites )
+  {
+    if ( num_sites == MAX_SITES )
+    {
+      fprintf( stderr, "Too many allocation sites -- test exited !!\n" );
+      exit(1);
+    }
+    sites[num_sites++] = name;
+  }
+
+  cur_site = n;
+}
+
+
+/* microseconds since the first call */
+static
+double  get_time( void )
+{
+  static double  start = -1;
+  double         t;
+
+#if defined CLOCK_MONOTONIC
+  struct timespec  tv;
+
+  clock_gettime( CLOCK_MONOTONIC, &tv );
+  t = 1e6 * tv.tv_sec + 1e-3 * tv.tv_nsec;
+#else
+  t = 1e6 * clock() / CLOCKS_PER_SEC;
+#endif
+
+  if ( start < 0 )
+    start = t;
+
+  return t - start;
+}
+
+
+/* account for an allocation (positive `size') or release */
+static
+void  record_event( long  size, int  site )
+{
+  live += size;
+
+  if ( size > 0 )
+  {
+    site_allocs[cur_site]++;
+    site_bytes [cur_site] += size;
+    num_allocs++;
+  }
+
+  if ( live > site_peak[cur_site] )
+    site_peak[cur_site] = live;
+  if ( live > peak )
+  {
+    peak      = live;
+    peak_site = cur_site;
+  }
+
+  if ( timeline )
+  {
+    const char*  p;
+
+    fprintf( timeline, "%.1f,%s,\"",
+             get_time(), size > 0 ? "alloc" : "free" );
+    for ( p = cur_font; *p; p++ )
+    {
+      if ( *p == '"' )
+        putc( '"', timeline );
+      putc( *p, timeline );
+    }
+    fprintf( timeline, "\",%s,%s,%ld,%ld\n",
+             sites[cur_site], sites[site], size > 0 ? size : -size, live );
+  }
+}
+
+
+static
+unsigned long  hash_block( void*  base )
+{
+  unsigned long  h = (unsigned long)(size_t)base;
+
+  /* blocks are aligned, so the lowest bits carry no information */
+  h ^= h >> 4;
+  h *= 2654435761UL;
+  h ^= h >> 16;
+
+  return h & my_hash_mask;
+}
+
+
+/* return the hash slot of `base', or the empty slot to insert it into */
+static
+long*  find_my_block( void*  base )
+{
+  unsigned long  h = hash_block( base );
+
+  /* linear probing; the table is never more than half full */
+  while ( my_hash[h] && my_blocks[my_hash[h] - 1].base != base )
+    h = ( h + 1 ) & my_hash_mask;
+
+  return my_hash + h;
+}
+
+
+static
+void  grow_my_blocks( void )
+{
+  if ( num_my_blocks == max_my_blocks )
+  {
+    max_my_blocks = max_my_blocks ? 2 * max_my_blocks : 4096;
+    my_blocks     = (MyBlock*)realloc( my_blocks,
+                                       max_my_blocks * sizeof ( MyBlock ) );
+    if ( !my_blocks )
+    {
+      fprintf( stderr, "Too many memory blocks -- test exited !!\n" );
+      exit(1);
+    }
+  }
+
+  if ( 2 * ( (unsigned long)num_my_blocks + 1 ) > my_hash_mask )
+  {
+    long  n;
+
+    free( my_hash );
+
+    my_hash_mask = my_hash_mask ? 2 * my_hash_mask + 1 : 8191;
+    my_hash      = (long*)calloc( my_hash_mask + 1, sizeof ( long ) );
+    if ( !my_hash )
+    {
+      fprintf( stderr, "Too many memory blocks -- test exited !!\n" );
+      exit(1);
+    }
+
+    for ( n = 0; n < num_my_blocks; n++ )
+      *find_my_block( my_blocks[n].base ) = n + 1;
+  }
+}
 
 
 /* record a new block in the table, check for duplicates too */
 static
 void  record_my_block( void*  base, long  size )
 {
+  MyBlock*  block;
+  long*     slot;
+  int       c;
+
   if (size <= 0)
   {
     fprintf( stderr, "adding a block with non-positive length - should not happen \n" );
     exit(1);
   }
 
-  if ( num_my_blocks < MAX_RECORDED_BLOCKS )
+  grow_my_blocks();
+
+  slot = find_my_block( base );
+  if ( *slot )
   {
-    MyBlock*  block;
+    /* the address of a released block can be handed out again */
+    block = my_blocks + *slot - 1;
 
 #ifdef CHECK_DUPLICATES
-    MyBlock*  limit;
-    block = my_blocks;
-    limit = block + num_my_blocks;
-    for ( ; block < limit; block++ )
+    if ( block->size != 0 )
     {
-      if ( block->base == base && block->size != 0 )
-      {
-        fprintf( stderr, "duplicate memory block at %p\n", block->base );
-        exit(1);
-      }
+      fprintf( stderr, "duplicate memory block at %p\n", block->base );
+      exit(1);
     }
 #endif
-
-    block = my_blocks + num_my_blocks++;
-    block->base = base;
-    block->size = size;
   }
   else
   {
-    fprintf( stderr, "Too many memory blocks -- test exited !!\n" );
-    exit(1);
+    block = my_blocks + num_my_blocks++;
+    *slot = num_my_blocks;
   }
+
+  block->base = base;
+  block->size = size;
+  block->site = cur_site;
+
+  for ( c = 0; c < NUM_SIZE_CLASSES - 1 && ( size >> ( c + 1 ) ); c++ )
+    ;
+  class_blocks[c]++;
+  class_bytes [c] += size;
+
+  record_event( size, cur_site );
 }
 
 /* forget a block, and check that it isn't part of our table already */
 static
 void  forget_my_block( void*  base )
 {
-  MyBlock*  block = my_blocks + num_my_blocks-1;
+  long*  slot = my_hash ? find_my_block( base ) : NULL;
 
-  /* we scan in reverse, because transient blocks are always located */
-  /* at the end of the table.. (it supposedly faster then..)         */
-  for ( ; block >= my_blocks; block-- )
+  if ( slot && *slot )
   {
-    if ( block->base == base )
+    MyBlock*  block = my_blocks + *slot - 1;
+
+    if (block->size > 0)
     {
-      if (block->size > 0)
-      {
-        block->size = 0;
-        return;
-      }
-      else
-      {
-        fprintf( stderr, "Block at %p released twice \n", base );
-        exit(1);
-      }
+      record_event( -block->size, block->site );
+      block->size = 0;
+      return;
+    }
+    else
+    {
+      fprintf( stderr, "Block at %p released twice \n", base );
+      exit(1);
     }
   }
   fprintf( stderr, "Trying to release an unallocated block at %p\n",
@@ -130,7 +326,7 @@ void  my_free( FT_Memory  memory,
 {
   memory=memory;
   forget_my_block(block);
-  /* free(block);  WE DO NOT REALLY FREE THE BLOCK */
+  free(block);
 }
 
 static
@@ -178,27 +374,101 @@ static FT_Memory  my_memory( void )
   return memory;
 }
 
+#define MAX_LISTED_LEAKS  10
+
 static void  dump_mem( void )
 {
-  MyBlock*  block = my_blocks + num_my_blocks-1;
+  MyBlock*  block;
+  MyBlock*  limit = my_blocks + num_my_blocks;
+  long      leaks[MAX_SITES];
+  double    bytes[MAX_SITES];
   int       bad   = 0;
+  int       n, c;
 
-  printf( "total allocated blocks = %d\n", num_my_blocks );
+  printf( "total allocated blocks = %ld\n", num_allocs );
 
-  /* we scan in reverse, because transient blocks are always located */
-  /* at the end of the table.. (it supposedly faster then..)         */
-  for ( ; block >= my_blocks; block-- )
+  printf( "\n" );
+  printf( "    size class    blocks        bytes\n" );
+  for ( c = 0; c < NUM_SIZE_CLASSES; c++ )
+    if ( class_blocks[c] )
+      printf( "%7ld-%-7ld %9ld %12.0f\n",
+              1L << c, ( 2L << c ) - 1, class_blocks[c], class_bytes[c] );
+  printf( "\n" );
+
+  memset( leaks, 0, sizeof ( leaks ) );
+  memset( bytes, 0, sizeof ( bytes ) );
+
+  for ( block = my_blocks; block < limit; block++ )
   {
     if (block->size > 0)
     {
-      fprintf( stderr, "%p (%6ld bytes) leaked !!\n", block->base, (long)block->size );
+      leaks[block->site]++;
+      bytes[block->site] += block->size;
       bad = 1;
     }
   }
+
+  /* report the leaks grouped by allocation site, */
+  /* listing only the last recorded blocks of each */
+  for ( n = 0; n < num_sites; n++ )
+  {
+    long  listed = 0;
+
+    if ( !leaks[n] )
+      continue;
+
+    fprintf( stderr, "%s: %ld block%s (%.0f bytes) leaked !!\n",
+             sites[n], leaks[n], leaks[n] == 1 ? "" : "s", bytes[n] );
+
+    for ( block = limit - 1; block >= my_blocks; block-- )
+    {
+      if ( block->size > 0 && block->site == n )
+      {
+        if ( listed++ == MAX_LISTED_LEAKS )
+        {
+          fprintf( stderr, "  ...\n" );
+          break;
+        }
+        fprintf( stderr, "  %p (%6ld bytes)\n", block->base, (long)block->size );
+      }
+    }
+  }
   if (!bad)
     fprintf( stderr, "no leaked memory block\n\n" );
 }
 
+/* report memory use per site for `name' (a font or the library), */
+/* then start afresh                                               */
+static void  flush_phases( const char*  name )
+{
+  int  n;
+
+  if ( print_phases )
+  {
+    printf( "  %s\n", name );
+    printf( "  %-18s %8s %12s %12s\n", "phase", "allocs", "bytes", "peak live" );
+    for ( n = 0; n < num_sites; n++ )
+      if ( site_allocs[n] )
+        printf( "  %-18s %8ld %12.0f %12ld\n",
+                sites[n], site_allocs[n], site_bytes[n], site_peak[n] );
+    printf( "  peak %ld bytes during %s\n", peak, sites[peak_site] );
+  }
+
+  if ( folded )
+    for ( n = 0; n < num_sites; n++ )
+      if ( site_allocs[n] )
+        fprintf( folded, "%s;%s %.0f\n", name, sites[n], site_bytes[n] );
+
+  memset( site_allocs, 0, sizeof ( site_allocs ) );
+  memset( site_bytes, 0, sizeof ( site_bytes ) );
+  memset( site_peak, 0, sizeof ( site_peak ) );
+
+  /* the next phase's peak is set by its first event, so that it */
+  /* is never attributed to an operation of an earlier phase      */
+  peak      = 0;
+  peak_site = 0;
+}
+
 /****************************************************************************/
 /****************************************************************************/
 /****************************************************************************/
@@ -210,7 +480,13 @@ static void  dump_mem( void )
     printf( "ftmemchk: simple memory tester -- part of the FreeType project\n" );
     printf( "--------------------------------------------------------------\n" );
     printf( "\n" );
-    printf( "Usage: %s ppem fontname[.ttf|.ttc] [fontname2..]\n", name );
+    printf( "Usage: %s [options] ppem fontname[.ttf|.ttc] [fontname2..]\n", name );
+    printf( "\n" );
+    printf( "  -p       Print memory use and peak per phase for each font.\n" );
+    printf( "  -f FILE  Write bytes allocated per font and phase to FILE,\n" );
+    printf( "           as folded stacks for flame graph tools.\n" );
+    printf( "  -t FILE  Write a CSV timeline of all allocations and\n" );
+    printf( "           releases to FILE.\n" );
     printf( "\n" );
 
     exit( 1 );
@@ -234,6 +510,47 @@ int  main( int argc, char** argv )
 
     execname = argv[0];
 
+    while ( argc > 1 && argv[1][0] == '-' )
+    {
+      switch ( argv[1][1] )
+      {
+      case 'p':
+        print_phases = 1;
+        break;
+
+      case 'f':
+      case 't':
+        if ( argc < 3 )
+          Usage( execname );
+        {
+          FILE*  f = fopen( argv[2], "w" );
+
+          if ( !f )
+          {
+            fprintf( stderr, "could not open `%s' for writing\n", argv[2] );
+            exit( 1 );
+          }
+
+          if ( argv[1][1] == 'f' )
+            folded = f;
+          else
+          {
+            timeline = f;
+            fprintf( timeline, "time_us,event,font,phase,site,size,live\n" );
+          }
+        }
+        argc--;
+        argv++;
+        break;
+
+      default:
+        Usage( execname );
+      }
+
+      argc--;
+      argv++;
+    }
+
     if ( argc < 3 )
       Usage( execname );
 
@@ -241,6 +558,7 @@ int  main( int argc, char** argv )
       Usage( execname );
 
     /* Create a new library with our own memory manager */
+    set_site( "FT_New_Library" );
     error = FT_New_Library( my_memory(), &library );
     if (error) Panic( "Could not create library object" );
 
@@ -248,6 +566,8 @@ int  main( int argc, char** argv )
     /* (implemented in ftinit.c)..                                */
     FT_Add_Default_Modules(library);
 
+    flush_phases( "library" );
+
 
     /* Now check all files */
     for ( file_index = 2; file_index < argc; file_index++ )
@@ -285,8 +605,10 @@ int  main( int argc, char** argv )
           i--;
 
       printf( "%s: ", fname );
+      cur_font = fname;
 
       /* Load face */
+      set_site( "FT_New_Face" );
       error = FT_New_Face( library, filename, 0, &face );
       if (error)
       {
@@ -300,6 +622,7 @@ int  main( int argc, char** argv )
 
       num_glyphs = face->num_glyphs;
 
+      set_site( "FT_Set_Char_Size" );
       error = FT_Set_Char_Size( face, ptsize << 6, ptsize << 6, 72, 72 );
       if (error) Panic( "Could not set character size" );
 
@@ -307,7 +630,14 @@ int  main( int argc, char** argv )
       {
         for ( id = 0; id < num_glyphs; id++ )
         {
-          error = FT_Load_Glyph( face, id, FT_LOAD_RENDER );
+          /* load and render separately to tell their memory use apart */
+          set_site( "FT_Load_Glyph" );
+          error = FT_Load_Glyph( face, id, FT_LOAD_DEFAULT );
+          if ( !error )
+          {
+            set_site( "FT_Render_Glyph" );
+            error = FT_Render_Glyph( face->glyph, FT_RENDER_MODE_NORMAL );
+          }
           if (error)
           {
             if ( Fail < 10 )
@@ -325,11 +655,23 @@ int  main( int argc, char** argv )
         else
           printf( "%d fails.\n", Fail );
 
+      set_site( "FT_Done_Face" );
       FT_Done_Face( face );
+
+      flush_phases( fname );
+      cur_font = "";
     }
 
+    set_site( "FT_Done_FreeType" );
     FT_Done_FreeType(library);
 
+    flush_phases( "library" );
+
+    if ( folded )
+      fclose( folded );
+    if ( timeline )
+      fclose( timeline );
+
     dump_mem();
 
     exit( 0 );      /* for safety reasons */
@@ -6,23 +6,31 @@
 /*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
 /*                                                                          */
 /*                                                                          */
-/*  ftpngout.c - PNG printing routines for FreeType demo programs.          */
+/*  ftpngout.c - PNG and Netpbm printing routines for FreeType demo         */
+/*               programs.                                                  */
 /*                                                                          */
 /****************************************************************************/
 
 #include "ftcommon.h"
 
+#ifndef _WIN32
+#define EXPORT_THREADS
+#include <pthread.h>
+#endif
+
 
 #ifdef FT_CONFIG_OPTION_USE_PNG
 
 #include <png.h>
 
-  int
-  FTDemo_Display_Print( FTDemo_Display*  display,
-                        const char*      filename,
-                        FT_String*       ver_str )
+  static int
+  Write_PNG( grBitmap*    bit,
+             double       gamma,
+             const char*  filename,
+             FT_String*   ver_str,
+             int          level,
+             int          filters )
   {
-    grBitmap*  bit    = display->bitmap;
     int        width  = bit->width;
     int        height = bit->rows;
     int        color_type;
@@ -103,7 +111,15 @@
     }
 
     /* Set gamma */
-    png_set_gAMA( png_ptr, info_ptr, 1.0 / display->gamma );
+    png_set_gAMA( png_ptr, info_ptr, 1.0 / gamma );
+
+    /* Set encoder parameters; the FTDEMO_FILTER_XXX flags */
+    /* are the PNG_FILTER_XXX flags shifted right by 3     */
+    if ( level >= 0 )
+      png_set_compression_level( png_ptr, level );
+    if ( filters )
+      png_set_filter( png_ptr, PNG_FILTER_TYPE_BASE,
+                      ( filters & FTDEMO_FILTER_ALL ) << 3 );
 
     png_write_info( png_ptr, info_ptr );
 
@@ -285,13 +301,14 @@
   GpStatus WINGDIPAPI GdipFree(void* ptr);
 
 
-  int
-  FTDemo_Display_Print( FTDemo_Display*  display,
-                        const char*      filename,
-                        FT_String*       ver_str )
+  static int
+  Write_PNG( grBitmap*    bit,
+             double       gamma,
+             const char*  filename,
+             FT_String*   ver_str,
+             int          level,
+             int          filters )
   {
-    grBitmap*  bit = display->bitmap;
-
     WCHAR         wfilename[20];
     PixelFormat   format;
     ColorPalette  palette;
@@ -303,7 +320,7 @@
     GDIPCONST CLSID      GpPngEncoder = { 0x557cf406, 0x1a04, 0x11d3,
                            { 0x9a,0x73,0x00,0x00,0xf8,0x1e,0xf3,0x2e } };
 
-    ULONG         gg[2] =    { display->gamma * 0x10000, 0x10000 };
+    ULONG         gg[2] =    { gamma * 0x10000, 0x10000 };
     PropertyItem  gamma =    { PropertyTagGamma, 2 * sizeof ( ULONG ),
                                PropertyTagTypeRational, gg };
     PropertyItem  software = { PropertyTagSoftwareUsed, strlen( ver_str ) + 1,
@@ -369,21 +386,374 @@
     GdipFree( bitmap );
     GdiplusShutdown( gdiplusToken );
 
+    /* GDI+ offers no control over the encoder */
+    FT_UNUSED( level );
+    FT_UNUSED( filters );
+
   Exit:
     return ret;
   }
 
 #else
 
+  static int
+  Write_PNG( grBitmap*    bit,
+             double       gamma,
+             const char*  filename,
+             FT_String*   ver_str,
+             int          level,
+             int          filters )
+  {
+    FT_UNUSED( bit );
+    FT_UNUSED( gamma );
+    FT_UNUSED( filename );
+    FT_UNUSED( ver_str );
+    FT_UNUSED( level );
+    FT_UNUSED( filters );
+
+    return 0;
+  }
+
+#endif /* !FT_CONFIG_OPTION_USE_PNG */
+
+
+  /* Write uncompressed PAM, or PGM/PPM depending on the pixel mode. */
+  static int
+  Write_Netpbm( grBitmap*    bit,
+                const char*  filename,
+                int          pam )
+  {
+    int             width  = bit->width;
+    int             height = bit->rows;
+    int             depth;
+    unsigned char*  row;
+    unsigned char*  line   = NULL;
+    FILE*           fp;
+    int             code   = 1;
+
+
+    switch ( bit->mode )
+    {
+    case gr_pixel_mode_gray:
+      depth = 1;
+      break;
+    case gr_pixel_mode_rgb24:
+      depth = 3;
+      break;
+    case gr_pixel_mode_rgb32:
+      depth = 3;
+      line  = (unsigned char*)malloc( (size_t)width * 3 );
+      if ( !line )
+      {
+        fprintf( stderr, "Could not allocate row buffer\n" );
+        return 1;
+      }
+      break;
+    default:
+      fprintf( stderr, "Unsupported color type\n" );
+      return 1;
+    }
+
+    fp = fopen( filename, "wb" );
+    if ( fp == NULL )
+    {
+      fprintf( stderr, "Could not open file %s for writing\n", filename );
+      goto Exit;
+    }
+
+    if ( pam )
+      fprintf( fp, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\n"
+                   "TUPLTYPE %s\nENDHDR\n",
+               width, height, depth,
+               depth == 1 ? "GRAYSCALE" : "RGB" );
+    else
+      fprintf( fp, "P%c\n%d %d\n255\n",
+               depth == 1 ? '5' : '6', width, height );
+
+    row = bit->buffer;
+    if ( bit->pitch < 0 )
+      row -= ( bit->rows - 1 ) * bit->pitch;
+    while ( height-- )
+    {
+      if ( line )
+      {
+        /* 32-bit pixels are stored as native 0xXXRRGGBB words */
+        const unsigned int*  src = (const unsigned int*)row;
+        unsigned char*       dst = line;
+        int                  x;
+
+
+        for ( x = 0; x < width; x++, src++ )
+        {
+          *dst++ = (unsigned char)( *src >> 16 );
+          *dst++ = (unsigned char)( *src >> 8 );
+          *dst++ = (unsigned char)( *src );
+        }
+
+        fwrite( line, 3, (size_t)width, fp );
+      }
+      else
+        fwrite( row, (size_t)depth, (size_t)width, fp );
+
+      row += bit->pitch;
+    }
+
+    code = ferror( fp ) != 0;
+    if ( fclose( fp ) || code )
+    {
+      fprintf( stderr, "Error while writing file %s\n", filename );
+      code = 1;
+    }
+
+  Exit:
+    free( line );
+    return code;
+  }
+
+
+  /* an image to export, possibly a snapshot owned by a background job */
+  typedef struct  Export_
+  {
+    grBitmap     bit;
+    double       gamma;
+    const char*  filename;
+    FT_String*   ver_str;
+    int          level;
+    int          filters;
+
+  } Export;
+
+
+  static int
+  Export_Run( Export*  e )
+  {
+    const char*  ext = strrchr( e->filename, '.' );
+
+
+    if ( ext && !strcmp( ext, ".pam" ) )
+      return Write_Netpbm( &e->bit, e->filename, 1 );
+    if ( ext && ( !strcmp( ext, ".pgm" ) || !strcmp( ext, ".ppm" ) ) )
+      return Write_Netpbm( &e->bit, e->filename, 0 );
+
+    return Write_PNG( &e->bit, e->gamma, e->filename, e->ver_str,
+                      e->level, e->filters );
+  }
+
+
+#ifdef EXPORT_THREADS
+
+  /* at most one export runs in the background; only the main */
+  /* thread starts and joins it                                */
+  static pthread_t  export_thread;
+  static int        export_running = 0;
+
+
+  static void*
+  Export_Worker( void*  arg )
+  {
+    Export*  e = (Export*)arg;
+
+
+    Export_Run( e );
+    free( e );
+
+    return NULL;
+  }
+
+
+  /* wait for the background export, if any */
+  static void
+  Export_Join( void )
+  {
+    if ( export_running )
+    {
+      pthread_join( export_thread, NULL );
+      export_running = 0;
+    }
+  }
+
+
+  /* Copy the image into a single block with the job and start */
+  /* encoding it in the background.                             */
+  static int
+  Export_Start( Export*  e )
+  {
+    size_t   size = (size_t)e->bit.rows *
+                      (size_t)( e->bit.pitch < 0 ? -e->bit.pitch
+                                                 : e->bit.pitch );
+    size_t   flen = strlen( e->filename ) + 1;
+    size_t   vlen = e->ver_str ? strlen( e->ver_str ) + 1 : 0;
+    Export*  job;
+    char*    p;
+
+
+    job = (Export*)malloc( sizeof ( Export ) + size + flen + vlen );
+    if ( !job )
+      return 0;
+
+    *job = *e;
+
+    /* the buffer comes first to keep it aligned */
+    p               = (char*)( job + 1 );
+    job->bit.buffer = (unsigned char*)memcpy( p, e->bit.buffer, size );
+    p              += size;
+    job->filename   = (const char*)memcpy( p, e->filename, flen );
+    p              += flen;
+    if ( vlen )
+      job->ver_str  = (FT_String*)memcpy( p, e->ver_str, vlen );
+
+    if ( pthread_create( &export_thread, NULL, Export_Worker, job ) )
+    {
+      free( job );
+      return 0;
+    }
+
+    export_running = 1;
+
+    return 1;
+  }
+
+#endif /* EXPORT_THREADS */
+
+
+  int
+  FTDemo_Display_Export( FTDemo_Display*  display,
+                         const char*      filename,
+                         FT_String*       ver_str,
+                         int              level,
+                         int              filters,
+                         int              async )
+  {
+    Export  e;
+
+
+    e.bit      = *display->bitmap;
+    e.gamma    = display->gamma;
+    e.filename = filename;
+    e.ver_str  = ver_str;
+    e.level    = level;
+    e.filters  = filters;
+
+#ifdef EXPORT_THREADS
+    /* never write two images at once, they may share the file name */
+    Export_Join();
+
+    /* fall back to synchronous export if no thread can be started */
+    if ( async && Export_Start( &e ) )
+      return 0;
+#else
+    FT_UNUSED( async );
+#endif
+
+    return Export_Run( &e );
+  }
+
+
+  void
+  FTDemo_Display_Export_Wait( void )
+  {
+#ifdef EXPORT_THREADS
+    Export_Join();
+#endif
+  }
+
+
+  /* Parse `FTDEMO_EXPORT', which is `png[:LEVEL[:FILTER,...]]', */
+  /* `fast', `pam', or `pnm', and return the file extension.     */
+  static const char*
+  Export_Format( grBitmap*  bit,
+                 int*       level,
+                 int*       filters )
+  {
+    static const char*  names[] = { "none", "sub", "up", "avg", "paeth" };
+
+    const char*  env = getenv( "FTDEMO_EXPORT" );
+    const char*  p;
+    size_t       len;
+    int          i;
+
+
+    *level   = -1;
+    *filters = 0;
+
+    if ( !env || !*env )
+      return ".png";
+
+    if ( !strcmp( env, "pam" ) )
+      return ".pam";
+    if ( !strcmp( env, "pnm" ) )
+      return bit->mode == gr_pixel_mode_gray ? ".pgm" : ".ppm";
+    if ( !strcmp( env, "fast" ) )
+    {
+      *level   = 1;
+      *filters = FTDEMO_FILTER_NONE;
+      return ".png";
+    }
+
+    if ( strncmp( env, "png", 3 ) )
+      goto Bad;
+
+    p = env + 3;
+    if ( *p == ':' )
+    {
+      p++;
+      if ( *p >= '0' && *p <= '9' )
+        *level = *p++ - '0';
+    }
+    if ( *p == ':' )
+    {
+      do
+      {
+        p++;
+        len = strcspn( p, "," );
+
+        for ( i = 0; i < 5; i++ )
+          if ( strlen( names[i] ) == len && !strncmp( p, names[i], len ) )
+            break;
+        if ( i == 5 )
+          goto Bad;
+
+        *filters |= 1 << i;
+        p        += len;
+      } while ( *p == ',' );
+    }
+    if ( !*p )
+      return ".png";
+
+  Bad:
+    fprintf( stderr, "invalid FTDEMO_EXPORT value `%s', using PNG\n", env );
+    *level   = -1;
+    *filters = 0;
+
+    return ".png";
+  }
+
+
+  int
+  FTDemo_Display_Snapshot( FTDemo_Display*  display,
+                           const char*      basename,
+                           FT_String*       ver_str )
+  {
+    char         filename[64];
+    const char*  ext;
+    int          level, filters;
+
+
+    ext = Export_Format( display->bitmap, &level, &filters );
+    snprintf( filename, sizeof ( filename ), "%s%s", basename, ext );
+
+    return FTDemo_Display_Export( display, filename, ver_str,
+                                  level, filters, 1 );
+  }
+
+
   int
   FTDemo_Display_Print( FTDemo_Display*  display,
                         const char*      filename,
                         FT_String*       ver_str )
   {
-    return 0;
+    return FTDemo_Display_Export( display, filename, ver_str, -1, 0, 0 );
   }
 
-#endif /* !FT_CONFIG_OPTION_USE_PNG */
-
 
 /* End */
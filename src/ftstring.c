@@ -108,7 +108,7 @@
 
   } status = { "", DIM, NULL, RENDER_MODE_STRING, FT_ENCODING_UNICODE,
                72, 48, 0, NULL,
-               { 0, 0, 0x8000, 0, NULL, 0, 0 },
+               { 0, 0, 0x8000, 0, NULL, 0, 0, 0 },
                { 0, 0, 0, 0 }, 0, NULL, { 0 } };
 
   static FTDemo_Display*  display;
@@ -275,6 +275,8 @@
     grWriteln( "  l         : cycle through anti-aliasing modes" );
     grWriteln( "  k         : cycle through kerning modes" );
     grWriteln( "  t         : cycle through kerning degrees" );
+    grWriteln( "  x         : cycle through subpixel steps (exact, 1/4, 1/8)" );
+    grWriteln( "  #         : toggle cache and rendering statistics" );
     grWriteln( "  Space     : cycle through color" );
     grWriteln( "  Tab       : cycle through sample strings" );
     grWriteln( "  Enter     : toggle simple string editor" );
@@ -299,7 +301,7 @@
     grWriteln( "  F7        : big rotate counter-clockwise" );
     grWriteln( "  F8        : big rotate clockwise" );
     grLn();
-    grWriteln( "  P         : print PNG file" );
+    grWriteln( "  P         : print image file" );
     grWriteln( "  q,ESC     : quit" );
     grLn();
     grWriteln( "press any key to exit this help screen" );
@@ -412,6 +414,36 @@
   }
 
 
+  static void
+  event_subpixel_change( void )
+  {
+    /* exact (the default), 1/4 pixel, or 1/8 pixel positioning */
+    switch ( handle->subpixel_steps )
+    {
+    case 4:
+      handle->subpixel_steps = 8;
+      break;
+    case 8:
+      handle->subpixel_steps = 0;
+      break;
+    default:
+      handle->subpixel_steps = 4;
+    }
+
+    handle->subpixel_lookups = 0;
+    handle->subpixel_hits    = 0;
+
+    if ( handle->subpixel_steps )
+      snprintf( status.header_buffer, sizeof ( status.header_buffer ),
+                "subpixel positions quantized to 1/%d pixel",
+                handle->subpixel_steps );
+    else
+      snprintf( status.header_buffer, sizeof ( status.header_buffer ),
+                "subpixel positions are now exact" );
+    status.header = status.header_buffer;
+  }
+
+
   static void
   event_color_change( void )
   {
@@ -498,6 +530,19 @@
   }
 
 
+  /* the advances suffice for layout unless the side bearing */
+  /* deltas are needed for kerning or subpixel positioning    */
+  static void
+  string_load( void )
+  {
+    status.sc.layout_only =
+      status.sc.kerning_mode != KERNING_MODE_SMART       &&
+      handle->lcd_mode       != LCD_MODE_LIGHT_SUBPIXEL;
+
+    FTDemo_String_Load( handle, &status.sc );
+  }
+
+
   static int
   Process_Event( void )
   {
@@ -551,7 +596,7 @@
 
 
         FTDemo_Version( handle, str );
-        FTDemo_Display_Print( display, "ftstring.png", str );
+        FTDemo_Display_Snapshot( display, "ftstring", str );
       }
       goto Exit;
 
@@ -592,6 +637,15 @@
       sc->kerning_degree = ( sc->kerning_degree + 1 ) % N_KERNING_DEGREES;
       goto String;
 
+    case grKEY( 'x' ):
+      event_subpixel_change();
+      goto Exit;
+
+    case grKEY( '#' ):
+      handle->show_stats = !handle->show_stats;
+      handle->stats_used = 1;
+      goto Exit;
+
     case grKeySpace:
       event_color_change();
       goto Exit;
@@ -606,7 +660,7 @@
       status.header = sc->vertical
                       ? "using vertical layout"
                       : "using horizontal layout";
-      goto Exit;
+      goto String;
 
     case grKEY( 'g' ):
       FTDemo_Display_Gamma_Change( display,  1 );
@@ -649,7 +703,7 @@
     FTDemo_Update_Current_Flags( handle );
 
   String:
-    FTDemo_String_Load( handle, &status.sc );
+    string_load();
 
   Exit:
     return ret;
@@ -680,6 +734,20 @@
                        display->bitmap->width / 2 - 4 * x, 2 * HEADER_HEIGHT,
                        kern, display->fore_color );
 
+    /* subpixel bitmap cache efficiency */
+    if ( handle->lcd_mode == LCD_MODE_LIGHT_SUBPIXEL &&
+         handle->subpixel_steps                      &&
+         handle->subpixel_lookups                    )
+    {
+      x = sprintf( kern, "1/%d px, %lu%% hits",
+                   handle->subpixel_steps,
+                   handle->subpixel_hits * 100 / handle->subpixel_lookups );
+
+      grWriteCellString( display->bitmap,
+                         display->bitmap->width - 8 * x, 3 * HEADER_HEIGHT,
+                         kern, display->fore_color );
+    }
+
     if ( status.header )
     {
       grWriteCellString( display->bitmap, 0, 3 * HEADER_HEIGHT,
@@ -956,7 +1024,7 @@
   Render_KernCmp( void )
   {
     FT_Size                size;
-    FTDemo_String_Context  sc = { 0, 0, 0, 0, NULL, 0, 0 };
+    FTDemo_String_Context  sc = { 0, 0, 0, 0, NULL, 0, 0, 0 };
     FT_Int                 x, y;
     FT_Int                 height;
 
@@ -1050,7 +1118,7 @@
     event_font_change( 0 );
     FTDemo_String_Set( handle, status.text );
     FTDemo_Update_Current_Flags( handle );
-    FTDemo_String_Load( handle, &status.sc );
+    string_load();
 
     do
     {
@@ -1085,6 +1153,8 @@
 
     printf( "Execution completed successfully.\n" );
 
+    FTDemo_Stats_Print( handle );
+
     FTDemo_Display_Done( display );
     FTDemo_Done( handle );
     exit( 0 );      /* for safety reasons */
@@ -0,0 +1,301 @@
+/****************************************************************************/
+/*                                                                          */
+/*  The FreeType project -- a free and portable quality font engine         */
+/*                                                                          */
+/*  Copyright (C) 2023 by                                                   */
+/*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
+/*                                                                          */
+/*  ftsvgbench                                                              */
+/*                                                                          */
+/*  Render all OT-SVG glyphs of a font on several threads at once, each     */
+/*  thread using its own library, to stress the librsvg port.               */
+/*                                                                          */
+/****************************************************************************/
+
+#include <ft2build.h>
+#include <freetype/freetype.h>
+#include <freetype/ftmodapi.h>
+
+#include "mlgetopt.h"
+#include "rsvg-port.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#define SVGBENCH_THREADS
+#include <pthread.h>
+#endif
+
+
+  /* per-thread results */
+  typedef struct  Worker_
+  {
+    int            index;
+    unsigned long  rendered;
+    unsigned long  errors;
+    unsigned long  checksum;  /* sum of bitmap hashes, order-independent */
+
+  } Worker;
+
+
+  static const char*  font_name;
+  static int          pixel_size = 64;
+  static int          repeat     = 1;
+  static int          jobs       = 1;
+
+
+  static void
+  Usage( char*  name )
+  {
+    printf( "ftsvgbench: OT-SVG rendering stress test -- part of the FreeType project\n" );
+    printf( "------------------------------------------------------------------------\n" );
+    printf( "\n" );
+    printf( "Usage: %s [options] fontname\n", name );
+    printf( "\n" );
+    printf( "  -b N    Set the document cache budget to N bytes.\n" );
+#ifdef SVGBENCH_THREADS
+    printf( "  -j N    Use N threads (default: 1).\n" );
+#endif
+    printf( "  -r N    Render all glyphs N times per thread (default: 1).\n" );
+    printf( "  -s N    Use pixel size N (default: 64).\n" );
+    printf( "\n" );
+
+    exit( 1 );
+  }
+
+
+  static double
+  get_time( void )
+  {
+#if defined CLOCK_MONOTONIC
+    struct timespec  tv;
+
+
+    clock_gettime( CLOCK_MONOTONIC, &tv );
+
+    return tv.tv_sec + 1e-9 * tv.tv_nsec;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+  }
+
+
+  static unsigned long
+  hash_bitmap( const FT_Bitmap*  bitmap,
+               FT_UInt           gindex )
+  {
+    const unsigned char*  row  = bitmap->buffer;
+    unsigned long         hash = 2166136261UL ^ gindex;
+    unsigned int          y, x;
+
+
+    for ( y = 0; y < bitmap->rows; y++, row += bitmap->pitch )
+      for ( x = 0; x < (unsigned int)bitmap->pitch; x++ )
+      {
+        hash ^= row[x];
+        hash *= 16777619UL;
+      }
+
+    return hash & 0xFFFFFFFFUL;
+  }
+
+
+  /* Render all glyphs `repeat' times, starting at a different glyph */
+  /* in each thread so that threads work on different documents.     */
+  static void*
+  Run( void*  arg )
+  {
+    Worker*     w = (Worker*)arg;
+    FT_Library  library;
+    FT_Face     face;
+    FT_Long     num_glyphs, start, i;
+    int         r;
+
+
+    if ( FT_Init_FreeType( &library ) )
+      return NULL;
+
+    FT_Property_Set( library, "ot-svg", "svg-hooks", &rsvg_hooks );
+
+    if ( FT_New_Face( library, font_name, 0, &face ) )
+      goto Exit;
+
+    if ( FT_Set_Pixel_Sizes( face, 0, (FT_UInt)pixel_size ) )
+      goto Done;
+
+    num_glyphs = face->num_glyphs;
+    start      = num_glyphs * w->index / jobs;
+
+    for ( r = 0; r < repeat; r++ )
+      for ( i = 0; i < num_glyphs; i++ )
+      {
+        FT_UInt  gindex = (FT_UInt)( ( start + i ) % num_glyphs );
+
+
+        if ( FT_Load_Glyph( face, gindex, FT_LOAD_COLOR | FT_LOAD_RENDER ) )
+          w->errors++;
+        else
+        {
+          w->rendered++;
+
+          /* count each glyph once per thread */
+          if ( r == 0 )
+            w->checksum += hash_bitmap( &face->glyph->bitmap, gindex );
+        }
+      }
+
+  Done:
+    FT_Done_Face( face );
+  Exit:
+    FT_Done_FreeType( library );
+
+    return NULL;
+  }
+
+
+  int
+  main( int     argc,
+        char**  argv )
+  {
+    char*          execname = argv[0];
+    int            option;
+    int            i;
+    int            mismatch = 0;
+    Worker*        workers;
+    unsigned long  rendered = 0;
+    unsigned long  errors   = 0;
+    double         t;
+
+#ifdef HAVE_LIBRSVG
+    FT_ULong  hits, misses;
+#endif
+#ifdef SVGBENCH_THREADS
+    pthread_t*  threads;
+    int         n_threads = 0;
+#endif
+
+
+    while ( 1 )
+    {
+      option = getopt( argc, argv, "b:j:r:s:" );
+
+      if ( option == -1 )
+        break;
+
+      switch ( option )
+      {
+      case 'b':
+#ifdef HAVE_LIBRSVG
+        rsvg_port_set_cache_budget( strtoul( optarg, NULL, 10 ) );
+#endif
+        break;
+
+#ifdef SVGBENCH_THREADS
+      case 'j':
+        jobs = atoi( optarg );
+        if ( jobs < 1 )
+          jobs = 1;
+        break;
+#endif
+
+      case 'r':
+        repeat = atoi( optarg );
+        if ( repeat < 1 )
+          repeat = 1;
+        break;
+
+      case 's':
+        pixel_size = atoi( optarg );
+        if ( pixel_size < 1 )
+          pixel_size = 1;
+        break;
+
+      default:
+        Usage( execname );
+        break;
+      }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if ( argc != 1 )
+      Usage( execname );
+
+    font_name = argv[0];
+
+    if ( !rsvg_hooks.preset_slot )
+    {
+      fprintf( stderr, "%s: compiled without librsvg\n", execname );
+      exit( 1 );
+    }
+
+    workers = (Worker*)calloc( (size_t)jobs, sizeof ( Worker ) );
+    if ( !workers )
+    {
+      fprintf( stderr, "%s: out of memory\n", execname );
+      exit( 1 );
+    }
+
+    for ( i = 0; i < jobs; i++ )
+      workers[i].index = i;
+
+    t = get_time();
+
+#ifdef SVGBENCH_THREADS
+    threads = (pthread_t*)malloc( (size_t)jobs * sizeof ( pthread_t ) );
+    if ( threads )
+      for ( ; n_threads < jobs; n_threads++ )
+        if ( pthread_create( &threads[n_threads], NULL,
+                             Run, workers + n_threads ) )
+          break;
+
+    /* run what could not be started in this thread */
+    for ( i = n_threads; i < jobs; i++ )
+      Run( workers + i );
+
+    for ( i = 0; i < n_threads; i++ )
+      pthread_join( threads[i], NULL );
+
+    free( threads );
+#else
+    for ( i = 0; i < jobs; i++ )
+      Run( workers + i );
+#endif
+
+    t = get_time() - t;
+
+    for ( i = 0; i < jobs; i++ )
+    {
+      rendered += workers[i].rendered;
+      errors   += workers[i].errors;
+
+      if ( workers[i].checksum != workers[0].checksum ||
+           workers[i].rendered != workers[0].rendered )
+        mismatch = 1;
+    }
+
+    printf( "threads          = %d\n", jobs );
+    printf( "rendered glyphs  = %lu\n", rendered );
+    printf( "errors           = %lu\n", errors );
+    printf( "time             = %f s\n", t );
+    printf( "glyphs/s         = %f\n", t > 0 ? rendered / t : 0.0 );
+#ifdef HAVE_LIBRSVG
+    rsvg_port_get_cache_stats( &hits, &misses );
+    printf( "cache hits       = %lu\n", hits );
+    printf( "cache misses     = %lu\n", misses );
+#endif
+    printf( "checksum         = %08lx%s\n",
+            workers[0].checksum & 0xFFFFFFFFUL,
+            mismatch ? " (threads disagree!)" : "" );
+
+    free( workers );
+
+    return mismatch;
+  }
+
+
+/* End */
@@ -26,7 +26,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>    /* for clock() */
+#include <time.h>    /* for clock() and clock_gettime() */
+
+#include "strbuf.h"
 
   /* SunOS 4.1.* does not define CLOCKS_PER_SEC, so include <sys/param.h> */
   /* to get the HZ macro which is the equivalent.                         */
@@ -37,6 +39,10 @@
 
 #define CHARSIZE    400   /* character point size */
 #define MAX_GLYPHS  512   /* Maximum number of glyphs rendered at one time */
+#define MAX_SIZES   64    /* Maximum number of sizes in a sweep */
+
+  /* outline complexity classes: <16, <32, <64, <128, <256, >=256 points */
+#define NUM_BUCKETS  6
 
   char  Header[128];
 
@@ -47,11 +53,14 @@
 
   int         num_glyphs;
   FT_Glyph    glyphs[MAX_GLYPHS];
+  int         glyph_points[MAX_GLYPHS];
+  int         glyph_contours[MAX_GLYPHS];
 
   int         tab_glyphs;
   int         cur_glyph;
 
-  int         pixel_size   = CHARSIZE;
+  int         pixel_sizes[MAX_SIZES] = { CHARSIZE };
+  int         num_sizes    = 1;
   int         repeat_count = 1;
 
   int         Fail;
@@ -59,6 +68,42 @@
 
   short       antialias = 1; /* smooth fonts with gray levels  */
   short       force_low;
+  short       json;          /* print JSON lines instead of text */
+
+
+  /* render modes that can be benchmarked */
+  static const struct
+  {
+    const char*     name;
+    FT_Render_Mode  mode;
+
+  } render_modes[] =
+  {
+    { "mono",  FT_RENDER_MODE_MONO },
+    { "gray",  FT_RENDER_MODE_NORMAL },
+    { "light", FT_RENDER_MODE_LIGHT },
+    { "lcd",   FT_RENDER_MODE_LCD },
+    { "lcdv",  FT_RENDER_MODE_LCD_V },
+    { "sdf",   FT_RENDER_MODE_SDF },
+  };
+#define NUM_RENDER_MODES \
+          (int)( sizeof ( render_modes ) / sizeof ( render_modes[0] ) )
+
+
+  /* rendering statistics of a set of glyphs */
+  typedef struct  Stats_
+  {
+    long    glyphs;    /* successfully rendered glyphs  */
+    long    points;
+    long    contours;
+    double  time;      /* in seconds                    */
+    double  pixels;    /* bitmap area                   */
+    double  spans;     /* horizontal runs of ink pixels */
+
+  } Stats;
+
+  Stats  total;
+  Stats  buckets[NUM_BUCKETS];
 
 
   static void
@@ -73,14 +118,24 @@
   /*                                                                 */
   /*  Get_Time:                                                      */
   /*                                                                 */
-  /*    Returns the current time in milliseconds.                    */
+  /*    Returns the current time in seconds, using a high-resolution */
+  /*    monotonic clock if available since single glyphs are timed.  */
   /*                                                                 */
   /*******************************************************************/
 
-  static long
+  static double
   Get_Time( void )
   {
-    return clock() * 10000 / CLOCKS_PER_SEC;
+#if defined CLOCK_MONOTONIC
+    struct timespec  tv;
+
+
+    clock_gettime( CLOCK_MONOTONIC, &tv );
+
+    return tv.tv_sec + 1e-9 * tv.tv_nsec;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
   }
 
 
@@ -102,38 +157,127 @@
     error = FT_Load_Glyph( face, idx, FT_LOAD_DEFAULT ) ||
             FT_Get_Glyph ( face->glyph, &glyph );
     if ( !error )
-      glyphs[cur_glyph++] = glyph;
+    {
+      glyph_points  [cur_glyph] = face->glyph->outline.n_points;
+      glyph_contours[cur_glyph] = face->glyph->outline.n_contours;
+      glyphs        [cur_glyph] = glyph;
+      cur_glyph++;
+    }
 
     return error;
   }
 
 
+  /*******************************************************************/
+  /*                                                                 */
+  /*  Count_Spans:                                                   */
+  /*                                                                 */
+  /*    Counts the horizontal runs of non-zero pixels in a bitmap.   */
+  /*                                                                 */
+  /*******************************************************************/
+
+  static long
+  Count_Spans( const FT_Bitmap*  bitmap )
+  {
+    const unsigned char*  row   = bitmap->buffer;
+    int                   pitch = bitmap->pitch;
+    long                  spans = 0;
+    unsigned int          x, y;
+
+
+    if ( pitch < 0 )
+      pitch = -pitch;
+
+    for ( y = 0; y < bitmap->rows; y++, row += pitch )
+    {
+      int  in = 0;
+
+
+      for ( x = 0; x < bitmap->width; x++ )
+      {
+        int  on = bitmap->pixel_mode == FT_PIXEL_MODE_MONO
+                    ? row[x >> 3] & ( 0x80 >> ( x & 7 ) )
+                    : row[x];
+
+
+        if ( on && !in )
+          spans++;
+        in = on != 0;
+      }
+    }
+
+    return spans;
+  }
+
+
   /*******************************************************************/
   /*                                                                 */
   /*  ConvertRaster:                                                 */
   /*                                                                 */
-  /*    Performs scan conversion.                                    */
+  /*    Performs scan conversion and accounts for it.  The bitmap    */
+  /*    area and spans are only measured when `measure' is set.      */
   /*                                                                 */
   /*******************************************************************/
 
   static FT_Error
-  ConvertRaster( int  idx )
+  ConvertRaster( int             idx,
+                 FT_Render_Mode  mode,
+                 int             measure )
   {
     FT_Glyph  bitmap;
+    Stats*    bucket;
+    double    t;
+    int       b;
+
 
+    for ( b = 0;
+          b < NUM_BUCKETS - 1 && glyph_points[idx] >= 16 << b;
+          b++ )
+      ;
+    bucket = buckets + b;
 
     bitmap = glyphs[idx];
     if ( bitmap->format == FT_GLYPH_FORMAT_BITMAP )
       error = 0;  /* we already have a (embedded) bitmap */
     else
     {
-      error = FT_Glyph_To_Bitmap( &bitmap,
-                                  antialias ? FT_RENDER_MODE_NORMAL
-                                            : FT_RENDER_MODE_MONO,
-                                  0,
-                                  0 );
-      if ( !error )
-        FT_Done_Glyph( bitmap );
+      t     = Get_Time();
+      error = FT_Glyph_To_Bitmap( &bitmap, mode, 0, 0 );
+      t     = Get_Time() - t;
+
+      if ( error )
+        return error;
+
+      total.time   += t;
+      bucket->time += t;
+
+      if ( measure )
+      {
+        FT_Bitmap*  map = &( (FT_BitmapGlyph)bitmap )->bitmap;
+        double      pixels, spans;
+
+
+        pixels = (double)map->width * map->rows * repeat_count;
+        spans  = (double)Count_Spans( map ) * repeat_count;
+
+        total.pixels   += pixels;
+        total.spans    += spans;
+        bucket->pixels += pixels;
+        bucket->spans  += spans;
+      }
+
+      FT_Done_Glyph( bitmap );
+    }
+
+    total.glyphs++;
+    bucket->glyphs++;
+
+    if ( measure )
+    {
+      total.points     += glyph_points[idx];
+      total.contours   += glyph_contours[idx];
+      bucket->points   += glyph_points[idx];
+      bucket->contours += glyph_contours[idx];
     }
 
     return error;
@@ -148,8 +292,12 @@
     fprintf( stderr, "Usage: fttimer [options] fontname[.ttf|.ttc]\n\n" );
     fprintf( stderr, "options:\n");
     fprintf( stderr, "   -r : repeat count to be used (default is 1)\n" );
-    fprintf( stderr, "   -s : character pixel size (default is 600)\n" );
+    fprintf( stderr, "   -s : character pixel size (default is 400), or a comma-separated\n"
+                     "        list of sizes and ranges with step, e.g., `8-72:8,96'\n" );
     fprintf( stderr, "   -m : render monochrome glyphs (default is anti-aliased)\n" );
+    fprintf( stderr, "   -M : comma-separated list of render modes to benchmark:\n"
+                     "        mono, gray, light, lcd, lcdv, sdf\n" );
+    fprintf( stderr, "   -J : print one JSON object per size and render mode\n" );
     fprintf( stderr, "   -a : use smooth anti-aliaser\n" );
     fprintf( stderr, "   -l : force low quality even at small sizes\n" );
 
@@ -157,14 +305,273 @@
   }
 
 
+  /* Parse a list like `8-72:8,96' into `pixel_sizes'. */
+  static int
+  Parse_Sizes( const char*  list )
+  {
+    char*  end;
+
+
+    num_sizes = 0;
+
+    for (;;)
+    {
+      long  a, b, step = 1;
+
+
+      a = strtol( list, &end, 10 );
+      if ( end == list )
+        return 0;
+      b    = a;
+      list = end;
+
+      if ( *list == '-' )
+      {
+        b = strtol( ++list, &end, 10 );
+        if ( end == list )
+          return 0;
+        list = end;
+
+        if ( *list == ':' )
+        {
+          step = strtol( ++list, &end, 10 );
+          if ( end == list || step < 1 )
+            return 0;
+          list = end;
+        }
+      }
+
+      if ( a < 1 || b < a || b > 0xFFFF )
+        return 0;
+
+      for ( ; a <= b; a += step )
+      {
+        if ( num_sizes == MAX_SIZES )
+          return 0;
+        pixel_sizes[num_sizes++] = (int)a;
+      }
+
+      if ( *list != ',' )
+        return *list == '\0';
+      list++;
+    }
+  }
+
+
+  /* Parse a list like `mono,gray' into a bit mask of `render_modes'. */
+  static unsigned int
+  Parse_Modes( const char*  list )
+  {
+    unsigned int  mask = 0;
+
+
+    for (;;)
+    {
+      size_t  len = strcspn( list, "," );
+      int     m;
+
+
+      for ( m = 0; m < NUM_RENDER_MODES; m++ )
+        if ( strlen( render_modes[m].name ) == len       &&
+             !strncmp( list, render_modes[m].name, len ) )
+          break;
+
+      if ( m == NUM_RENDER_MODES )
+        return 0;
+
+      mask |= 1U << m;
+
+      if ( list[len] != ',' )
+        return mask;
+      list += len + 1;
+    }
+  }
+
+
+  /* Benchmark all glyphs at the current size in render mode `mode'. */
+  static double
+  Run( FT_Render_Mode  mode )
+  {
+    int     total_glyphs, base;
+    double  tz0;
+
+
+    tab_glyphs = MAX_GLYPHS;
+    if ( tab_glyphs > num_glyphs )
+      tab_glyphs = num_glyphs;
+
+    memset( &total, 0, sizeof ( total ) );
+    memset( buckets, 0, sizeof ( buckets ) );
+
+    Num  = 0;
+    Fail = 0;
+
+    total_glyphs = num_glyphs;
+    base         = 0;
+
+    tz0 = Get_Time();
+
+    while ( total_glyphs > 0 )
+    {
+      int     repeat;
+      double  t;
+
+
+      /* First, preload 'tab_glyphs' in memory */
+      cur_glyph = 0;
+
+      if ( !json )
+        printf( "loading %d glyphs", tab_glyphs );
+
+      for ( Num = 0; Num < tab_glyphs; Num++ )
+      {
+        error = LoadChar( base + Num );
+        if ( error )
+          Fail++;
+
+        total_glyphs--;
+      }
+
+      base += tab_glyphs;
+
+      if ( tab_glyphs > total_glyphs )
+        tab_glyphs = total_glyphs;
+
+      if ( !json )
+        printf( ", rendering... " );
+
+      /* Now, render the loaded glyphs */
+
+      t = total.time;
+
+      for ( repeat = 0; repeat < repeat_count; repeat++ )
+      {
+        for ( Num = 0; Num < cur_glyph; Num++ )
+        {
+          if ( ( error = ConvertRaster( Num, mode, repeat == 0 ) ) != 0 )
+            Fail++;
+        }
+      }
+
+      if ( !json )
+        printf( " = %f s\n", total.time - t );
+
+      /* Now free all loaded outlines */
+      for ( Num = 0; Num < cur_glyph; Num++ )
+        FT_Done_Glyph( glyphs[Num] );
+    }
+
+    return Get_Time() - tz0;
+  }
+
+
+  static double
+  Rate( double  amount,
+        double  time )
+  {
+    return time > 0 ? amount / time : 0;
+  }
+
+
+  static void
+  Print_Text( double  tz0 )
+  {
+    int  b;
+
+
+    printf( "\n" );
+    printf( "rendered glyphs  = %ld\n", total.glyphs );
+    printf( "render time      = %f s\n", total.time );
+    printf( "fails            = %d\n", Fail );
+    printf( "average glyphs/s = %f\n", Rate( total.glyphs, total.time ) );
+    printf( "average pixels/s = %f\n", Rate( total.pixels, total.time ) );
+    printf( "average spans/s  = %f\n", Rate( total.spans, total.time ) );
+
+    printf( "\n" );
+    printf( "   points  glyphs  contours  us/glyph  Mpixels/s  Mspans/s\n" );
+    for ( b = 0; b < NUM_BUCKETS; b++ )
+    {
+      Stats*  s = buckets + b;
+      long    n = s->glyphs / repeat_count;  /* distinct glyphs */
+
+
+      if ( !s->glyphs )
+        continue;
+
+      if ( b < NUM_BUCKETS - 1 )
+        printf( "  %3d-%-4d", b ? 16 << ( b - 1 ) : 0, ( 16 << b ) - 1 );
+      else
+        printf( "  %4d+   ", 16 << ( b - 1 ) );
+
+      printf( "%6ld  %8.1f  %8.2f  %9.3f  %8.3f\n",
+              n,
+              n ? (double)s->contours / n : 0.0,
+              1e6 * Rate( s->time, s->glyphs ),
+              1e-6 * Rate( s->pixels, s->time ),
+              1e-6 * Rate( s->spans, s->time ) );
+    }
+
+    printf( "\n" );
+    printf( "total timing     = %f s\n", tz0 );
+    printf( "Fails = %d\n", Fail );
+  }
+
+
+  static void
+  Print_JSON( const char*  filename,
+              int          pixel_size,
+              const char*  mode_name,
+              double       tz0 )
+  {
+    char    file[6 * 1028 + 3];  /* fully escaped `filename' in quotes */
+    StrBuf  sb;
+    int     b;
+
+
+    file[0] = '\0';
+    STRBUF_INIT_FROM_ARRAY( &sb, file );
+    strbuf_add_json( &sb, filename );
+
+    printf( "{\"file\":%s,\"size\":%d,\"mode\":\"%s\",\"repeat\":%d"
+            ",\"glyphs\":%ld,\"fails\":%d,\"time\":%.6f,\"total_time\":%.6f"
+            ",\"glyphs_per_s\":%.1f,\"pixels_per_s\":%.1f"
+            ",\"spans_per_s\":%.1f,\"buckets\":[",
+            strbuf_value( &sb ), pixel_size, mode_name, repeat_count,
+            total.glyphs, Fail, total.time, tz0,
+            Rate( total.glyphs, total.time ),
+            Rate( total.pixels, total.time ),
+            Rate( total.spans, total.time ) );
+
+    for ( b = 0; b < NUM_BUCKETS; b++ )
+    {
+      Stats*  s = buckets + b;
+
+
+      printf( "%s{\"min_points\":%d,\"max_points\":",
+              b ? "," : "", b ? 16 << ( b - 1 ) : 0 );
+      if ( b < NUM_BUCKETS - 1 )
+        printf( "%d", ( 16 << b ) - 1 );
+      else
+        printf( "null" );
+
+      printf( ",\"glyphs\":%ld,\"points\":%ld,\"contours\":%ld"
+              ",\"time\":%.6f,\"pixels\":%.0f,\"spans\":%.0f}",
+              s->glyphs / repeat_count, s->points, s->contours,
+              s->time, s->pixels, s->spans );
+    }
+
+    printf( "]}\n" );
+  }
+
+
   int
   main( int     argc,
         char**  argv )
   {
-    int    i, total, base, rendered_glyphs;
-    char   filename[1024 + 4];
-
-    long   t, t0, tz0;
+    int           i, m;
+    int           first = 1;
+    char          filename[1024 + 4];
+    unsigned int  modes = 0;
 
 
     antialias = 1;
@@ -182,11 +589,21 @@
         force_low = 1;
         break;
 
+      case 'J':
+        json = 1;
+        break;
+
       case 's':
         argc--;
         argv++;
-        if ( argc < 2 ||
-             sscanf( argv[1], "%d", &pixel_size ) != 1 )
+        if ( argc < 2 || !Parse_Sizes( argv[1] ) )
+          Usage();
+        break;
+
+      case 'M':
+        argc--;
+        argv++;
+        if ( argc < 2 || !( modes = Parse_Modes( argv[1] ) ) )
           Usage();
         break;
 
@@ -213,6 +630,10 @@
     if ( argc != 2 )
       Usage();
 
+    /* without `-M', option `-m' selects between the two classic modes */
+    if ( !modes )
+      modes = 1U << ( antialias ? 1 : 0 );
+
     i = strlen( argv[1] );
     while ( i > 0 && argv[1][i] != '\\' )
     {
@@ -237,99 +658,46 @@
     else if ( error )
       Panic( "Error while opening font resource" );
 
-    /* get face properties and allocate preload arrays */
+    /* get face properties */
 
     num_glyphs = face->num_glyphs;
 
-    tab_glyphs = MAX_GLYPHS;
-    if ( tab_glyphs > num_glyphs )
-      tab_glyphs = num_glyphs;
-
-    /* create size */
-
-    error = FT_Set_Pixel_Sizes( face, pixel_size, pixel_size );
-    if ( error )
-      Panic( "Could not reset instance" );
-
-    Num  = 0;
-    Fail = 0;
-
-    total = num_glyphs;
-    base  = 0;
-
-    rendered_glyphs = 0;
-
-    t0 = 0;  /* Initial time */
-
-    tz0 = Get_Time();
-
-    while ( total > 0 )
+    for ( i = 0; i < num_sizes; i++ )
     {
-      int  repeat;
-
-
-      /* First, preload 'tab_glyphs' in memory */
-      cur_glyph = 0;
+      /* create size */
 
-      printf( "loading %d glyphs", tab_glyphs );
+      error = FT_Set_Pixel_Sizes( face, pixel_sizes[i], pixel_sizes[i] );
+      if ( error )
+        Panic( "Could not reset instance" );
 
-      for ( Num = 0; Num < tab_glyphs; Num++ )
+      for ( m = 0; m < NUM_RENDER_MODES; m++ )
       {
-        error = LoadChar( base + Num );
-        if ( error )
-          Fail++;
+        double  tz0;
 
-        total--;
-      }
 
-      base += tab_glyphs;
+        if ( !( modes & ( 1U << m ) ) )
+          continue;
 
-      if ( tab_glyphs > total )
-        tab_glyphs = total;
-
-      printf( ", rendering... " );
-
-      /* Now, render the loaded glyphs */
-
-      t = Get_Time();
-
-      for ( repeat = 0; repeat < repeat_count; repeat++ )
-      {
-        for ( Num = 0; Num < cur_glyph; Num++ )
+        /* label the runs of a sweep */
+        if ( !json && ( num_sizes > 1 || ( modes & ( modes - 1 ) ) ) )
         {
-          if ( ( error = ConvertRaster( Num ) ) != 0 )
-            Fail++;
-          else
-            rendered_glyphs++;
+          printf( "%s=== %d px, %s ===\n",
+                  first ? "" : "\n",
+                  pixel_sizes[i], render_modes[m].name );
+          first = 0;
         }
-      }
-
-      t = Get_Time() - t;
-      if ( t < 0 )
-        t += 1000 * 60 * 60;
 
-      printf( " = %f s\n", (double)t / 10000 );
-      t0 += t;
+        tz0 = Run( render_modes[m].mode );
 
-      /* Now free all loaded outlines */
-      for ( Num = 0; Num < cur_glyph; Num++ )
-        FT_Done_Glyph( glyphs[Num] );
+        if ( json )
+          Print_JSON( filename, pixel_sizes[i], render_modes[m].name, tz0 );
+        else
+          Print_Text( tz0 );
+      }
     }
 
-    tz0 = Get_Time() - tz0;
-
     FT_Done_Face( face );
 
-    printf( "\n" );
-    printf( "rendered glyphs  = %d\n", rendered_glyphs );
-    printf( "render time      = %f s\n", (double)t0 / 10000 );
-    printf( "fails            = %d\n", Fail );
-    printf( "average glyphs/s = %f\n",
-            (double)rendered_glyphs / t0 * 10000 );
-
-    printf( "total timing     = %f s\n", (double)tz0 / 10000 );
-    printf( "Fails = %d\n", Fail );
-
     FT_Done_FreeType( library );
 
     exit( 0 );      /* for safety reasons */
@@ -36,6 +36,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
+
+#ifndef _WIN32
+#define VALID_THREADS
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 
   static const char*  execname;
@@ -87,6 +95,13 @@
   };
 #define N_GX_TABLE_SPEC  ( sizeof ( gx_table_spec ) / sizeof ( TableSpecRec ) )
 
+  /* the classic kern validator checks a single table */
+  static TableSpecRec  ckern_table_spec[] =
+  {
+    { TTAG_kern, 1 },
+  };
+#define N_CKERN_TABLE_SPEC  1
+
 
   typedef struct  ValidatorRec_
   {
@@ -226,8 +241,9 @@
       "\n" );
     fprintf( stderr,
       "Usage: %s [options] fontfile\n"
+      "       %s -C [options] file_or_directory...\n"
       "\n",
-             execname );
+             execname, execname );
 
     fprintf( stderr,
       "Options:\n"
@@ -237,6 +253,19 @@
       "  -f index      Select font index (default: 0).\n"
       "\n" );
 
+    fprintf( stderr,
+      "  -C            Corpus mode: validate all faces of all given files,\n"
+      "                searching directories recursively, and print one\n"
+      "                tab-separated result line per face and validator.\n"
+      "                Option `-t' accepts a `:'-separated list here.\n"
+      "\n" );
+
+#ifdef VALID_THREADS
+    fprintf( stderr,
+      "  -j N          Use N threads in corpus mode (default: 1).\n"
+      "\n" );
+#endif
+
     fprintf( stderr,
       "  -t validator  Select validator.\n"
       "                Available validators:\n"
@@ -669,6 +698,25 @@
   }
 
 
+  static FT_UInt
+  parse_ckern_dialect( const char*  dialect_request )
+  {
+    if ( dialect_request == NULL                      ||
+         strcmp( dialect_request, "ms:apple" ) == 0 ||
+         strcmp( dialect_request, "apple:ms" ) == 0 )
+      return FT_VALIDATE_MS | FT_VALIDATE_APPLE;
+    else if ( strcmp( dialect_request, "ms" ) == 0 )
+      return FT_VALIDATE_MS;
+    else if ( strcmp( dialect_request, "apple" ) == 0 )
+      return FT_VALIDATE_APPLE;
+
+    fprintf( stderr, "Wrong classic kern dialect: %s\n", dialect_request );
+    print_usage( NULL );
+
+    return 0;
+  }
+
+
   static FT_Error
   run_ckern_validator( FT_Face      face,
                        const char*  dialect_request,
@@ -679,24 +727,11 @@
     FT_Bytes   data;
 
 
-    if ( dialect_request == NULL )
-      dialect_request = "ms:apple";
-
-
     validation_flags  = (FT_UInt)validation_level;
+    validation_flags |= parse_ckern_dialect( dialect_request );
 
-    if ( strcmp( dialect_request, "ms:apple" ) == 0 ||
-         strcmp( dialect_request, "apple:ms" ) == 0 )
-      validation_flags |= FT_VALIDATE_MS | FT_VALIDATE_APPLE;
-    else if ( strcmp( dialect_request, "ms" ) == 0 )
-      validation_flags |= FT_VALIDATE_MS;
-    else if ( strcmp( dialect_request, "apple" ) == 0 )
-      validation_flags |= FT_VALIDATE_APPLE;
-    else
-    {
-      fprintf( stderr, "Wrong classic kern dialect: %s\n", dialect_request );
-      print_usage( NULL );
-    }
+    if ( dialect_request == NULL )
+      dialect_request = "ms:apple";
 
     printf( "[%s:%s] validation targets: %s...",
             execname, validators[validator].symbol, dialect_request );
@@ -731,6 +766,477 @@
     return 0;
   }
 
+  /*
+   * Corpus mode
+   */
+
+  /* The result lines of one font file. */
+  typedef struct  CorpusFileRec_
+  {
+    const char*  fname;
+    char*        text;
+    size_t       length;
+    size_t       size;
+    int          faces;
+    int          failed;
+    int          errors;
+    int          done;
+
+  } CorpusFileRec, *CorpusFile;
+
+
+  static CorpusFile  corpus;
+  static size_t      corpus_count;
+  static size_t      corpus_max;
+
+  static unsigned int  corpus_validators;  /* bit mask of validator types */
+  static const char*   corpus_tables;
+  static int           corpus_level;
+
+
+  static void
+  corpus_printf( CorpusFile   file,
+                 const char*  format,
+                 ... )
+  {
+    va_list  ap;
+    int      n;
+
+
+    for (;;)
+    {
+      if ( file->size > file->length )
+      {
+        va_start( ap, format );
+        n = vsnprintf( file->text + file->length, file->size - file->length,
+                       format, ap );
+        va_end( ap );
+
+        if ( n < 0 )
+          return;
+
+        if ( (size_t)n < file->size - file->length )
+        {
+          file->length += (size_t)n;
+          return;
+        }
+      }
+
+      file->size = 2 * file->size + 1024;
+      file->text = (char*)realloc( file->text, file->size );
+      if ( !file->text )
+        panic( FT_Err_Out_Of_Memory, "Out of memory." );
+    }
+  }
+
+
+  static void
+  corpus_print_tables( CorpusFile          file,
+                       FT_UInt             validation_flags,
+                       const TableSpecRec  spec[],
+                       int                 spec_count )
+  {
+    int   i;
+    int   n_print;
+    char  tag[4];
+
+
+    for ( i = 0, n_print = 0; i < spec_count; i++ )
+    {
+      if ( spec[i].validation_flag & validation_flags )
+      {
+        corpus_printf( file, "%s%.4s",
+                       n_print ? ":" : "",
+                       make_tag_chararray( tag, spec[i].tag ) );
+        n_print++;
+      }
+    }
+
+    if ( !n_print )
+      corpus_printf( file, "-" );
+  }
+
+
+  /* Run validator `type' without printing anything.  Return the flags */
+  /* of the validated tables and set `*failed' to the failing ones.    */
+  static FT_UInt
+  corpus_validate( FT_Face        face,
+                   ValidatorType  type,
+                   FT_UInt*       failed )
+  {
+    FT_Error      error;
+    FT_UInt       targets;
+    unsigned int  i;
+
+
+    *failed = 0;
+
+    switch ( type )
+    {
+    case OT_VALIDATE:
+      {
+        FT_Bytes  data[N_OT_TABLE_SPEC];
+
+
+        targets = make_table_specs( face, corpus_tables, ot_table_spec,
+                                    N_OT_TABLE_SPEC );
+        if ( !targets )
+          return 0;
+
+        for ( i = 0; i < N_OT_TABLE_SPEC; i++ )
+          data[i] = NULL;
+
+        error = FT_OpenType_Validate(
+                  face,
+                  targets | (FT_UInt)corpus_level,
+                  &data[0], &data[1], &data[2], &data[3], &data[4] );
+
+        /* `MATH' is validated but not returned; blame it only */
+        /* if the error cannot be attributed to another table  */
+        for ( i = 0; i < N_OT_TABLE_SPEC; i++ )
+        {
+          if ( ot_table_spec[i].tag == TTAG_MATH )
+            continue;
+
+          if ( ( ot_table_spec[i].validation_flag & targets ) && !data[i] )
+            *failed |= ot_table_spec[i].validation_flag;
+
+          FT_OpenType_Free( face, data[i] );
+        }
+
+        if ( error && !*failed )
+          *failed = targets & FT_VALIDATE_MATH;
+      }
+      break;
+
+    case GX_VALIDATE:
+      {
+        FT_Bytes  data[N_GX_TABLE_SPEC];
+
+
+        targets = make_table_specs( face, corpus_tables, gx_table_spec,
+                                    N_GX_TABLE_SPEC );
+        if ( !targets )
+          return 0;
+
+        for ( i = 0; i < N_GX_TABLE_SPEC; i++ )
+          data[i] = NULL;
+
+        (void)FT_TrueTypeGX_Validate( face,
+                                      targets | (FT_UInt)corpus_level,
+                                      data,
+                                      N_GX_TABLE_SPEC );
+
+        for ( i = 0; i < N_GX_TABLE_SPEC; i++ )
+        {
+          if ( ( gx_table_spec[i].validation_flag & targets ) && !data[i] )
+            *failed |= gx_table_spec[i].validation_flag;
+
+          FT_TrueTypeGX_Free( face, data[i] );
+        }
+      }
+      break;
+
+    default:
+      {
+        FT_Bytes  data;
+
+
+        error = FT_ClassicKern_Validate(
+                  face,
+                  parse_ckern_dialect( corpus_tables ) |
+                    (FT_UInt)corpus_level,
+                  &data );
+
+        /* no data and no error means no `kern' table */
+        targets = data || error ? 1 : 0;
+        *failed = data ? 0 : targets;
+
+        FT_ClassicKern_Free( face, data );
+      }
+      break;
+    }
+
+    return targets;
+  }
+
+
+  static void
+  corpus_run_file( FT_Library  library,
+                   CorpusFile  file )
+  {
+    FT_Face   face;
+    FT_Error  error;
+    FT_Long   face_index, num_faces = 1;
+
+
+    for ( face_index = 0; face_index < num_faces; face_index++ )
+    {
+      int  i, face_failed;
+
+
+      error = FT_New_Face( library, file->fname, face_index, &face );
+      if ( error )
+      {
+        corpus_printf( file, "%s\t%ld\t-\terror\t0x%04x\n",
+                       file->fname, face_index, error );
+        file->errors++;
+
+        /* without the first face, the number of faces is unknown */
+        if ( face_index == 0 )
+          return;
+        continue;
+      }
+
+      num_faces = face->num_faces;
+      file->faces++;
+
+      face_failed = 0;
+
+      for ( i = 0; i < LAST_VALIDATE; i++ )
+      {
+        Validator  v = &validators[i];
+        FT_UInt    targets, failed;
+
+
+        if ( !( corpus_validators & ( 1U << i ) ) )
+          continue;
+
+        targets = corpus_validate( face, (ValidatorType)i, &failed );
+
+        corpus_printf( file, "%s\t%ld\t%s\t%s\t",
+                       file->fname, face_index, v->symbol,
+                       failed ? "FAIL" : "ok" );
+        if ( i == CKERN_VALIDATE )
+          corpus_print_tables( file, failed ? failed : targets,
+                               ckern_table_spec, N_CKERN_TABLE_SPEC );
+        else
+          corpus_print_tables( file, failed ? failed : targets,
+                               v->table_spec, (int)v->n_table_spec );
+        corpus_printf( file, "\n" );
+
+        if ( failed )
+          face_failed = 1;
+      }
+
+      file->failed += face_failed;
+
+      FT_Done_Face( face );
+    }
+  }
+
+
+  static void
+  corpus_add_file( const char*  fname )
+  {
+    if ( corpus_count == corpus_max )
+    {
+      corpus_max = corpus_max ? 2 * corpus_max : 64;
+      corpus     = (CorpusFile)realloc( corpus,
+                                        corpus_max * sizeof ( CorpusFileRec ) );
+      if ( !corpus )
+        panic( FT_Err_Out_Of_Memory, "Out of memory." );
+    }
+
+    memset( corpus + corpus_count, 0, sizeof ( CorpusFileRec ) );
+    corpus[corpus_count++].fname = fname;
+  }
+
+
+#ifdef VALID_THREADS
+
+  static int
+  corpus_compare_names( const void*  a,
+                        const void*  b )
+  {
+    return strcmp( *(char* const*)a, *(char* const*)b );
+  }
+
+
+  /* Queue a file, or all files below a directory in sorted order. */
+  static void
+  corpus_add_path( const char*  path )
+  {
+    struct stat     st;
+    DIR*            dir;
+    struct dirent*  entry;
+    char**          names     = NULL;
+    size_t          num_names = 0;
+    size_t          max_names = 0;
+    size_t          i;
+
+
+    if ( stat( path, &st ) || !S_ISDIR( st.st_mode ) )
+    {
+      corpus_add_file( path );
+      return;
+    }
+
+    dir = opendir( path );
+    if ( !dir )
+    {
+      corpus_add_file( path );
+      return;
+    }
+
+    while ( ( entry = readdir( dir ) ) != NULL )
+    {
+      size_t  len;
+
+
+      /* skip `.', `..', and hidden files */
+      if ( entry->d_name[0] == '.' )
+        continue;
+
+      if ( num_names == max_names )
+      {
+        max_names = max_names ? 2 * max_names : 64;
+        names     = (char**)realloc( names, max_names * sizeof ( char* ) );
+        if ( !names )
+          panic( FT_Err_Out_Of_Memory, "Out of memory." );
+      }
+
+      len              = strlen( path ) + strlen( entry->d_name ) + 2;
+      names[num_names] = (char*)malloc( len );
+      if ( !names[num_names] )
+        panic( FT_Err_Out_Of_Memory, "Out of memory." );
+      snprintf( names[num_names++], len, "%s/%s", path, entry->d_name );
+    }
+    closedir( dir );
+
+    qsort( names, num_names, sizeof ( char* ), corpus_compare_names );
+
+    /* the names are kept until exit */
+    for ( i = 0; i < num_names; i++ )
+      corpus_add_path( names[i] );
+
+    free( names );
+  }
+
+
+  static struct
+  {
+    size_t           next;
+    pthread_mutex_t  lock;
+    pthread_cond_t   done;
+
+  } pool = { 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+
+  static void*
+  corpus_worker( void*  arg )
+  {
+    FT_Library  library = NULL;
+
+
+    FT_UNUSED( arg );
+
+    /* FreeType objects must not be shared between threads; */
+    /* without a library, every file gets an error line      */
+    (void)FT_Init_FreeType( &library );
+
+    for (;;)
+    {
+      CorpusFile  file;
+
+
+      pthread_mutex_lock( &pool.lock );
+      file = pool.next < corpus_count ? corpus + pool.next++ : NULL;
+      pthread_mutex_unlock( &pool.lock );
+
+      if ( !file )
+        break;
+
+      corpus_run_file( library, file );
+
+      pthread_mutex_lock( &pool.lock );
+      file->done = 1;
+      pthread_cond_broadcast( &pool.done );
+      pthread_mutex_unlock( &pool.lock );
+    }
+
+    FT_Done_FreeType( library );
+
+    return NULL;
+  }
+
+#else /* !VALID_THREADS */
+
+  static void
+  corpus_add_path( const char*  path )
+  {
+    corpus_add_file( path );
+  }
+
+#endif /* !VALID_THREADS */
+
+
+  /* Validate all queued files and print the results in queue order */
+  /* followed by a summary line; return 1 if anything failed.        */
+  static int
+  corpus_run( FT_Library  library,
+              int         jobs )
+  {
+    size_t  i;
+    int     faces = 0, failed = 0, errors = 0;
+
+#ifdef VALID_THREADS
+    pthread_t*  threads = NULL;
+    int         n       = 0;
+
+
+    if ( jobs > 1 )
+    {
+      threads = (pthread_t*)malloc( (size_t)jobs * sizeof ( pthread_t ) );
+      if ( threads )
+        for ( n = 0; n < jobs; n++ )
+          if ( pthread_create( &threads[n], NULL, corpus_worker, NULL ) )
+            break;
+    }
+#else
+    FT_UNUSED( jobs );
+#endif
+
+    printf( "#file\tface\tvalidator\tresult\ttables\n" );
+
+    for ( i = 0; i < corpus_count; i++ )
+    {
+      CorpusFile  file = corpus + i;
+
+
+#ifdef VALID_THREADS
+      if ( n > 0 )
+      {
+        pthread_mutex_lock( &pool.lock );
+        while ( !file->done )
+          pthread_cond_wait( &pool.done, &pool.lock );
+        pthread_mutex_unlock( &pool.lock );
+      }
+      else
+#endif
+        corpus_run_file( library, file );
+
+      fwrite( file->text, 1, file->length, stdout );
+      free( file->text );
+
+      faces  += file->faces;
+      failed += file->failed;
+      errors += file->errors;
+    }
+
+#ifdef VALID_THREADS
+    while ( n-- > 0 )
+      pthread_join( threads[n], NULL );
+    free( threads );
+#endif
+
+    printf( "# %lu files, %d faces, %d failed, %d errors\n",
+            (unsigned long)corpus_count, faces, failed, errors );
+
+    return failed || errors;
+  }
+
+
   /*
    * Main driver
    */
@@ -753,6 +1259,9 @@
 
     int  font_index = 0;
 
+    int  corpus_mode = 0;
+    int  jobs        = 1;
+
 
     execname = ft_basename( argv[0] );
 
@@ -774,7 +1283,7 @@
 
     while ( 1 )
     {
-      option = getopt( argc, argv, "f:lt:T:vV:" );
+      option = getopt( argc, argv, "Cf:j:lt:T:vV:" );
 
       if ( option == -1 )
         break;
@@ -783,25 +1292,49 @@
       {
       case 't':
         {
-          int i;
+          const char*  name = optarg;
+          int          i;
 
-          validator = LAST_VALIDATE;
-          for ( i = 0; i < LAST_VALIDATE; i++ )
+
+          /* a `:'-separated list is only accepted in corpus mode */
+          corpus_validators = 0;
+          do
           {
-            if ( strcmp( optarg, validators[i].symbol ) == 0 )
+            size_t  len = strcspn( name, ":" );
+
+
+            validator = LAST_VALIDATE;
+            for ( i = 0; i < LAST_VALIDATE; i++ )
             {
-              validator = (ValidatorType)i;
-              break;
+              if ( strlen( validators[i].symbol ) == len           &&
+                   strncmp( name, validators[i].symbol, len ) == 0 )
+              {
+                validator = (ValidatorType)i;
+                break;
+              }
             }
-          }
-          if ( validator == LAST_VALIDATE )
-          {
-            fprintf( stderr, "*** Unknown validator name: %s\n", optarg );
-            print_usage( NULL );
-          }
+            if ( validator == LAST_VALIDATE )
+            {
+              fprintf( stderr, "*** Unknown validator name: %s\n", optarg );
+              print_usage( NULL );
+            }
+
+            corpus_validators |= 1U << validator;
+            name              += len;
+          } while ( *name++ == ':' );
         }
         break;
 
+      case 'C':
+        corpus_mode = 1;
+        break;
+
+      case 'j':
+        jobs = atoi( optarg );
+        if ( jobs < 1 )
+          jobs = 1;
+        break;
+
       case 'T':
         tables = optarg;
         break;
@@ -854,7 +1387,54 @@
       fprintf(stderr, "*** Font file is not specified.\n");
       print_usage( NULL );
     }
-    else if ( argc > 1 )
+
+    if ( !corpus_validators )
+      corpus_validators = 1U << validator;
+
+    if ( corpus_mode )
+    {
+      int  i;
+
+
+      for ( i = 0; i < LAST_VALIDATE; i++ )
+      {
+        if ( !( corpus_validators & ( 1U << i ) ) )
+          continue;
+
+        if ( !validators[i].is_implemented( library ) )
+          panic( FT_Err_Unimplemented_Feature,
+                 validators[i].unimplemented_message );
+
+        /* check the table names or dialects once for all fonts */
+        if ( i == CKERN_VALIDATE )
+          parse_ckern_dialect( tables );
+        else if ( tables && tables[0] )
+          parse_table_specs( tables,
+                             validators[i].table_spec,
+                             (int)validators[i].n_table_spec );
+      }
+
+      corpus_tables = tables;
+      corpus_level  = validation_level;
+
+      for ( i = 0; i < argc; i++ )
+        corpus_add_path( argv[i] );
+
+      error = corpus_run( library, jobs );
+
+      free( corpus );
+      FT_Done_FreeType( library );
+
+      return (int)error;
+    }
+
+    if ( corpus_validators & ( corpus_validators - 1 ) )
+    {
+      fprintf( stderr, "*** Only corpus mode accepts several validators.\n" );
+      print_usage( NULL );
+    }
+
+    if ( argc > 1 )
     {
       fprintf(stderr, "*** Too many font files.\n");
       print_usage( NULL );
@@ -428,154 +428,292 @@
   }
 
 
-  static int
-  Render_All( int  num_indices,
-              int  offset )
+  /*
+   * `Render_All' keeps the rendered glyphs together with the metrics
+   * needed for the layout, keyed by glyph position.  Paging back and
+   * forth through large fonts thus only re-blits cells already seen.
+   * The cache is flushed by `Process_Event' whenever rendering
+   * parameters might have changed.
+   */
+  typedef struct  CellRec_
   {
-    int  start_x, start_y, step_y, x, y, width;
-    int  i, have_topleft;
+    struct CellRec_*  next;
 
-    FT_Size       size;
-    FT_Face       face;
-    FT_GlyphSlot  slot;
+    int       index;          /* as passed to `FTDemo_Get_Index' */
+    FT_Error  load_error;
+    FT_Error  draw_error;
+    FT_Pos    advance;        /* `slot->advance.x'               */
+    FT_Bool   behind_origin;  /* glyph image left of the origin  */
+    FT_Glyph  glyph;          /* bitmap glyph, or NULL           */
 
-    FT_Color*        palette;
-    FT_Palette_Data  palette_data;
-    FT_UShort        palette_index;
+  } CellRec, *Cell;
 
 
-    error = FTDemo_Get_Size( handle, &size );
-    if ( error )
-      return -1;
+#define CELL_BUCKETS       1024
+#define CELL_CACHE_BUDGET  ( 32UL * 1024 * 1024 )
 
-    INIT_SIZE( size, start_x, start_y, step_y, x, y );
-    face = size->face;
-    slot = face->glyph;
+  static Cell           cells[CELL_BUCKETS];
+  static unsigned long  cells_size;
 
-    palette_index = (FT_UShort)handle->current_font->palette_index;
-    if ( FT_Palette_Select( face, palette_index, &palette ) )
-      palette = NULL;
-    if ( FT_Palette_Data_Get( face, &palette_data ) )
-      return -1;
 
-    have_topleft = 0;
+  static void
+  Flush_Cells( void )
+  {
+    int  i;
 
-    for ( i = offset; i < num_indices; i++ )
-    {
-      FT_LayerIterator  iterator;
-      FT_UInt           glyph_idx;
 
-      FT_Bool  have_layers;
-      FT_UInt  layer_glyph_idx;
-      FT_UInt  layer_color_idx;
+    for ( i = 0; i < CELL_BUCKETS; i++ )
+    {
+      Cell  cell = cells[i];
 
 
-      glyph_idx = FTDemo_Get_Index( handle, (FT_UInt32)i );
+      while ( cell )
+      {
+        Cell  next = cell->next;
 
-      /* check whether we have glyph color layers */
-      iterator.p  = NULL;
-      have_layers = FT_Get_Color_Glyph_Layer( face,
-                                              glyph_idx,
-                                              &layer_glyph_idx,
-                                              &layer_color_idx,
-                                              &iterator );
 
-      if ( palette && have_layers && handle->use_layers )
-      {
-        FT_Int32  load_flags = handle->load_flags;
+        FT_Done_Glyph( cell->glyph );
+        free( cell );
+        cell = next;
+      }
 
-        FT_Bitmap  bitmap;
-        FT_Vector  bitmap_offset = { 0, 0 };
+      cells[i] = NULL;
+    }
 
+    cells_size = 0;
+  }
 
-        /*
-         * We want to handle glyph layers manually, thus switching off
-         * `FT_LOAD_COLOR' and ensuring normal AA render mode.
-         */
-        load_flags &= ~FT_LOAD_COLOR;
-        load_flags |=  FT_LOAD_RENDER;
 
-        load_flags &= ~FT_LOAD_TARGET_( 0xF );
-        load_flags |=  FT_LOAD_TARGET_NORMAL;
+  static Cell
+  Load_Cell( int               i,
+             FT_Size           size,
+             FT_Color*         palette,
+             FT_Palette_Data*  palette_data,
+             FT_UShort         palette_index )
+  {
+    FT_Face       face = size->face;
+    FT_GlyphSlot  slot = face->glyph;
+    Cell          cell;
 
-        FT_Bitmap_Init( &bitmap );
+    FT_LayerIterator  iterator;
+    FT_UInt           glyph_idx;
 
-        do
-        {
-          FT_Vector  slot_offset;
-          FT_Color   color;
+    FT_Bool  have_layers;
+    FT_UInt  layer_glyph_idx;
+    FT_UInt  layer_color_idx;
 
 
-          error = FT_Load_Glyph( face, layer_glyph_idx, load_flags );
-          if ( error )
-            break;
+    cell = (Cell)calloc( 1, sizeof ( *cell ) );
+    if ( !cell )
+      Fatal( "not enough memory" );
 
-          slot_offset.x = slot->bitmap_left * 64;
-          slot_offset.y = slot->bitmap_top * 64;
+    cell->index = i;
+    cell->next  = cells[i % CELL_BUCKETS];
 
-          if ( layer_color_idx == 0xFFFF )
-          {
-            // TODO: FT_Palette_Get_Foreground_Color
-            if ( palette_data.palette_flags                  &&
-               ( palette_data.palette_flags[palette_index] &
-                   FT_PALETTE_FOR_DARK_BACKGROUND          ) )
-            {
-              /* white opaque */
-              color.blue  = 0xFF;
-              color.green = 0xFF;
-              color.red   = 0xFF;
-              color.alpha = 0xFF;
-            }
-            else
-            {
-              /* black opaque */
-              color.blue  = 0x00;
-              color.green = 0x00;
-              color.red   = 0x00;
-              color.alpha = 0xFF;
-            }
-          }
-          else if ( layer_color_idx < palette_data.num_palette_entries )
-            color = palette[layer_color_idx];
-          else
-            continue;
+    cells[i % CELL_BUCKETS] = cell;
+    cells_size             += sizeof ( *cell );
 
-          error = FT_Bitmap_Blend( handle->library,
-                                   &slot->bitmap,
-                                   slot_offset,
-                                   &bitmap,
-                                   &bitmap_offset,
-                                   color );
+    glyph_idx = FTDemo_Get_Index( handle, (FT_UInt32)i );
 
-        } while ( FT_Get_Color_Glyph_Layer( face,
+    /* check whether we have glyph color layers */
+    iterator.p  = NULL;
+    have_layers = FT_Get_Color_Glyph_Layer( face,
                                             glyph_idx,
                                             &layer_glyph_idx,
                                             &layer_color_idx,
-                                            &iterator ) );
+                                            &iterator );
+
+    if ( palette && have_layers && handle->use_layers )
+    {
+      FT_Int32  load_flags = handle->load_flags;
 
+      FT_Bitmap  bitmap;
+      FT_Vector  bitmap_offset = { 0, 0 };
+
+
+      /*
+       * We want to handle glyph layers manually, thus switching off
+       * `FT_LOAD_COLOR' and ensuring normal AA render mode.
+       */
+      load_flags &= ~FT_LOAD_COLOR;
+      load_flags |=  FT_LOAD_RENDER;
+
+      load_flags &= ~FT_LOAD_TARGET_( 0xF );
+      load_flags |=  FT_LOAD_TARGET_NORMAL;
+
+      FT_Bitmap_Init( &bitmap );
+
+      do
+      {
+        FT_Vector  slot_offset;
+        FT_Color   color;
+
+
+        error = FT_Load_Glyph( face, layer_glyph_idx, load_flags );
         if ( error )
+          break;
+
+        slot_offset.x = slot->bitmap_left * 64;
+        slot_offset.y = slot->bitmap_top * 64;
+
+        if ( layer_color_idx == 0xFFFF )
         {
-          FT_Bitmap_Done( handle->library, &bitmap );
-          goto Next;
+          // TODO: FT_Palette_Get_Foreground_Color
+          if ( palette_data->palette_flags                  &&
+             ( palette_data->palette_flags[palette_index] &
+                 FT_PALETTE_FOR_DARK_BACKGROUND           ) )
+          {
+            /* white opaque */
+            color.blue  = 0xFF;
+            color.green = 0xFF;
+            color.red   = 0xFF;
+            color.alpha = 0xFF;
+          }
+          else
+          {
+            /* black opaque */
+            color.blue  = 0x00;
+            color.green = 0x00;
+            color.red   = 0x00;
+            color.alpha = 0xFF;
+          }
         }
+        else if ( layer_color_idx < palette_data->num_palette_entries )
+          color = palette[layer_color_idx];
         else
-        {
-          FT_Bitmap_Done( handle->library, &slot->bitmap );
+          continue;
 
-          slot->bitmap      = bitmap;
-          slot->bitmap_left = bitmap_offset.x / 64;
-          slot->bitmap_top  = bitmap_offset.y / 64;
-        }
+        error = FT_Bitmap_Blend( handle->library,
+                                 &slot->bitmap,
+                                 slot_offset,
+                                 &bitmap,
+                                 &bitmap_offset,
+                                 color );
+
+      } while ( FT_Get_Color_Glyph_Layer( face,
+                                          glyph_idx,
+                                          &layer_glyph_idx,
+                                          &layer_color_idx,
+                                          &iterator ) );
+
+      if ( error )
+      {
+        FT_Bitmap_Done( handle->library, &bitmap );
+        cell->load_error = error;
+        return cell;
       }
       else
       {
-        error = FT_Load_Glyph( face, glyph_idx, handle->load_flags );
-        if ( error )
-          goto Next;
+        FT_Bitmap_Done( handle->library, &slot->bitmap );
+
+        slot->bitmap      = bitmap;
+        slot->bitmap_left = bitmap_offset.x / 64;
+        slot->bitmap_top  = bitmap_offset.y / 64;
+      }
+    }
+    else
+    {
+      error = FT_Load_Glyph( face, glyph_idx, handle->load_flags );
+      if ( error )
+      {
+        cell->load_error = error;
+        return cell;
       }
+    }
 
-      width = slot->advance.x ? slot->advance.x >> 6
-                              : size->metrics.y_ppem / 2;
+    cell->advance       = slot->advance.x;
+    cell->behind_origin = slot->bitmap_left + (int)slot->bitmap.width <= 0;
+
+    /* render now, keeping the bitmap glyph for drawing */
+    error = FT_Get_Glyph( slot, &cell->glyph );
+    if ( !error )
+    {
+      grBitmap  bit3;
+      FT_Glyph  glyf;
+      int       left, top, x_advance, y_advance;
+
+
+      error = FTDemo_Glyph_To_Bitmap( handle, cell->glyph, &bit3,
+                                      &left, &top,
+                                      &x_advance, &y_advance, &glyf );
+      if ( glyf )
+      {
+        FT_Done_Glyph( cell->glyph );
+        cell->glyph = glyf;
+      }
+
+      if ( error )
+      {
+        FT_Done_Glyph( cell->glyph );
+        cell->glyph = NULL;
+      }
+      else
+        cells_size += (unsigned long)bit3.rows *
+                      (unsigned long)( bit3.pitch < 0 ? -bit3.pitch
+                                                      : bit3.pitch );
+    }
+    cell->draw_error = error;
+
+    return cell;
+  }
+
+
+  static int
+  Render_All( int  num_indices,
+              int  offset )
+  {
+    int  start_x, start_y, step_y, x, y, width;
+    int  i, have_topleft;
+
+    FT_Size  size;
+    FT_Face  face;
+
+    FT_Color*        palette;
+    FT_Palette_Data  palette_data;
+    FT_UShort        palette_index;
+
+
+    error = FTDemo_Get_Size( handle, &size );
+    if ( error )
+      return -1;
+
+    INIT_SIZE( size, start_x, start_y, step_y, x, y );
+    face = size->face;
+
+    palette_index = (FT_UShort)handle->current_font->palette_index;
+    if ( FT_Palette_Select( face, palette_index, &palette ) )
+      palette = NULL;
+    if ( FT_Palette_Data_Get( face, &palette_data ) )
+      return -1;
+
+    have_topleft = 0;
+
+    for ( i = offset; i < num_indices; i++ )
+    {
+      Cell  cell;
+
+
+      for ( cell = cells[i % CELL_BUCKETS]; cell; cell = cell->next )
+        if ( cell->index == i )
+          break;
+
+      if ( !cell )
+      {
+        if ( cells_size > CELL_CACHE_BUDGET )
+          Flush_Cells();
+
+        cell = Load_Cell( i, size,
+                          palette, &palette_data, palette_index );
+      }
+
+      if ( cell->load_error )
+      {
+        error = cell->load_error;
+        goto Next;
+      }
+
+      width = cell->advance ? cell->advance >> 6
+                            : size->metrics.y_ppem / 2;
 
       if ( X_TOO_LONG( x + width, display ) )
       {
@@ -586,13 +724,13 @@
           break;
       }
 
-      if ( slot->advance.x == 0 )
+      if ( cell->advance == 0 )
       {
         grFillRect( display->bitmap, x, y - width, width, width,
                     status.green );
 
         /* advance pen immediately if the glyph is behind the origin */
-        if ( slot->bitmap_left + (int)slot->bitmap.width <= 0 )
+        if ( cell->behind_origin )
         {
           x     += width;
           width  = 0;
@@ -601,7 +739,18 @@
       else
         width = 0;
 
-      error = FTDemo_Draw_Slot( handle, display, slot, &x, &y );
+      error = cell->draw_error;
+      if ( !error )
+      {
+        error = FTDemo_Draw_Glyph( handle, display, cell->glyph, &x, &y );
+
+        /* the glyph has been discarded on error */
+        if ( error )
+        {
+          cell->glyph      = NULL;
+          cell->draw_error = error;
+        }
+      }
 
       x += width + 1;  /* with extra space between glyphs */
 
@@ -714,6 +863,7 @@
     int      pt_size, step, pt_height;
     FT_Size  size;
     int      have_topleft, start;
+    int      use_atlas = handle->use_atlas;
 
     char         text[256];
     const char*  p;
@@ -725,6 +875,9 @@
 
     have_topleft = 0;
 
+    /* every line has a different size, which would reset the atlas */
+    handle->use_atlas = 0;
+
     pt_height = 64 * 72 * display->bitmap->rows / status.res;
     step      = ( mid_size * mid_size / pt_height + 64 ) & ~63;
     pt_size   = mid_size - step * ( mid_size / step );  /* remainder */
@@ -810,6 +963,8 @@
       }
     }
 
+    handle->use_atlas = use_atlas;
+
     FTDemo_Set_Current_Charsize( handle, mid_size, status.res );
     FTDemo_Get_Size( handle, &size );
 
@@ -870,7 +1025,7 @@
     grWriteln( "              glyphs                    y, Y        adjust vertical         " );
     grWriteln( "Z           toggle SVG glyphs                        emboldening (in mode 2)" );
     grWriteln( "                                        s, S        adjust slanting         " );
-    grWriteln( "K           toggle cache modes                       (in mode 2)            " );
+    grWriteln( "K           cycle through cache modes                (in mode 2)            " );
     grWriteln( "                                        r, R        adjust stroking radius  " );
     grWriteln( "p, n        previous/next font                       (in mode 3)            " );
     grWriteln( "                                                                            " );
@@ -886,7 +1041,9 @@
     grWriteln( "H           cycle through hinting                                           " );
     grWriteln( "             engines (if available)     Tab         cycle through charmaps  " );
     grWriteln( "f           toggle forced auto-                                             " );
-    grWriteln( "             hinting (if hinting)       P           print PNG file          " );
+    grWriteln( "             hinting (if hinting)       P           print image file        " );
+    grWriteln( "                                        T           print glyph atlas       " );
+    grWriteln( "                                        #           toggle statistics       " );
     grWriteln( "                                        q, ESC      quit ftview             " );
     /*          |----------------------------------|    |----------------------------------| */
     grLn();
@@ -1129,6 +1286,30 @@
         return 1;
     }
 
+    /* rendered cells survive paging and display changes only */
+    switch ( event.key )
+    {
+    case grKeyLeft:
+    case grKeyRight:
+    case grKeyF7:
+    case grKeyF8:
+    case grKeyF9:
+    case grKeyF10:
+    case grKeyF11:
+    case grKeyF12:
+    case grKeyF1:
+    case grKEY( '?' ):
+    case grKEY( '#' ):
+    case grKEY( 'g' ):
+    case grKEY( 'v' ):
+    case grKEY( 'P' ):
+    case grKEY( 'T' ):
+      break;
+
+    default:
+      Flush_Cells();
+    }
+
     if ( event.key >= '1' && event.key < '1' + N_RENDER_MODES )
     {
       int  render_mode = (int)( event.key - '1' );
@@ -1173,7 +1354,7 @@
 
 
         FTDemo_Version( handle, str );
-        FTDemo_Display_Print( display, "ftview.png", str );
+        FTDemo_Display_Snapshot( display, "ftview", str );
       }
       goto Start;
 
@@ -1206,7 +1387,28 @@
       break;
 
     case grKEY( 'K' ):
-      handle->use_sbits_cache = !handle->use_sbits_cache;
+      /* sbits cache, sbits cache with atlas, no cache */
+      if ( handle->use_atlas )
+        handle->use_sbits_cache = handle->use_atlas = 0;
+      else if ( handle->use_sbits_cache )
+        handle->use_atlas = 1;
+      else
+        handle->use_sbits_cache = 1;
+      return 1;
+
+    case grKEY( 'T' ):
+      {
+        FT_String  str[64] = "ftview (FreeType) ";
+
+
+        FTDemo_Version( handle, str );
+        FTDemo_Atlas_Print( handle, "ftatlas.png", str );
+      }
+      goto Start;
+
+    case grKEY( '#' ):
+      handle->show_stats = !handle->show_stats;
+      handle->stats_used = 1;
       return 1;
 
     case grKEY( 'f' ):
@@ -1586,10 +1788,31 @@
 
     /* cache */
     snprintf( buf, sizeof ( buf ), "cache: %s",
-              handle->use_sbits_cache ? "on" : "off" );
+              handle->use_atlas       ? "atlas" :
+              handle->use_sbits_cache ? "on"    : "off" );
     grWriteCellString( display->bitmap, 0, (line++) * HEADER_HEIGHT,
                        buf, display->fore_color );
 
+    /* glyph atlas usage and packing density */
+    if ( handle->use_atlas && handle->atlas.height )
+    {
+      snprintf( buf, sizeof ( buf ), "  %ld glyphs",
+                handle->atlas.num_packed );
+      grWriteCellString( display->bitmap, 0, (line++) * HEADER_HEIGHT,
+                         buf, display->fore_color );
+
+      snprintf( buf, sizeof ( buf ), "  %dx%d",
+                ATLAS_WIDTH, handle->atlas.height );
+      grWriteCellString( display->bitmap, 0, (line++) * HEADER_HEIGHT,
+                         buf, display->fore_color );
+
+      snprintf( buf, sizeof ( buf ), "  %.1f%% used",
+                100.0 * handle->atlas.area /
+                  ( ATLAS_WIDTH * handle->atlas.height ) );
+      grWriteCellString( display->bitmap, 0, (line++) * HEADER_HEIGHT,
+                         buf, display->fore_color );
+    }
+
     line++;
 
     /* LCD filtering */
@@ -1912,6 +2135,10 @@
               status.err_fails, FTDemo_Error_String( status.err_fails ) );
     }
 
+    FTDemo_Stats_Print( handle );
+
+    Flush_Cells();
+
     FTDemo_Display_Done( display );
     FTDemo_Done( handle );
     exit( 0 );      /* for safety reasons */
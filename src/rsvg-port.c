@@ -24,6 +24,7 @@
 #include <cairo.h>
 #include <librsvg/rsvg.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <freetype/freetype.h>
@@ -32,30 +33,346 @@
 #include "rsvg-port.h"
 
 
+  /*
+   * The state shared by all libraries, the lock protecting it, the
+   * budget for a state yet to be created, and the cache statistics.
+   */
+  static Rsvg_Port_State  rsvg_port_state;
+  static GMutex           rsvg_port_lock;
+  static FT_ULong         rsvg_port_budget = RSVG_PORT_CACHE_BUDGET;
+  static FT_ULong         rsvg_port_hits;
+  static FT_ULong         rsvg_port_misses;
+
+
+  /*
+   * The calling thread's recording context, destroyed at thread exit.
+   */
+  static void
+  rsvg_port_context_free( gpointer  data )
+  {
+    Rsvg_Port_ContextRec  *context = (Rsvg_Port_ContextRec*)data;
+
+
+    if ( context->rec_surface )
+      cairo_surface_destroy( context->rec_surface );
+
+    free( context );
+  }
+
+
+  static GPrivate  rsvg_port_context =
+                     G_PRIVATE_INIT( rsvg_port_context_free );
+
+
+  static Rsvg_Port_ContextRec*
+  rsvg_port_get_context( void )
+  {
+    Rsvg_Port_ContextRec  *context = g_private_get( &rsvg_port_context );
+
+
+    if ( !context )
+    {
+      context = (Rsvg_Port_ContextRec*)calloc( 1, sizeof ( *context ) );
+      if ( context )
+        g_private_set( &rsvg_port_context, context );
+    }
+
+    return context;
+  }
+
+
   /*
    * The init hook is called when the first OT-SVG glyph is rendered.  All
    * we do is to allocate an internal state structure and set the pointer in
    * `library->svg_renderer_state`.  This state structure becomes very
    * useful to cache some of the results obtained by one hook function that
-   * the other one might use.
+   * the other one might use.  All libraries share the same state.
    */
   FT_Error
-  rsvg_port_init( FT_Pointer  *state )
+  rsvg_port_init( FT_Pointer  *_state )
+  {
+    FT_Error  error = FT_Err_Ok;
+
+
+    g_mutex_lock( &rsvg_port_lock );
+
+    /* allocate the memory upon first initialization */
+    if ( !rsvg_port_state )
+    {
+      rsvg_port_state = (Rsvg_Port_State)calloc( 1,
+                                                 sizeof( Rsvg_Port_StateRec ) );
+      if ( rsvg_port_state )
+        rsvg_port_state->cache_budget = rsvg_port_budget;
+    }
+
+    if ( rsvg_port_state )
+      rsvg_port_state->users++;
+    else
+      error = FT_Err_Out_Of_Memory;
+
+    *_state = rsvg_port_state;
+
+    g_mutex_unlock( &rsvg_port_lock );
+
+    return error;
+  }
+
+
+  /*
+   * Remove a handle from the cache and destroy it.  The caller must hold
+   * the lock.
+   */
+  static void
+  rsvg_port_drop_handle( Rsvg_Port_State       state,
+                         Rsvg_Port_HandleRec  *entry )
+  {
+    if ( entry->prev )
+      entry->prev->next = entry->next;
+    else
+      state->handles = entry->next;
+    if ( entry->next )
+      entry->next->prev = entry->prev;
+
+    state->cache_bytes -= entry->length;
+
+    g_object_unref( entry->handle );
+    free( entry );
+  }
+
+
+  /*
+   * Drop least recently used handles that are not busy until the cache
+   * fits into its budget.  The caller must hold the lock.
+   */
+  static void
+  rsvg_port_trim_cache( Rsvg_Port_State  state )
   {
-    /* allocate the memory upon initialization */
-    *state = malloc( sizeof( Rsvg_Port_StateRec ) ); /* XXX error handling */
+    Rsvg_Port_HandleRec  *entry = state->handles;
+
+
+    if ( !entry )
+      return;
+
+    while ( entry->next )
+      entry = entry->next;
+
+    while ( entry && state->cache_bytes > state->cache_budget )
+    {
+      Rsvg_Port_HandleRec  *prev = entry->prev;
+
+
+      if ( !entry->busy )
+        rsvg_port_drop_handle( state, entry );
 
-    return FT_Err_Ok;
+      entry = prev;
+    }
   }
 
 
   /*
-   * Deallocate the state structure.
+   * Deallocate the state structure when the last library is done with
+   * it.  The recording of the calling thread is released, too.
    */
   void
-  rsvg_port_free( FT_Pointer  *state )
+  rsvg_port_free( FT_Pointer  *_state )
+  {
+    Rsvg_Port_State  state = *(Rsvg_Port_State*)_state;
+
+
+    g_private_replace( &rsvg_port_context, NULL );
+
+    g_mutex_lock( &rsvg_port_lock );
+
+    if ( --state->users == 0 )
+    {
+      while ( state->handles )
+        rsvg_port_drop_handle( state, state->handles );
+
+      free( state );
+      rsvg_port_state = NULL;
+    }
+
+    g_mutex_unlock( &rsvg_port_lock );
+  }
+
+
+  void
+  rsvg_port_set_cache_budget( FT_ULong  budget )
   {
-    free( *state );
+    g_mutex_lock( &rsvg_port_lock );
+
+    rsvg_port_budget = budget;
+    if ( rsvg_port_state )
+    {
+      rsvg_port_state->cache_budget = budget;
+      rsvg_port_trim_cache( rsvg_port_state );
+    }
+
+    g_mutex_unlock( &rsvg_port_lock );
+  }
+
+
+  void
+  rsvg_port_get_cache_stats( FT_ULong  *hits,
+                             FT_ULong  *misses )
+  {
+    g_mutex_lock( &rsvg_port_lock );
+
+    *hits   = rsvg_port_hits;
+    *misses = rsvg_port_misses;
+
+    g_mutex_unlock( &rsvg_port_lock );
+  }
+
+
+  /*
+   * Hash 64 bytes spread over the document (FNV-1a).
+   */
+  static FT_UInt32
+  rsvg_port_sample( const FT_Byte  *document,
+                    FT_ULong        length )
+  {
+    FT_UInt32  hash = 2166136261UL;
+    FT_ULong   i;
+
+
+    if ( !length )
+      return hash;
+
+    length--;
+    for ( i = 0; i < 64; i++ )
+    {
+      /* from the first to the last byte, avoiding overflow */
+      hash ^= document[length / 63 * i + length % 63 * i / 63];
+      hash *= 16777619UL;
+    }
+
+    return hash;
+  }
+
+
+  /*
+   * Return a parsed handle for `document` that no other thread is using,
+   * either from the cache or freshly created.  In the latter case, the new
+   * handle is added to the cache, evicting least recently used ones to
+   * stay within the budget.  The handle must be given back with
+   * `rsvg_port_release_handle`, passing the returned `*entry`, which is
+   * NULL if the handle was too large to be cached.
+   */
+  static RsvgHandle*
+  rsvg_port_get_handle( Rsvg_Port_State        state,
+                        FT_SVG_Document        document,
+                        FT_UInt32              sample,
+                        Rsvg_Port_HandleRec  **aentry )
+  {
+    Rsvg_Port_HandleRec  *entry;
+    RsvgHandle           *handle;
+    GError               *gerror = NULL;
+
+
+    *aentry = NULL;
+
+    g_mutex_lock( &rsvg_port_lock );
+
+    for ( entry = state->handles; entry; entry = entry->next )
+    {
+      if ( entry->document == document->svg_document        &&
+           entry->length   == document->svg_document_length &&
+           entry->sample   == sample                        &&
+           !entry->busy                                     )
+      {
+        /* move to front */
+        if ( entry->prev )
+        {
+          entry->prev->next = entry->next;
+          if ( entry->next )
+            entry->next->prev = entry->prev;
+
+          entry->prev           = NULL;
+          entry->next           = state->handles;
+          state->handles->prev = entry;
+          state->handles       = entry;
+        }
+
+        entry->busy = TRUE;
+        rsvg_port_hits++;
+
+        g_mutex_unlock( &rsvg_port_lock );
+
+        *aentry = entry;
+        return entry->handle;
+      }
+    }
+
+    rsvg_port_misses++;
+
+    g_mutex_unlock( &rsvg_port_lock );
+
+    /* Form an `RsvgHandle` by loading the SVG document; this is the */
+    /* expensive part, so don't hold the lock meanwhile.             */
+    handle = rsvg_handle_new_from_data( document->svg_document,
+                                        document->svg_document_length,
+                                        &gerror );
+    if ( handle == NULL )
+    {
+      g_clear_error( &gerror );
+      return NULL;
+    }
+
+    entry = (Rsvg_Port_HandleRec*)malloc( sizeof ( *entry ) );
+    if ( !entry )
+      return handle;
+
+    entry->document = document->svg_document;
+    entry->length   = document->svg_document_length;
+    entry->sample   = sample;
+    entry->handle   = handle;
+    entry->busy     = TRUE;
+    entry->prev     = NULL;
+
+    g_mutex_lock( &rsvg_port_lock );
+
+    /* `rsvg_port_set_cache_budget` may change the budget at any time */
+    if ( entry->length > state->cache_budget )
+    {
+      g_mutex_unlock( &rsvg_port_lock );
+
+      free( entry );
+      return handle;
+    }
+
+    entry->next = state->handles;
+    if ( state->handles )
+      state->handles->prev = entry;
+    state->handles      = entry;
+    state->cache_bytes += entry->length;
+
+    rsvg_port_trim_cache( state );
+
+    g_mutex_unlock( &rsvg_port_lock );
+
+    *aentry = entry;
+    return handle;
+  }
+
+
+  static void
+  rsvg_port_release_handle( Rsvg_Port_State       state,
+                            RsvgHandle           *handle,
+                            Rsvg_Port_HandleRec  *entry )
+  {
+    if ( !entry )
+    {
+      g_object_unref( handle );
+      return;
+    }
+
+    g_mutex_lock( &rsvg_port_lock );
+
+    entry->busy = FALSE;
+    rsvg_port_trim_cache( state );
+
+    g_mutex_unlock( &rsvg_port_lock );
   }
 
 
@@ -71,13 +388,16 @@
   {
     FT_Error  error = FT_Err_Ok;
 
-    Rsvg_Port_State   state;
-    cairo_status_t    status;
-    cairo_t          *cr;
-    cairo_surface_t  *surface;
+    Rsvg_Port_ContextRec  *context = rsvg_port_get_context();
+    cairo_status_t         status;
+    cairo_t               *cr;
+    cairo_surface_t       *surface;
 
 
-    state = *(Rsvg_Port_State*)_state;
+    FT_UNUSED( _state );
+
+    if ( !context || !context->rec_surface )
+      return FT_Err_Invalid_Outline;
 
     /* Create an image surface to store the rendered image.  However,   */
     /* don't allocate memory; instead use the space already provided in */
@@ -110,12 +430,12 @@
 
     /* Set a translate transform that translates the points in such a way */
     /* that we get a tight rendering with least redundant white spac.     */
-    cairo_translate( cr, -state->x, -state->y );
+    cairo_translate( cr, -context->x, -context->y );
 
     /* Replay from the recorded surface.  This saves us from parsing the */
     /* document again and redoing what was already done in the preset    */
     /* hook.                                                             */
-    cairo_set_source_surface( cr, state->rec_surface, 0.0, 0.0 );
+    cairo_set_source_surface( cr, context->rec_surface, 0.0, 0.0 );
     cairo_paint( cr );
 
     cairo_surface_flush( surface );
@@ -124,10 +444,10 @@
     slot->bitmap.num_grays  = 256;
     slot->format            = FT_GLYPH_FORMAT_BITMAP;
 
-    /* Clean up everything. */
+    /* Clean up everything; the recording stays with the thread's */
+    /* context until another glyph gets preset.                    */
     cairo_surface_destroy( surface );
     cairo_destroy( cr );
-    cairo_surface_destroy( state->rec_surface );
 
     return error;
   }
@@ -138,7 +458,8 @@
    * when presetting the glyphslot when `FT_Load_Glyph` is called.
    * Secondly, it is called right before the render hook is called.  When
    * `cache` is false, it is the former, when `cache` is true, it is the
-   * latter.
+   * latter.  Both calls are for the same glyph, so the second one can
+   * reuse the recording made by the first one.
    *
    * The job of this function is to preset the slot setting the width,
    * height, pitch, `bitmap.left`, and `bitmap.top`.  These are all
@@ -161,9 +482,10 @@
     FT_UShort  start_glyph_id = document->start_glyph_id;
 
     /* Librsvg variables. */
-    GError   *gerror = NULL;
     gboolean  ret;
 
+    Rsvg_Port_HandleRec  *entry;
+
     gboolean  out_has_width;
     gboolean  out_has_height;
     gboolean  out_has_viewbox;
@@ -177,9 +499,10 @@
     cairo_t        *rec_cr;
     cairo_matrix_t  transform_matrix;
 
-    /* Rendering port's state. */
-    Rsvg_Port_State     state;
-    Rsvg_Port_StateRec  state_dummy;
+    /* Rendering port's state and the thread's recording context. */
+    Rsvg_Port_State        state   = *(Rsvg_Port_State*)_state;
+    Rsvg_Port_ContextRec  *context = rsvg_port_get_context();
+    Rsvg_Port_KeyRec       key;
 
     /* General variables. */
     double  x, y;
@@ -198,24 +521,48 @@
     char  str[32];
 
 
-    /* If `cache` is `TRUE` we store calculations in the actual port */
-    /* state variable, otherwise we just create a dummy variable and */
-    /* store there.  This saves us from too many 'if' statements.    */
-    if ( cache )
-      state = *(Rsvg_Port_State*)_state;
-    else
-      state = &state_dummy;
+    FT_UNUSED( cache );
 
-    /* Form an `RsvgHandle` by loading the SVG document. */
-    handle = rsvg_handle_new_from_data( document->svg_document,
-                                        document->svg_document_length,
-                                        &gerror );
-    if ( handle == NULL )
+    if ( !context )
+      return FT_Err_Out_Of_Memory;
+
+    /* The recording is kept in the thread's context in any case.  If */
+    /* the previous call was for the same glyph (typically, the       */
+    /* preset call for loading followed by the one for rendering),    */
+    /* there is nothing to be recorded again.                         */
+    memset( &key, 0, sizeof ( key ) );
+    key.document    = document->svg_document;
+    key.length      = document->svg_document_length;
+    key.sample      = rsvg_port_sample( key.document, key.length );
+    key.glyph_index = slot->glyph_index;
+    key.x_ppem      = metrics.x_ppem;
+    key.y_ppem      = metrics.y_ppem;
+    key.transform   = document->transform;
+    key.delta       = document->delta;
+
+    if ( context->rec_surface                                    &&
+         !memcmp( &key, &context->rec_key, sizeof ( key ) ) )
     {
-      error = FT_Err_Invalid_SVG_Document;
-      goto CleanLibrsvg;
+      x      = context->x;
+      y      = context->y;
+      width  = context->width;
+      height = context->height;
+
+      goto Preset;
     }
 
+    if ( context->rec_surface )
+    {
+      cairo_surface_destroy( context->rec_surface );
+      context->rec_surface = NULL;
+    }
+
+    /* Get an `RsvgHandle` for the SVG document, parsing it if */
+    /* necessary.                                               */
+    handle = rsvg_port_get_handle( state, document, key.sample, &entry );
+    if ( handle == NULL )
+      return FT_Err_Invalid_SVG_Document;
+
     /* Get attributes like `viewBox` and `width`/`height`. */
     rsvg_handle_get_intrinsic_dimensions( handle,
                                           &out_has_width,
@@ -279,14 +626,14 @@
      * Create a cairo recording surface.  This is done for two reasons.
      * Firstly, it is required to get the bounding box of the final drawing
      * so we can use an appropriate translate transform to get a tight
-     * rendering.  Secondly, if `cache` is true, we can save this surface
-     * and later replay it against an image surface for the final rendering.
-     * This saves us from loading and parsing the document again.
+     * rendering.  Secondly, we save this surface in the port state and
+     * later replay it against an image surface for the final rendering.
+     * This saves us from rendering the document again.
      */
-    state->rec_surface =
+    context->rec_surface =
       cairo_recording_surface_create( CAIRO_CONTENT_COLOR_ALPHA, NULL );
 
-    rec_cr = cairo_create( state->rec_surface );
+    rec_cr = cairo_create( context->rec_surface );
 
     /*
      * We need to take into account any transformations applied.  The end
@@ -363,17 +710,25 @@
     }
 
     /* Get the bounding box of the drawing. */
-    cairo_recording_surface_ink_extents( state->rec_surface, &x, &y,
+    cairo_recording_surface_ink_extents( context->rec_surface, &x, &y,
                                          &width, &height );
 
+    /* No more drawing will be done on the recording surface. */
+    cairo_destroy( rec_cr );
+    rsvg_port_release_handle( state, handle, entry );
+
     /* We store the bounding box's `x` and `y` values so that the render */
     /* hook can apply a translation to get a tight rendering.            */
-    state->x = x;
-    state->y = y;
+    context->x      = x;
+    context->y      = y;
+    context->width  = width;
+    context->height = height;
+    memcpy( &context->rec_key, &key, sizeof ( key ) );
 
+  Preset:
     /* Preset the values. */
-    slot->bitmap_left = (FT_Int) state->x;  /* XXX rounding? */
-    slot->bitmap_top  = (FT_Int)-state->y;
+    slot->bitmap_left = (FT_Int) x;  /* XXX rounding? */
+    slot->bitmap_top  = (FT_Int)-y;
 
     /* Do conversion in two steps to avoid 'bad function cast' warning. */
     tmpd               = ceil( height );
@@ -390,8 +745,8 @@
     metrics_width  = (float)width;
     metrics_height = (float)height;
 
-    horiBearingX = (float) state->x;
-    horiBearingY = (float)-state->y;
+    horiBearingX = (float) x;
+    horiBearingY = (float)-y;
 
     vertBearingX = slot->metrics.horiBearingX / 64.0f -
                      slot->metrics.horiAdvance / 64.0f / 2;
@@ -412,23 +767,15 @@
     if ( slot->metrics.vertAdvance == 0 )
       slot->metrics.vertAdvance = (FT_Pos)( metrics_height * 1.2f * 64 );
 
-    /* If a render call is to follow, just destroy the context for the */
-    /* recording surface since no more drawing will be done on it.     */
-    /* However, keep the surface itself for use by the render hook.    */
-    if ( cache )
-    {
-      cairo_destroy( rec_cr );
-      goto CleanLibrsvg;
-    }
+    return error;
 
     /* Destroy the recording surface as well as the context. */
   CleanCairo:
-    cairo_surface_destroy( state->rec_surface );
+    cairo_surface_destroy( context->rec_surface );
+    context->rec_surface = NULL;
     cairo_destroy( rec_cr );
 
-  CleanLibrsvg:
-    /* Destroy the handle. */
-    g_object_unref( handle );
+    rsvg_port_release_handle( state, handle, entry );
 
     return error;
   }
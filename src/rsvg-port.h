@@ -29,17 +29,94 @@
 #include <freetype/freetype.h>
 
 
+  /*
+   * The default limit for the total length of the SVG documents whose
+   * parsed handles are kept in the cache.
+   */
+#ifndef RSVG_PORT_CACHE_BUDGET
+#define RSVG_PORT_CACHE_BUDGET  ( 8 * 1024 * 1024 )
+#endif
+
+
+  /*
+   * A parsed SVG document.  It is identified by its address and length,
+   * together with a hash of some sampled bytes to notice a different
+   * document that happens to be loaded at the same address later on.
+   *
+   * An `RsvgHandle` must not be used by two threads at the same time, so
+   * a handle is marked as busy while a glyph gets recorded with it.  If
+   * all handles of a document are busy, another one gets parsed.
+   */
+  typedef struct  Rsvg_Port_HandleRec_
+  {
+    const FT_Byte  *document;
+    FT_ULong        length;
+    FT_UInt32       sample;
+
+    RsvgHandle  *handle;
+    FT_Bool      busy;
+
+    struct Rsvg_Port_HandleRec_  *prev;  /* more recently used */
+    struct Rsvg_Port_HandleRec_  *next;  /* less recently used */
+
+  } Rsvg_Port_HandleRec;
+
+
+  /*
+   * Everything a glyph's recording depends on.
+   */
+  typedef struct  Rsvg_Port_KeyRec_
+  {
+    const FT_Byte  *document;
+    FT_ULong        length;
+    FT_UInt32       sample;
+
+    FT_UInt    glyph_index;
+    FT_UShort  x_ppem;
+    FT_UShort  y_ppem;
+    FT_Matrix  transform;
+    FT_Vector  delta;
+
+  } Rsvg_Port_KeyRec;
+
+
+  /*
+   * The recording of the glyph last preset by a thread, which is kept
+   * until the thread presets another glyph.  The render hook always
+   * follows the preset hook for the same glyph in the same thread, and
+   * loading and rendering a glyph only records it once.
+   */
+  typedef struct  Rsvg_Port_ContextRec_
+  {
+    cairo_surface_t  *rec_surface;
+
+    double  x;
+    double  y;
+    double  width;
+    double  height;
+
+    Rsvg_Port_KeyRec  rec_key;   /* the glyph in `rec_surface` */
+
+  } Rsvg_Port_ContextRec;
+
+
   /*
    * Different hook functions can access persisting data by creating a state
    * structure and putting its address in `library->svg_renderer_state`.
    * Functions can then store and retrieve data from this structure.
+   *
+   * All libraries share a single state holding a least-recently-used
+   * cache of parsed documents; it is protected by a lock so that
+   * libraries in different threads can render SVG glyphs concurrently.
+   * Recordings are kept per thread (see `Rsvg_Port_ContextRec`).
    */
   typedef struct  Rsvg_Port_StateRec_
   {
-    cairo_surface_t  *rec_surface;
+    FT_ULong  users;                 /* libraries using the state */
 
-    double  x;
-    double  y;
+    Rsvg_Port_HandleRec  *handles;   /* most recently used first  */
+    FT_ULong              cache_bytes;
+    FT_ULong              cache_budget;  /* limit for `cache_bytes` */
 
   } Rsvg_Port_StateRec;
 
@@ -61,6 +138,15 @@
                          FT_Bool       cache,
                          FT_Pointer   *state );
 
+  /* set the cache budget in bytes; call before loading any glyph */
+  void
+  rsvg_port_set_cache_budget( FT_ULong  budget );
+
+  /* get the number of cache hits and misses since program start */
+  void
+  rsvg_port_get_cache_stats( FT_ULong  *hits,
+                             FT_ULong  *misses );
+
 #endif /* HAVE_LIBRSVG */
 
 
@@ -12,6 +12,7 @@
 
 
 #include "strbuf.h"
+#include "common.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -177,4 +178,55 @@
   }
 
 
+  extern int
+  strbuf_add_json( StrBuf*      sb,
+                   const char*  str )
+  {
+    unsigned     pos = sb->pos;
+    const char*  end;
+
+
+    if ( !str )
+      return strbuf_add( sb, "null" );
+
+    end = str + strlen( str );
+
+    strbuf_addc( sb, '"' );
+    while ( str < end )
+    {
+      const char*  p   = str;
+      int          ch  = utf8_next( &p, end );
+      long         len = p - str;
+
+
+      /* reject overlong forms, surrogates, and values beyond Unicode */
+      if ( ch < 0                          ||
+           ( ch >= 0xD800 && ch < 0xE000 ) ||
+           ch > 0x10FFFF                   ||
+           len != ( ch < 0x80    ? 1 :
+                    ch < 0x800   ? 2 :
+                    ch < 0x10000 ? 3 : 4 ) )
+      {
+        strbuf_format( sb, "\\u%04x", (unsigned char)*str++ );
+        continue;
+      }
+
+      if ( ch == '"' || ch == '\\' )
+      {
+        strbuf_addc( sb, '\\' );
+        strbuf_addc( sb, (char)ch );
+      }
+      else if ( ch < 0x20 )
+        strbuf_format( sb, "\\u%04x", ch );
+      else
+        strbuf_addn( sb, str, (size_t)len );
+
+      str = p;
+    }
+    strbuf_addc( sb, '"' );
+
+    return (int)( sb->pos - pos );
+  }
+
+
 /* END */
@@ -171,6 +171,18 @@ extern "C" {
                   const char*  fmt,
                   va_list      args );
 
+
+  /*
+   * Append a UTF-8 string as a quoted JSON string, or `null' if `str' is
+   * NULL.  Valid UTF-8 sequences are copied unchanged; control characters,
+   * `"', and `\' are escaped, and so are bytes that are not part of a valid
+   * sequence, which are taken as Latin-1.  Return the number of characters
+   * that were really added.
+   */
+  extern int
+  strbuf_add_json( StrBuf*      sb,
+                   const char*  str );
+
 #ifdef __cplusplus
 }
 #endif
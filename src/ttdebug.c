@@ -13,6 +13,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 
 #ifdef UNIX
@@ -2855,6 +2856,739 @@
   }
 
 
+  /*************************************************************************
+   *
+   * Batch mode: run the bytecode programs for lists of glyphs and sizes
+   * without interaction, recording every executed instruction in a
+   * compact binary trace.
+   *
+   * The trace starts with the eight-byte signature `TTDTRC1\n', followed
+   * by records starting with a type byte; numbers are little-endian.
+   *
+   *   `S'  ppem (2)                            size set
+   *   `G'  glyph index (4)                     glyph loaded
+   *   `R'  range (1)                           program started
+   *   `I'  opcode (1), range (1), IP (4),      instruction executed
+   *        stack depth (2)
+   *   `F'  function (2), call depth (1)        current function changed
+   *                                            (0xFFFF: none)
+   *   `T'  zone (1), point (2)                 point moved by the last
+   *                                            instruction (zone 0 is the
+   *                                            twilight zone; option `-p')
+   *   `E'  error (2)                           program aborted
+   *
+   * The range is one of the `tt_coderange_xxx' values: 1 for `fpgm', 2
+   * for `prep', and 3 for `glyf'.
+   *
+   * With option `-P' the same loop profiles the programs instead (or in
+   * addition), counting the instructions executed per glyph, per `fpgm'
+   * function, and per size.
+   *
+   */
+
+#define TRACE_SIGNATURE  "TTDTRC1\n"
+
+#define MAX_RANGES  64
+
+
+  typedef struct  Range_
+  {
+    long  first;
+    long  last;
+
+  } Range;
+
+
+  static FILE*    trace_file;
+  static FT_Bool  trace_points;
+
+
+  typedef struct  PpemCost_
+  {
+    long      ppem;
+    FT_ULong  prep;       /* instructions executed in `prep'          */
+    FT_ULong  glyf;       /* instructions executed for glyph programs */
+    FT_ULong  glyphs;     /* glyphs loaded                            */
+    FT_ULong  max_glyf;   /* instructions for the most expensive ...  */
+    long      max_glyph;  /* ... glyph                                */
+
+  } PpemCost;
+
+
+  /* Instruction counts; programs are identified by their code range,  */
+  /* functions called from them are included.  For functions, `self'    */
+  /* counts instructions executed in the function body and `total'      */
+  /* also those of the functions it calls.                              */
+  static FT_Bool    profiling;
+  static FT_ULong   prof_program[4];
+  static FT_ULong*  prof_glyph;
+  static FT_ULong*  prof_fn_self;
+  static FT_ULong*  prof_fn_total;
+  static FT_ULong*  prof_fn_calls;
+  static PpemCost*  cur_ppem;
+  static long       cur_glyph;
+  static FT_ULong   cur_glyph_cost;
+
+
+  static FT_Byte*
+  put_le( FT_Byte*  p,
+          FT_ULong  value,
+          int       size )
+  {
+    while ( size-- )
+    {
+      *p++    = (FT_Byte)value;
+      value >>= 8;
+    }
+
+    return p;
+  }
+
+
+  static void
+  trace_record( int       type,
+                FT_ULong  a,
+                int       a_size,
+                FT_ULong  b,
+                int       b_size )
+  {
+    FT_Byte   rec[8];
+    FT_Byte*  p = rec;
+
+
+    *p++ = (FT_Byte)type;
+    p    = put_le( p, a, a_size );
+    p    = put_le( p, b, b_size );
+
+    fwrite( rec, 1, (size_t)( p - rec ), trace_file );
+  }
+
+
+  static void
+  trace_moved_points( TT_GlyphZone  zone,
+                      FT_Vector*    saved,
+                      int           zone_index )
+  {
+    FT_UShort  i;
+
+
+    for ( i = 0; i < zone->n_points; i++ )
+      if ( zone->cur[i].x != saved[i].x || zone->cur[i].y != saved[i].y )
+        trace_record( 'T', (FT_ULong)zone_index, 1, i, 2 );
+  }
+
+
+  static void
+  profile_instruction( TT_ExecContext  exc,
+                       FT_Int          program )
+  {
+    FT_Int  i, j;
+
+
+    prof_program[program & 3]++;
+
+    if ( program == tt_coderange_glyph )
+    {
+      prof_glyph[cur_glyph]++;
+      cur_glyph_cost++;
+      if ( cur_ppem )
+        cur_ppem->glyf++;
+    }
+    else if ( program == tt_coderange_cvt && cur_ppem )
+      cur_ppem->prep++;
+
+    if ( CUR.callTop > 0 )
+    {
+      prof_fn_self[CUR.callStack[CUR.callTop - 1].Def->opc]++;
+
+      for ( i = 0; i < CUR.callTop; i++ )
+      {
+        FT_UInt  fn = (FT_UInt)CUR.callStack[i].Def->opc;
+
+
+        /* count recursive functions only once */
+        for ( j = 0; j < i; j++ )
+          if ( (FT_UInt)CUR.callStack[j].Def->opc == fn )
+            break;
+
+        if ( j == i )
+          prof_fn_total[fn]++;
+      }
+    }
+  }
+
+
+  /* The debug hook used in batch mode: execute a program */
+  /* instruction by instruction, tracing and profiling.   */
+  static FT_Error
+  BatchIns( void*  exec )
+  {
+    TT_ExecContext  exc = (TT_ExecContext)exec;
+
+    FT_Error    err      = FT_Err_Ok;
+    FT_Int      program  = CUR.curRange;
+    FT_Int      call_top = 0;
+    FT_Bool     points   = trace_file && trace_points;
+    FT_Vector*  save_pts = NULL;
+    FT_Vector*  save_twilight = NULL;
+
+
+    CUR.instruction_trap = 1;
+
+    if ( trace_file )
+      trace_record( 'R', (FT_ULong)program, 1, 0, 0 );
+
+    if ( points )
+    {
+      save_pts      = (FT_Vector*)malloc( sizeof ( FT_Vector ) *
+                                          ( CUR.pts.n_points + 1U ) );
+      save_twilight = (FT_Vector*)malloc( sizeof ( FT_Vector ) *
+                                          ( CUR.twilight.n_points + 1U ) );
+      if ( !save_pts || !save_twilight )
+        Abort( "out of memory" );
+    }
+
+    while ( CUR.IP < CUR.codeSize )
+    {
+      FT_Byte  opcode = CUR.code[CUR.IP];
+
+
+      if ( trace_file )
+      {
+        FT_Byte   rec[10];
+        FT_Byte*  p = rec;
+
+
+        *p++ = 'I';
+        *p++ = opcode;
+        *p++ = (FT_Byte)CUR.curRange;
+        p    = put_le( p, (FT_ULong)CUR.IP, 4 );
+        p    = put_le( p, (FT_ULong)CUR.top, 2 );
+        fwrite( rec, 1, (size_t)( p - rec ), trace_file );
+      }
+
+      if ( profiling )
+        profile_instruction( exc, program );
+
+      if ( points )
+      {
+        memcpy( save_pts, CUR.pts.cur,
+                sizeof ( FT_Vector ) * CUR.pts.n_points );
+        memcpy( save_twilight, CUR.twilight.cur,
+                sizeof ( FT_Vector ) * CUR.twilight.n_points );
+      }
+
+      err = TT_RunIns( exc );
+      if ( err )
+        break;
+
+      if ( profiling && CUR.callTop > 0 )
+      {
+        /* a new call, or the next iteration of a `LOOPCALL' */
+        if ( CUR.callTop > call_top                      ||
+             ( CUR.callTop == call_top && opcode == 0x2D ) )
+          prof_fn_calls[CUR.callStack[CUR.callTop - 1].Def->opc]++;
+      }
+
+      if ( CUR.callTop != call_top )
+      {
+        call_top = CUR.callTop;
+        if ( trace_file )
+          trace_record( 'F',
+                        call_top > 0 ? CUR.callStack[call_top - 1].Def->opc
+                                     : 0xFFFFU, 2,
+                        (FT_ULong)call_top, 1 );
+      }
+
+      if ( points )
+      {
+        trace_moved_points( &CUR.twilight, save_twilight, 0 );
+        trace_moved_points( &CUR.pts, save_pts, 1 );
+      }
+    }
+
+    if ( err && trace_file )
+      trace_record( 'E', (FT_ULong)err, 2, 0, 0 );
+
+    free( save_pts );
+    free( save_twilight );
+
+    return err;
+  }
+
+
+  /* Parse a comma-separated list of numbers and ranges like `3-7'. */
+  static int
+  parse_ranges( const char*  arg,
+                Range*       ranges )
+  {
+    int    n = 0;
+    char*  end;
+
+
+    do
+    {
+      if ( n == MAX_RANGES )
+        return 0;
+
+      ranges[n].first = strtol( arg, &end, 10 );
+      if ( end == arg || ranges[n].first < 0 )
+        return 0;
+
+      ranges[n].last = ranges[n].first;
+      if ( *end == '-' )
+      {
+        arg            = end + 1;
+        ranges[n].last = strtol( arg, &end, 10 );
+        if ( end == arg || ranges[n].last < ranges[n].first )
+          return 0;
+      }
+
+      n++;
+      arg = end + 1;
+
+    } while ( *end == ',' );
+
+    return *end ? 0 : n;
+  }
+
+
+  static void
+  set_design_coords( void )
+  {
+    FT_Done_MM_Var( library, multimaster );
+    error = FT_Get_MM_Var( (FT_Face)face, &multimaster );
+    if ( error )
+      multimaster = NULL;
+    else
+    {
+      unsigned int  n;
+
+
+      if ( requested_cnt > multimaster->num_axis )
+        requested_cnt = multimaster->num_axis;
+
+      for ( n = 0; n < requested_cnt; n++ )
+      {
+        if ( requested_pos[n] < multimaster->axis[n].minimum )
+          requested_pos[n] = multimaster->axis[n].minimum;
+        else if ( requested_pos[n] > multimaster->axis[n].maximum )
+          requested_pos[n] = multimaster->axis[n].maximum;
+      }
+
+      FT_Set_Var_Design_Coordinates( (FT_Face)face,
+                                     requested_cnt,
+                                     requested_pos );
+    }
+
+    error = FT_Err_Ok;
+  }
+
+
+  static const FT_ULong*  sort_counts;
+
+
+  /* sort indices by decreasing count, then by increasing index */
+  static int
+  compare_counts( const void*  a,
+                  const void*  b )
+  {
+    FT_UInt  ia = *(const FT_UInt*)a;
+    FT_UInt  ib = *(const FT_UInt*)b;
+
+
+    if ( sort_counts[ia] != sort_counts[ib] )
+      return sort_counts[ia] < sort_counts[ib] ? 1 : -1;
+
+    return ia < ib ? -1 : ia > ib;
+  }
+
+
+#define TOP_COUNT  20
+
+
+  static void
+  Print_Profile( const PpemCost*  ppems,
+                 int              num_ppems,
+                 FT_Long          num_glyphs )
+  {
+    FT_UInt*  order;
+    FT_ULong  total;
+    FT_UInt   i, n, size;
+    int       k;
+
+
+    total = prof_program[tt_coderange_font] +
+            prof_program[tt_coderange_cvt]  +
+            prof_program[tt_coderange_glyph];
+
+    printf( "%lu instructions executed: `fpgm' %lu, `prep' %lu,"
+            " `glyf' %lu\n"
+            "\n",
+            total,
+            prof_program[tt_coderange_font],
+            prof_program[tt_coderange_cvt],
+            prof_program[tt_coderange_glyph] );
+
+    if ( !total )
+      total = 1;
+
+    printf( "hinting cost per ppem\n"
+            "   ppem        prep        glyf  glyphs  glyf/glyph"
+            "     max  (glyph)\n" );
+    for ( k = 0; k < num_ppems; k++ )
+      printf( "  %5ld %11lu %11lu %7lu %11.1f %7lu  (%ld)\n",
+              ppems[k].ppem,
+              ppems[k].prep,
+              ppems[k].glyf,
+              ppems[k].glyphs,
+              ppems[k].glyphs ? (double)ppems[k].glyf / ppems[k].glyphs
+                              : 0.0,
+              ppems[k].max_glyf,
+              ppems[k].max_glyph );
+
+    size  = num_glyphs > 0x10000L ? (FT_UInt)num_glyphs : 0x10000U;
+    order = (FT_UInt*)malloc( size * sizeof ( FT_UInt ) );
+    if ( !order )
+      Abort( "out of memory" );
+
+    /* glyphs */
+    for ( i = 0; i < (FT_UInt)num_glyphs; i++ )
+      order[i] = i;
+    sort_counts = prof_glyph;
+    qsort( order, (size_t)num_glyphs, sizeof ( FT_UInt ), compare_counts );
+
+    printf( "\n"
+            "most expensive glyphs, all sizes\n"
+            "  glyph   instructions       %%\n" );
+    for ( n = 0;
+          n < TOP_COUNT && n < (FT_UInt)num_glyphs && prof_glyph[order[n]];
+          n++ )
+      printf( "  %5u %14lu  %6.2f\n",
+              order[n], prof_glyph[order[n]],
+              100.0 * prof_glyph[order[n]] / total );
+
+    /* functions */
+    for ( i = 0; i < 0x10000; i++ )
+      order[i] = i;
+    sort_counts = prof_fn_self;
+    qsort( order, 0x10000, sizeof ( FT_UInt ), compare_counts );
+
+    printf( "\n"
+            "most expensive `fpgm' functions, all sizes\n"
+            "  function        calls          self         total       %%\n" );
+    for ( n = 0; n < TOP_COUNT && prof_fn_self[order[n]]; n++ )
+      printf( "  %8u %12lu %13lu %13lu  %6.2f\n",
+              order[n],
+              prof_fn_calls[order[n]],
+              prof_fn_self[order[n]],
+              prof_fn_total[order[n]],
+              100.0 * prof_fn_self[order[n]] / total );
+
+    free( order );
+  }
+
+
+  /* Load all glyphs of `glyphs' at all sizes of `sizes', tracing */
+  /* and profiling all bytecode programs executed.                */
+  static void
+  Run_Batch( const char*  file_name,
+             int          face_index,
+             const Range* glyphs,
+             int          num_glyph_ranges,
+             const Range* sizes,
+             int          num_size_ranges )
+  {
+    int        r, s, k;
+    long       gindex, ppem;
+    FT_Long    num_glyphs;
+    long       loaded = 0, failed = 0;
+    int        num_ppems = 0;
+    PpemCost*  ppems     = NULL;
+
+
+    FT_Set_Debug_Hook( library,
+                       FT_DEBUG_HOOK_TRUETYPE,
+                       BatchIns );
+
+    error = FT_New_Face( library, file_name, face_index, (FT_Face*)&face );
+    if ( error )
+      Abort( "could not open input font file" );
+
+    if ( face->root.driver != driver )
+    {
+      error = FT_Err_Invalid_File_Format;
+      Abort( "this is not a TrueType font" );
+    }
+
+    set_design_coords();
+
+    num_glyphs = face->root.num_glyphs;
+
+    if ( trace_file )
+      fwrite( TRACE_SIGNATURE, 1, 8, trace_file );
+
+    if ( profiling )
+    {
+      for ( s = 0; s < num_size_ranges; s++ )
+        num_ppems += (int)( sizes[s].last - sizes[s].first + 1 );
+
+      ppems         = (PpemCost*)calloc( (size_t)num_ppems,
+                                         sizeof ( PpemCost ) );
+      prof_glyph    = (FT_ULong*)calloc( (size_t)num_glyphs + 1,
+                                         sizeof ( FT_ULong ) );
+      prof_fn_self  = (FT_ULong*)calloc( 0x10000, sizeof ( FT_ULong ) );
+      prof_fn_total = (FT_ULong*)calloc( 0x10000, sizeof ( FT_ULong ) );
+      prof_fn_calls = (FT_ULong*)calloc( 0x10000, sizeof ( FT_ULong ) );
+      if ( !ppems || !prof_glyph                         ||
+           !prof_fn_self || !prof_fn_total || !prof_fn_calls )
+        Abort( "out of memory" );
+    }
+
+    k = 0;
+    for ( s = 0; s < num_size_ranges; s++ )
+      for ( ppem = sizes[s].first; ppem <= sizes[s].last; ppem++, k++ )
+      {
+        if ( trace_file )
+          trace_record( 'S', (FT_ULong)ppem, 2, 0, 0 );
+
+        if ( profiling )
+        {
+          cur_ppem       = ppems + k;
+          cur_ppem->ppem = ppem;
+        }
+
+        error = FT_Set_Char_Size( (FT_Face)face,
+                                  ppem << 6, ppem << 6, 72, 72 );
+        if ( error )
+          Abort( "could not set character size" );
+
+        for ( r = 0; r < num_glyph_ranges; r++ )
+          for ( gindex = glyphs[r].first;
+                gindex <= glyphs[r].last && gindex < num_glyphs;
+                gindex++ )
+          {
+            if ( trace_file )
+              trace_record( 'G', (FT_ULong)gindex, 4, 0, 0 );
+
+            cur_glyph      = gindex;
+            cur_glyph_cost = 0;
+
+            if ( FT_Load_Glyph( (FT_Face)face,
+                                (FT_UInt)gindex,
+                                FT_LOAD_NO_BITMAP ) )
+              failed++;
+            loaded++;
+
+            if ( profiling )
+            {
+              cur_ppem->glyphs++;
+              if ( cur_glyph_cost > cur_ppem->max_glyf )
+              {
+                cur_ppem->max_glyf  = cur_glyph_cost;
+                cur_ppem->max_glyph = gindex;
+              }
+            }
+          }
+      }
+
+    FT_Done_Face( (FT_Face)face );
+
+    if ( trace_file && ferror( trace_file ) )
+    {
+      fprintf( stderr, "error while writing trace\n" );
+      exit( 1 );
+    }
+
+    fprintf( stderr, "%ld glyphs loaded, %ld failed\n", loaded, failed );
+
+    if ( profiling )
+    {
+      Print_Profile( ppems, num_ppems, num_glyphs );
+
+      free( ppems );
+      free( prof_glyph );
+      free( prof_fn_self );
+      free( prof_fn_total );
+      free( prof_fn_calls );
+    }
+  }
+
+
+  /* the number of bytes following the type byte of a trace record */
+  static size_t
+  trace_payload_size( int  type )
+  {
+    switch ( type )
+    {
+    case 'R':
+      return 1;
+    case 'S':
+    case 'E':
+      return 2;
+    case 'F':
+    case 'T':
+      return 3;
+    case 'G':
+      return 4;
+    case 'I':
+      return 8;
+    default:
+      return 0;
+    }
+  }
+
+
+  /* Print per-opcode counts and the hottest `fpgm' functions of a */
+  /* trace.  Instructions are attributed to the innermost function */
+  /* they are executed in.                                         */
+  static void
+  Summarize_Trace( const char*  name )
+  {
+    FILE*     f;
+    FT_Byte   rec[9];
+    FT_ULong  op_count[256];
+    FT_ULong  range_count[4];
+    FT_ULong  program_count[4];
+    FT_ULong* fn_instructions;
+    FT_ULong* fn_calls;
+    FT_UInt*  order;
+    FT_ULong  total   = 0;
+    FT_ULong  glyphs  = 0;
+    FT_ULong  errors  = 0;
+    FT_ULong  touched = 0;
+    FT_UInt   cur_fn  = 0xFFFFU;
+    FT_UInt   depth   = 0;
+    FT_UInt   i, n;
+    int       type;
+
+
+    f = fopen( name, "rb" );
+    if ( !f )
+    {
+      fprintf( stderr, "could not open trace `%s'\n", name );
+      exit( 1 );
+    }
+
+    if ( fread( rec, 1, 8, f ) != 8 || memcmp( rec, TRACE_SIGNATURE, 8 ) )
+    {
+      fprintf( stderr, "`%s' is not a ttdebug trace\n", name );
+      exit( 1 );
+    }
+
+    memset( op_count, 0, sizeof ( op_count ) );
+    memset( range_count, 0, sizeof ( range_count ) );
+    memset( program_count, 0, sizeof ( program_count ) );
+
+    fn_instructions = (FT_ULong*)calloc( 0x10000, sizeof ( FT_ULong ) );
+    fn_calls        = (FT_ULong*)calloc( 0x10000, sizeof ( FT_ULong ) );
+    order           = (FT_UInt*)malloc( 0x10000 * sizeof ( FT_UInt ) );
+    if ( !fn_instructions || !fn_calls || !order )
+    {
+      fprintf( stderr, "out of memory\n" );
+      exit( 1 );
+    }
+
+    while ( ( type = getc( f ) ) != EOF )
+    {
+      size_t  size = trace_payload_size( type );
+
+
+      if ( !size || fread( rec, 1, size, f ) != size )
+      {
+        fprintf( stderr, "`%s': corrupt trace\n", name );
+        exit( 1 );
+      }
+
+      switch ( type )
+      {
+      case 'G':
+        glyphs++;
+        break;
+
+      case 'R':
+        program_count[rec[0] & 3]++;
+        cur_fn = 0xFFFFU;
+        depth  = 0;
+        break;
+
+      case 'I':
+        op_count[rec[0]]++;
+        range_count[rec[1] & 3]++;
+        if ( cur_fn != 0xFFFFU )
+          fn_instructions[cur_fn]++;
+        total++;
+        break;
+
+      case 'F':
+        cur_fn = rec[0] | ( rec[1] << 8 );
+        if ( rec[2] > depth && cur_fn != 0xFFFFU )
+          fn_calls[cur_fn]++;
+        depth = rec[2];
+        break;
+
+      case 'T':
+        touched++;
+        break;
+
+      case 'E':
+        errors++;
+        break;
+      }
+    }
+
+    fclose( f );
+
+    printf( "%s: %lu instructions in %lu `fpgm', %lu `prep',"
+            " and %lu `glyf' programs\n",
+            name, total,
+            program_count[tt_coderange_font],
+            program_count[tt_coderange_cvt],
+            program_count[tt_coderange_glyph] );
+    printf( "  %lu glyphs loaded, %lu errors", glyphs, errors );
+    if ( touched )
+      printf( ", %lu point moves", touched );
+    printf( "\n"
+            "  executed in `fpgm' %lu, `prep' %lu, `glyf' %lu\n"
+            "\n",
+            range_count[tt_coderange_font],
+            range_count[tt_coderange_cvt],
+            range_count[tt_coderange_glyph] );
+
+    if ( !total )
+      total = 1;
+
+    /* opcodes */
+    for ( i = 0; i < 256; i++ )
+      order[i] = i;
+    sort_counts = op_count;
+    qsort( order, 256, sizeof ( FT_UInt ), compare_counts );
+
+    printf( "opcode                      count       %%\n" );
+    for ( i = 0; i < 256 && op_count[order[i]]; i++ )
+      printf( "  %02x %-16s %12lu  %6.2f\n",
+              order[i], OpStr[order[i]], op_count[order[i]],
+              100.0 * op_count[order[i]] / total );
+
+    /* functions */
+    for ( i = 0; i < 0x10000; i++ )
+      order[i] = i;
+    sort_counts = fn_instructions;
+    qsort( order, 0x10000, sizeof ( FT_UInt ), compare_counts );
+
+    printf( "\n"
+            "function          calls  instructions       %%\n" );
+    for ( n = 0; n < TOP_COUNT && fn_instructions[order[n]]; n++ )
+      printf( "  %5u %13lu %13lu  %6.2f\n",
+              order[n], fn_calls[order[n]], fn_instructions[order[n]],
+              100.0 * fn_instructions[order[n]] / total );
+
+    free( fn_instructions );
+    free( fn_calls );
+    free( order );
+  }
+
+
   static void
   Usage( const char*  execname )
   {
@@ -2879,7 +3613,10 @@
       "\n" );
     fprintf( stderr,
       "Usage: %s [options] idx size font\n"
-      "\n", execname );
+      "       %s -t trace [-p] [options] idx-list size-list font\n"
+      "       %s -P [options] idx-list size-list font\n"
+      "       %s -s trace\n"
+      "\n", execname, execname, execname, execname );
     fprintf( stderr,
       "  idx       The index of the glyph to debug.\n"
       "  size      The size of the glyph in pixels (ppem).\n"
@@ -2893,6 +3630,14 @@
       "            at start-up (ignored if not a variation font).\n"
       "  -v        Show version.\n"
       "\n"
+      "  -t trace  Run non-interactively for all glyphs and sizes given as\n"
+      "            comma-separated lists of numbers and ranges (like\n"
+      "            `0-99,120'), writing a binary instruction trace.\n"
+      "  -p        Also trace the points moved by each instruction.\n"
+      "  -P        Like `-t' but (or also) print a profile: instruction\n"
+      "            counts per size, glyph, and `fpgm' function.\n"
+      "  -s trace  Summarize a trace: opcode counts and hottest functions.\n"
+      "\n"
       "While running, press the `?' key for help.\n"
       "\n",
       versions,
@@ -2923,6 +3668,8 @@
 
     int  tmp;
 
+    const char*  trace_name = NULL;
+
 
     /* init library, read face object, get driver, create size */
     error = FT_Init_FreeType( &library );
@@ -2970,7 +3717,7 @@
 
     while ( 1 )
     {
-      option = getopt( argc, argv, "I:d:f:v" );
+      option = getopt( argc, argv, "I:Pd:f:ps:t:v" );
 
       if ( option == -1 )
         break;
@@ -3004,6 +3751,10 @@
         }
         break;
 
+      case 'P':
+        profiling = 1;
+        break;
+
       case 'd':
         parse_design_coords( optarg );
         break;
@@ -3012,6 +3763,19 @@
         face_index = atoi( optarg );
         break;
 
+      case 'p':
+        trace_points = 1;
+        break;
+
+      case 's':
+        Summarize_Trace( optarg );
+        exit( 0 );
+        /* break; */
+
+      case 't':
+        trace_name = optarg;
+        break;
+
       case 'v':
         printf( "%s\n", version_string );
         exit( 0 );
@@ -3029,6 +3793,52 @@
     if ( argc < 3 )
       Usage( execname );
 
+    if ( trace_name || profiling )
+    {
+      Range  glyphs[MAX_RANGES];
+      Range  sizes[MAX_RANGES];
+      int    num_glyph_ranges, num_size_ranges;
+
+
+      num_glyph_ranges = parse_ranges( argv[0], glyphs );
+      if ( !num_glyph_ranges )
+      {
+        printf( "invalid glyph index list = %s\n", argv[0] );
+        Usage( execname );
+      }
+
+      num_size_ranges = parse_ranges( argv[1], sizes );
+      if ( !num_size_ranges )
+      {
+        printf( "invalid glyph size list = %s\n", argv[1] );
+        Usage( execname );
+      }
+
+      if ( trace_name )
+      {
+        trace_file = fopen( trace_name, "wb" );
+        if ( !trace_file )
+        {
+          fprintf( stderr, "could not open `%s' for writing\n",
+                   trace_name );
+          exit( 1 );
+        }
+      }
+
+      Run_Batch( argv[2], face_index,
+                 glyphs, num_glyph_ranges,
+                 sizes, num_size_ranges );
+
+      if ( trace_file )
+        fclose( trace_file );
+
+      FT_Done_MM_Var( library, multimaster );
+      FT_Done_FreeType( library );
+      free( requested_pos );
+
+      return 0;
+    }
+
     /* get glyph index */
     if ( sscanf( argv[0], "%d", &tmp ) != 1 || tmp < 0 )
     {
@@ -3070,30 +3880,7 @@
         Abort( "this is not a TrueType font" );
       }
 
-      FT_Done_MM_Var( library, multimaster );
-      error = FT_Get_MM_Var( (FT_Face)face, &multimaster );
-      if ( error )
-        multimaster = NULL;
-      else
-      {
-        unsigned int  n;
-
-
-        if ( requested_cnt > multimaster->num_axis )
-          requested_cnt = multimaster->num_axis;
-
-        for ( n = 0; n < requested_cnt; n++ )
-        {
-          if ( requested_pos[n] < multimaster->axis[n].minimum )
-            requested_pos[n] = multimaster->axis[n].minimum;
-          else if ( requested_pos[n] > multimaster->axis[n].maximum )
-            requested_pos[n] = multimaster->axis[n].maximum;
-        }
-
-        FT_Set_Var_Design_Coordinates( (FT_Face)face,
-                                       requested_cnt,
-                                       requested_pos );
-      }
+      set_design_coords();
 
       size = (TT_Size)face->root.size;
 